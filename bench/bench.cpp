@@ -0,0 +1,976 @@
+//
+//  bench.cpp
+//  rdvlisp
+//
+//  Created by Ruben De Visscher on 18/10/26.
+//  Copyright (c) 2026 Ruben De Visscher. All rights reserved.
+//
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <deque>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <new>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "corpus.h"
+#include "eval.h"
+#include "macros.h"
+#include "memory.h"
+#include "modules.h"
+#include "optimize.h"
+#include "persistent.h"
+#include "profile.h"
+#include "reader.h"
+#include "rope.h"
+#include "server.h"
+#include "snapshot.h"
+
+using namespace rdvlisp;
+
+// Every allocation in the process goes through here so phases can report how
+// many they made. The array and sized forms are replaced too, so that every
+// form of delete frees what the matching new allocated.
+static std::atomic<uint64_t> allocation_count(0);
+static std::atomic<uint64_t> allocated_bytes(0);
+
+static void * counted_allocation(size_t size) {
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+    if(void * p = std::malloc(size == 0 ? 1 : size)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void * operator new(size_t size) {
+    return counted_allocation(size);
+}
+
+void * operator new[](size_t size) {
+    return counted_allocation(size);
+}
+
+void operator delete(void * p) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void * p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void * p, size_t) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void * p, size_t) noexcept {
+    std::free(p);
+}
+
+// Peak resident set size in kilobytes since the last reset_peak_rss. Linux
+// lets the high-water mark be reset, elsewhere it is the peak of the process.
+static void reset_peak_rss() {
+    std::ofstream clear_refs("/proc/self/clear_refs");
+    if(clear_refs) {
+        clear_refs << "5";
+    }
+}
+
+static long peak_rss() {
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while(std::getline(status, line)) {
+        if(line.compare(0, 6, "VmHWM:") == 0) {
+            return std::strtol(line.c_str() + 6, nullptr, 10);
+        }
+    }
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+    return usage.ru_maxrss / 1024;
+#else
+    return usage.ru_maxrss;
+#endif
+}
+
+class Options {
+public:
+    size_t size = 1 << 20;
+    size_t repeat = 5;
+    std::string filter;
+    std::string output;
+};
+
+class Measurement {
+public:
+    double seconds = std::numeric_limits<double>::infinity();
+    uint64_t allocations = 0;
+    uint64_t allocated_bytes = 0;
+    long peak_rss_kb = 0;
+};
+
+// Runs f repeat times and keeps the fastest run; allocations and peak RSS are
+// those of the last run, which every run should match.
+static Measurement measure(size_t repeat, const std::function<void()>& f) {
+    Measurement measurement;
+    for(size_t i = 0; i < repeat; ++i) {
+        reset_peak_rss();
+        uint64_t allocations = allocation_count.load();
+        uint64_t bytes = allocated_bytes.load();
+        auto start = std::chrono::steady_clock::now();
+        f();
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        measurement.seconds = std::min(measurement.seconds, elapsed.count());
+        measurement.allocations = allocation_count.load() - allocations;
+        measurement.allocated_bytes = allocated_bytes.load() - bytes;
+        measurement.peak_rss_kb = peak_rss();
+    }
+    return measurement;
+}
+
+// Minimal JSON writer, objects are written as a flat list of fields.
+class Json {
+    std::ostringstream out_;
+    bool first_ = true;
+public:
+    Json& field(const std::string& name, const std::string& value) {
+        key(name);
+        write_string(value);
+        return *this;
+    }
+    // JSON has no infinities or NaN, e.g. the ratio of two runs too short to
+    // time, they are written as null.
+    Json& field(const std::string& name, double value) {
+        key(name);
+        if(std::isfinite(value)) {
+            out_ << value;
+        } else {
+            out_ << "null";
+        }
+        return *this;
+    }
+    Json& field(const std::string& name, uint64_t value) {
+        key(name);
+        out_ << value;
+        return *this;
+    }
+    Json& field(const std::string& name, long value) {
+        key(name);
+        out_ << value;
+        return *this;
+    }
+    Json& measurement(const Measurement& m) {
+        return field("seconds", m.seconds).field("allocations", m.allocations).field("allocated_bytes", m.allocated_bytes).field("peak_rss_kb", m.peak_rss_kb);
+    }
+    std::string str() const {
+        return "{" + out_.str() + "}";
+    }
+private:
+    void write_string(const std::string& s) {
+        out_ << '"';
+        for(char c : s) {
+            if(c == '"' or c == '\\') {
+                out_ << '\\' << c;
+            } else if(static_cast<unsigned char>(c) < 0x20) {
+                char escaped[8];
+                std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                out_ << escaped;
+            } else {
+                out_ << c;
+            }
+        }
+        out_ << '"';
+    }
+    void key(const std::string& name) {
+        if(!first_) {
+            out_ << ", ";
+        }
+        first_ = false;
+        write_string(name);
+        out_ << ": ";
+    }
+};
+
+static uint64_t count_nodes(const ast::ExpressionRef& expression) {
+    uint64_t count = 1;
+    if(auto tuple = boost::get<ast::Tuple>(&expression->variant)) {
+        for(auto& element : tuple->elements) {
+            count += count_nodes(element);
+        }
+    }
+    return count;
+}
+
+static std::vector<ast::ExpressionRef> read_forms(const SourceRef& buffer) {
+    auto& source = *buffer;
+    std::vector<ast::ExpressionRef> forms;
+    size_t current = 0;
+    while(true) {
+        while(current < source.size() and std::isspace(source[current])) {
+            ++current;
+        }
+        if(current >= source.size()) {
+            break;
+        }
+        auto r = read(buffer, current);
+        if(r.fail()) {
+            throw ReadError(r.error(), r.start, r.end);
+        }
+        forms.push_back(r.get());
+        current = r.end;
+    }
+    return forms;
+}
+
+static std::vector<ast::ExpressionRef> read_forms(const std::string& source) {
+    return read_forms(make_source(source));
+}
+
+static bool selected(const Options& options, const std::string& name) {
+    return options.filter.empty() or name.find(options.filter) != std::string::npos;
+}
+
+// Whether any of the cases names is selected, so that the setup they share
+// can be skipped if none is.
+static bool selected(const Options& options, const std::vector<std::string>& names) {
+    for(auto& name : names) {
+        if(selected(options, name)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static Json phase(const std::string& corpus, const std::string& name, uint64_t bytes, uint64_t nodes, const Measurement& m) {
+    std::cerr << corpus << "/" << name << ": " << bytes / m.seconds / 1e6 << " MB/s, " << nodes / m.seconds << " nodes/s, " << m.allocations << " allocations" << std::endl;
+    Json json;
+    json.field("name", corpus + "/" + name).field("bytes", bytes).field("nodes", nodes).field("mb_per_s", bytes / m.seconds / 1e6).field("nodes_per_s", nodes / m.seconds).measurement(m);
+    return json;
+}
+
+// Memory per subsystem while reading and evaluating a corpus once: the peak,
+// what is still live once the forms are dropped, and the allocations made.
+static Json memory_usage(const bench::Corpus& corpus) {
+    runtime::Runtime runtime(1);
+    bench::prepare_runtime(runtime);
+    std::vector<memory::Usage> before;
+    for(size_t i = 0; i < memory::subsystem_count; ++i) {
+        before.push_back(memory::usage(static_cast<memory::Subsystem>(i)));
+    }
+    memory::reset_peak();
+    {
+        auto forms = read_forms(corpus.source);
+        for(auto& form : forms) {
+            runtime.eval(form);
+        }
+    }
+    Json json;
+    json.field("name", corpus.name + "/memory");
+    std::cerr << corpus.name << "/memory:";
+    for(size_t i = 0; i < memory::subsystem_count; ++i) {
+        auto subsystem = static_cast<memory::Subsystem>(i);
+        auto after = memory::usage(subsystem);
+        std::string name = memory::name(subsystem);
+        uint64_t peak = after.peak_bytes - before[i].live_bytes;
+        std::cerr << " " << name << " " << peak / 1024 << " KB";
+        json.field(name + "_peak_bytes", peak)
+            .field(name + "_retained_bytes", after.live_bytes - before[i].live_bytes)
+            .field(name + "_allocations", after.allocations - before[i].allocations);
+    }
+    std::cerr << std::endl;
+    return json;
+}
+
+static void run_corpora(const Options& options, std::vector<std::string>& results) {
+    for(auto& corpus : bench::make_corpora(options.size)) {
+        std::vector<std::string> phases;
+        for(auto phase : {"read", "print", "eval", "optimize", "memory"}) {
+            phases.push_back(corpus.name + "/" + phase);
+        }
+        if(!selected(options, phases)) {
+            continue;
+        }
+        auto source = make_source(corpus.source);
+        std::vector<ast::ExpressionRef> forms = read_forms(source);
+        uint64_t nodes = 0;
+        for(auto& form : forms) {
+            nodes += count_nodes(form);
+        }
+        uint64_t bytes = corpus.source.size();
+
+        if(selected(options, corpus.name + "/read")) {
+            auto m = measure(options.repeat, [&] {
+                read_forms(source);
+            });
+            results.push_back(phase(corpus.name, "read", bytes, nodes, m).str());
+        }
+        if(selected(options, corpus.name + "/print")) {
+            uint64_t printed = 0;
+            auto m = measure(options.repeat, [&] {
+                std::ostringstream out;
+                for(auto& form : forms) {
+                    out << *form << '\n';
+                }
+                printed = out.tellp();
+            });
+            results.push_back(phase(corpus.name, "print", printed, nodes, m).str());
+        }
+        if(selected(options, corpus.name + "/eval")) {
+            runtime::Runtime runtime(1);
+            bench::prepare_runtime(runtime);
+            auto m = measure(options.repeat, [&] {
+                for(auto& form : forms) {
+                    runtime.eval(form);
+                }
+            });
+            results.push_back(phase(corpus.name, "eval", bytes, nodes, m).str());
+        }
+        if(selected(options, corpus.name + "/optimize")) {
+            runtime::Runtime runtime(1);
+            bench::prepare_runtime(runtime);
+            std::vector<ast::ExpressionRef> optimized;
+            auto m = measure(options.repeat, [&] {
+                optimized.clear();
+                for(auto& form : forms) {
+                    optimized.push_back(optimize::optimize(runtime, form));
+                }
+            });
+            results.push_back(phase(corpus.name, "optimize", bytes, nodes, m).str());
+            auto baseline = measure(options.repeat, [&] {
+                for(auto& form : forms) {
+                    runtime.eval(form);
+                }
+            });
+            m = measure(options.repeat, [&] {
+                for(auto& form : optimized) {
+                    runtime.eval(form);
+                }
+            });
+            auto json = phase(corpus.name, "optimized-eval", bytes, nodes, m);
+            json.field("eval_reduction", 1 - m.seconds / baseline.seconds);
+            std::cerr << corpus.name << "/optimized-eval: " << 100 * (1 - m.seconds / baseline.seconds) << "% less time than eval" << std::endl;
+            results.push_back(json.str());
+        }
+        if(selected(options, corpus.name + "/memory")) {
+            results.push_back(memory_usage(corpus).str());
+        }
+    }
+}
+
+static uint64_t allocations() {
+    return allocation_count.load(std::memory_order_relaxed);
+}
+
+// Overhead of profiling the evaluation of the deep corpus, the one with the
+// most calls per byte, compared to evaluating it without a profiler. The cold
+// run is the first one with a new profiler, which names every span it sees,
+// the others see them again.
+static void run_profile(const Options& options, std::vector<std::string>& results) {
+    if(!selected(options, std::vector<std::string>{"profile/disabled", "profile/counters", "profile/sampling"})) {
+        return;
+    }
+    auto corpora = bench::make_corpora(options.size);
+    auto& corpus = corpora[1];
+    std::vector<ast::ExpressionRef> forms = read_forms(corpus.source);
+    std::vector<std::pair<std::string, std::function<profile::Profiler *()>>> modes = {
+        {"profile/disabled", [] {
+            return nullptr;
+        }},
+        {"profile/counters", [] {
+            return new profile::Profiler(profile::Profiler::Mode::Counters, allocations);
+        }},
+        {"profile/sampling", [] {
+            return new profile::Profiler(profile::Profiler::Mode::Sampling);
+        }},
+    };
+    double baseline = 0;
+    double cold_baseline = 0;
+    for(auto& mode : modes) {
+        if(!selected(options, mode.first)) {
+            continue;
+        }
+        runtime::Runtime runtime(1);
+        bench::prepare_runtime(runtime);
+        auto run = [&] {
+            for(auto& form : forms) {
+                runtime.eval(form);
+            }
+        };
+        std::unique_ptr<profile::Profiler> cold_profiler(mode.second());
+        runtime.set_profiler(cold_profiler.get());
+        auto cold = measure(1, run);
+        runtime.set_profiler(nullptr);
+        cold_profiler.reset();
+        std::unique_ptr<profile::Profiler> profiler(mode.second());
+        runtime.set_profiler(profiler.get());
+        auto m = measure(options.repeat, run);
+        runtime.set_profiler(nullptr);
+        if(profiler.get() == nullptr) {
+            baseline = m.seconds;
+            cold_baseline = cold.seconds;
+        }
+        Json json;
+        json.field("name", mode.first).field("bytes", static_cast<uint64_t>(corpus.source.size())).field("cold_seconds", cold.seconds);
+        if(baseline > 0) {
+            std::cerr << mode.first << ": " << m.seconds / baseline << "x, cold " << cold.seconds / cold_baseline << "x" << std::endl;
+            json.field("overhead", m.seconds / baseline).field("cold_overhead", cold.seconds / cold_baseline);
+        }
+        if(profiler.get() != nullptr and profiler->mode() == profile::Profiler::Mode::Sampling) {
+            json.field("samples", static_cast<uint64_t>(profiler->samples()));
+        }
+        results.push_back(json.measurement(m).str());
+    }
+}
+
+// pmap over a large array with 1 to 32 threads, once with a function that
+// only computes and once with one that mostly allocates.
+static void run_parallel(const Options& options, std::vector<std::string>& results) {
+    auto compute = [](runtime::Runtime& runtime, const std::vector<runtime::ValueRef>& arguments) -> runtime::ValueRef {
+        uint64_t x = boost::get<int64_t>(boost::get<runtime::Integer>(arguments[0]->variant).value) + 1;
+        for(int i = 0; i < 2000; ++i) {
+            x ^= x << 13;
+            x ^= x >> 7;
+            x ^= x << 17;
+        }
+        return runtime::make_value(runtime::Integer(static_cast<int64_t>(x >> 1)));
+    };
+    auto allocate = [](runtime::Runtime& runtime, const std::vector<runtime::ValueRef>& arguments) -> runtime::ValueRef {
+        std::vector<runtime::ValueRef> elements;
+        for(int i = 0; i < 64; ++i) {
+            elements.push_back(runtime::make_value(runtime::String(std::string(48, 'x'))));
+        }
+        return runtime::make_value(runtime::Array(elements, types::string));
+    };
+    std::vector<std::pair<std::string, runtime::Builtin>> functions = {
+        {"compute", runtime::Builtin("compute", compute)},
+        {"allocate", runtime::Builtin("allocate", allocate)},
+    };
+
+    size_t count = std::max<size_t>(options.size / 64, 1024);
+    std::vector<runtime::ValueRef> elements;
+    for(size_t i = 0; i < count; ++i) {
+        elements.push_back(runtime::make_value(runtime::Integer(static_cast<int64_t>(i))));
+    }
+    auto array = runtime::make_value(runtime::Array(elements, types::sint64));
+
+    for(auto& function : functions) {
+        double baseline = 0;
+        for(size_t threads : {1, 2, 4, 8, 16, 32}) {
+            std::string name = "pmap/" + function.first + "/" + std::to_string(threads);
+            if(!selected(options, name)) {
+                continue;
+            }
+            runtime::Runtime runtime(threads);
+            auto pmap = runtime.value_namespace.lookup(ast::Identifier(std::vector<std::string>{"pmap"}));
+            auto callable = runtime::make_value(function.second);
+            auto m = measure(options.repeat, [&] {
+                runtime.apply(pmap, {callable, array});
+            });
+            if(threads == 1) {
+                baseline = m.seconds;
+            }
+            std::cerr << name << ": " << count / m.seconds << " elements/s" << std::endl;
+            Json json;
+            json.field("name", name).field("elements", static_cast<uint64_t>(count)).field("threads", static_cast<uint64_t>(threads)).field("elements_per_s", count / m.seconds);
+            if(baseline > 0) {
+                json.field("speedup", baseline / m.seconds);
+            }
+            results.push_back(json.measurement(m).str());
+        }
+    }
+}
+
+// Building a string from small pieces and taking slices of a large one, as a
+// Rope and as a std::string copied on every operation the way values were.
+// Also appending pieces too long to be merged, which makes the deepest trees,
+// and comparing the result with a flat copy.
+static void run_rope(const Options& options, std::vector<std::string>& results) {
+    if(!selected(options, std::vector<std::string>{"rope/concat/rope", "rope/concat/string", "rope/append/rope", "rope/equal/rope", "rope/slice/rope", "rope/slice/string"})) {
+        return;
+    }
+    size_t pieces = std::max<size_t>(options.size / 128, 256);
+    std::string piece = "0123456789abcdef";
+    size_t appends = 80000;
+    std::string chunk(40, 'y');
+    Rope appended;
+    for(size_t i = 0; i < appends; ++i) {
+        appended = appended + Rope(chunk);
+    }
+    Rope flat(appended.str());
+    std::mt19937 rng(42);
+    std::string large(options.size, 'x');
+    std::vector<std::pair<size_t, size_t>> ranges;
+    for(size_t i = 0; i < 100000; ++i) {
+        size_t length = std::min<size_t>(1000 + rng() % 9000, large.size());
+        size_t begin = rng() % (large.size() - length + 1);
+        ranges.push_back(std::make_pair(begin, begin + length));
+    }
+    Rope large_rope(large);
+
+    std::vector<std::pair<std::string, std::function<void()>>> cases = {
+        {"rope/concat/rope", [&] {
+            Rope result;
+            for(size_t i = 0; i < pieces; ++i) {
+                result = result + Rope(piece);
+            }
+        }},
+        {"rope/concat/string", [&] {
+            std::string result;
+            for(size_t i = 0; i < pieces; ++i) {
+                result = result + piece;
+            }
+        }},
+        {"rope/append/rope", [&] {
+            Rope result;
+            for(size_t i = 0; i < appends; ++i) {
+                result = result + Rope(chunk);
+            }
+        }},
+        {"rope/equal/rope", [&] {
+            for(size_t i = 0; i < 100; ++i) {
+                if(appended != flat) {
+                    std::abort();
+                }
+            }
+        }},
+        {"rope/slice/rope", [&] {
+            for(auto& range : ranges) {
+                large_rope.slice(range.first, range.second);
+            }
+        }},
+        {"rope/slice/string", [&] {
+            for(auto& range : ranges) {
+                large.substr(range.first, range.second - range.first);
+            }
+        }},
+    };
+    for(auto& c : cases) {
+        if(!selected(options, c.first)) {
+            continue;
+        }
+        auto m = measure(options.repeat, c.second);
+        std::cerr << c.first << ": " << m.seconds * 1e3 << " ms" << std::endl;
+        Json json;
+        json.field("name", c.first).measurement(m);
+        results.push_back(json.str());
+    }
+}
+
+// Startup of a runtime with a library of functions and tables, built from
+// source and from a snapshot of a runtime it was built in.
+static void run_snapshot(const Options& options, std::vector<std::string>& results) {
+    if(!selected(options, std::vector<std::string>{"snapshot/cold", "snapshot/load"})) {
+        return;
+    }
+    size_t count = std::max<size_t>(options.size / 256, 256);
+    std::string image;
+    {
+        runtime::Runtime runtime(1);
+        bench::prepare_runtime(runtime);
+        bench::load_library(runtime, count);
+        image = snapshot::save(runtime);
+    }
+
+    double baseline = 0;
+    std::vector<std::pair<std::string, std::function<void()>>> cases = {
+        {"snapshot/cold", [&] {
+            runtime::Runtime runtime(1);
+            bench::prepare_runtime(runtime);
+            bench::load_library(runtime, count);
+        }},
+        {"snapshot/load", [&] {
+            runtime::Runtime runtime(1);
+            bench::install_builtins(runtime);
+            snapshot::load(runtime, image.data(), image.size());
+        }},
+    };
+    for(auto& c : cases) {
+        if(!selected(options, c.first)) {
+            continue;
+        }
+        auto m = measure(options.repeat, c.second);
+        if(baseline == 0) {
+            baseline = m.seconds;
+        }
+        std::cerr << c.first << ": " << m.seconds * 1e3 << " ms" << std::endl;
+        Json json;
+        json.field("name", c.first).field("functions", static_cast<uint64_t>(count)).field("snapshot_bytes", static_cast<uint64_t>(image.size())).field("speedup", baseline / m.seconds);
+        results.push_back(json.measurement(m).str());
+    }
+}
+
+// Loading a library of modules by compiling them, from the module cache, and
+// lazily, when only one function of it is used.
+static void run_modules(const Options& options, std::vector<std::string>& results) {
+    if(!selected(options, std::vector<std::string>{"modules/compile", "modules/cached", "modules/lazy"})) {
+        return;
+    }
+    size_t count = 16;
+    auto modules = bench::make_modules(count, std::max<size_t>(options.size / 4096, 16));
+    char directory_template[] = "/tmp/rdvlisp_bench.XXXXXX";
+    if(mkdtemp(directory_template) == nullptr) {
+        std::cerr << "modules: could not create a temporary directory" << std::endl;
+        return;
+    }
+    std::string directory = directory_template;
+    std::string cache = directory + "/cache";
+    mkdir((directory + "/lib").c_str(), 0700);
+    mkdir(cache.c_str(), 0700);
+    std::vector<std::string> files;
+    for(auto& module : modules) {
+        files.push_back(directory + "/lib/" + module.name.substr(4) + ".rdv");
+        std::ofstream(files.back()) << module.source;
+    }
+    {
+        runtime::Runtime runtime(1);
+        bench::prepare_runtime(runtime);
+        modules::Loader loader(runtime, {directory}, cache);
+        loader.require(modules.back().name);
+    }
+
+    double baseline = 0;
+    std::vector<std::pair<std::string, std::string>> cases = {
+        {"modules/compile", ""},
+        {"modules/cached", cache},
+        {"modules/lazy", cache},
+    };
+    for(auto& c : cases) {
+        if(!selected(options, c.first)) {
+            continue;
+        }
+        modules::Loader::Statistics statistics;
+        auto m = measure(options.repeat, [&] {
+            runtime::Runtime runtime(1);
+            bench::prepare_runtime(runtime);
+            modules::Loader loader(runtime, {directory}, c.second);
+            if(c.first == "modules/lazy") {
+                runtime.eval(read("(lib.m0.g0 1)").get());
+            } else {
+                loader.require(modules.back().name);
+            }
+            statistics = loader.statistics();
+        });
+        if(baseline == 0) {
+            baseline = m.seconds;
+        }
+        std::cerr << c.first << ": " << m.seconds * 1e3 << " ms, " << statistics.compiled + statistics.restored << " modules" << std::endl;
+        Json json;
+        json.field("name", c.first).field("compiled", static_cast<uint64_t>(statistics.compiled)).field("restored", static_cast<uint64_t>(statistics.restored)).field("speedup", baseline / m.seconds);
+        results.push_back(json.measurement(m).str());
+    }
+
+    for(auto& module : modules) {
+        unlink((cache + "/" + module.name + ".rdvc").c_str());
+    }
+    for(auto& file : files) {
+        unlink(file.c_str());
+    }
+    rmdir(cache.c_str());
+    rmdir((directory + "/lib").c_str());
+    rmdir(directory.c_str());
+}
+
+// Expanding macro-dense code, and expanding the same code read again with
+// the expansions of the first time memoized.
+static void run_macros(const Options& options, std::vector<std::string>& results) {
+    if(!selected(options, std::vector<std::string>{"macros/expand", "macros/memoized"})) {
+        return;
+    }
+    auto corpus = bench::make_macro_corpus(options.size);
+    auto forms = read_forms(corpus.source);
+    auto reread = read_forms(corpus.source);
+    macros::Cache cache;
+    macros::Expander(&cache).expand_all(forms);
+
+    double baseline = 0;
+    std::vector<std::pair<std::string, macros::Cache *>> cases = {
+        {"macros/expand", nullptr},
+        {"macros/memoized", &cache},
+    };
+    for(auto& c : cases) {
+        if(!selected(options, c.first)) {
+            continue;
+        }
+        macros::Expander::Statistics statistics;
+        auto m = measure(options.repeat, [&] {
+            macros::Expander expander(c.second);
+            expander.expand_all(reread);
+            statistics = expander.statistics();
+        });
+        if(baseline == 0) {
+            baseline = m.seconds;
+        }
+        std::cerr << c.first << ": " << corpus.source.size() / m.seconds / 1e6 << " MB/s, " << statistics.forms / m.seconds << " forms/s" << std::endl;
+        Json json;
+        json.field("name", c.first).field("bytes", static_cast<uint64_t>(corpus.source.size())).field("forms", static_cast<uint64_t>(statistics.forms)).field("macro_calls", static_cast<uint64_t>(statistics.calls)).field("cached", static_cast<uint64_t>(statistics.cached));
+        json.field("mb_per_s", corpus.source.size() / m.seconds / 1e6).field("speedup", baseline / m.seconds);
+        results.push_back(json.measurement(m).str());
+    }
+}
+
+// Updates of one element at a time of a vector and a map of count elements,
+// persistent against copying the whole container as Array has to.
+static void run_persistent(const Options& options, std::vector<std::string>& results) {
+    if(!selected(options, std::vector<std::string>{"persistent/vector/copy", "persistent/vector/assoc", "persistent/vector/transient", "persistent/map/copy", "persistent/map/assoc", "persistent/map/transient"})) {
+        return;
+    }
+    size_t count = std::max<size_t>(options.size / 256, 1024);
+    std::mt19937 rng(42);
+    std::vector<runtime::ValueRef> values;
+    for(size_t i = 0; i < count; ++i) {
+        values.push_back(runtime::make_value(runtime::Integer(static_cast<int64_t>(i))));
+    }
+    std::vector<size_t> updates;
+    for(size_t i = 0; i < count; ++i) {
+        updates.push_back(rng() % count);
+    }
+    typedef std::unordered_map<runtime::ValueRef, runtime::ValueRef, runtime::ValueHash, runtime::ValueEqual> HashMap;
+    persistent::Vector<runtime::ValueRef>::Transient vector_builder;
+    decltype(runtime::Map::entries)::Transient map_builder;
+    HashMap hash_map;
+    for(auto& value : values) {
+        vector_builder.push_back(value);
+        map_builder.insert(value, value);
+        hash_map[value] = value;
+    }
+    auto vector = vector_builder.persistent();
+    auto map = map_builder.persistent();
+
+    std::vector<std::pair<std::string, std::function<void()>>> cases = {
+        {"persistent/vector/copy", [&] {
+            std::vector<runtime::ValueRef> current = values;
+            for(size_t i = 0; i < updates.size(); ++i) {
+                std::vector<runtime::ValueRef> next = current;
+                next[updates[i]] = values[i];
+                current = std::move(next);
+            }
+        }},
+        {"persistent/vector/assoc", [&] {
+            auto current = vector;
+            for(size_t i = 0; i < updates.size(); ++i) {
+                current = current.set(updates[i], values[i]);
+            }
+        }},
+        {"persistent/vector/transient", [&] {
+            persistent::Vector<runtime::ValueRef>::Transient current(vector);
+            for(size_t i = 0; i < updates.size(); ++i) {
+                current.set(updates[i], values[i]);
+            }
+            current.persistent();
+        }},
+        {"persistent/map/copy", [&] {
+            HashMap current = hash_map;
+            for(size_t i = 0; i < updates.size(); ++i) {
+                HashMap next = current;
+                next[values[updates[i]]] = values[i];
+                current = std::move(next);
+            }
+        }},
+        {"persistent/map/assoc", [&] {
+            auto current = map;
+            for(size_t i = 0; i < updates.size(); ++i) {
+                current = current.insert(values[updates[i]], values[i]);
+            }
+        }},
+        {"persistent/map/transient", [&] {
+            decltype(runtime::Map::entries)::Transient current(map);
+            for(size_t i = 0; i < updates.size(); ++i) {
+                current.insert(values[updates[i]], values[i]);
+            }
+            current.persistent();
+        }},
+    };
+    for(auto& c : cases) {
+        if(!selected(options, c.first)) {
+            continue;
+        }
+        auto m = measure(options.repeat, c.second);
+        std::cerr << c.first << ": " << updates.size() / m.seconds / 1e6 << " M updates/s" << std::endl;
+        Json json;
+        json.field("name", c.first).field("elements", static_cast<uint64_t>(count)).field("updates", static_cast<uint64_t>(updates.size()));
+        json.field("updates_per_s", updates.size() / m.seconds);
+        results.push_back(json.measurement(m).str());
+    }
+}
+
+// Latency and throughput of batches evaluated by a server, against starting
+// a runtime and loading the library per batch as a separate invocation would.
+// Clients wait for each batch before sending the next, or keep a window of
+// them in flight.
+static void run_server(const Options& options, std::vector<std::string>& results) {
+    if(!selected(options, std::vector<std::string>{"server/cold", "server/warm", "server/pipelined"})) {
+        return;
+    }
+    size_t count = std::max<size_t>(options.size / 16384, 32);
+    size_t forms = 16;
+    size_t library = 256;
+    size_t clients = 4;
+    size_t window = 8;
+    auto batches = bench::make_batches(count, forms, library);
+    std::string socket_path = "/tmp/rdvlisp-bench-" + std::to_string(getpid()) + ".sock";
+
+    runtime::Runtime runtime;
+    bench::prepare_runtime(runtime);
+    bench::load_library(runtime, library);
+    server::Server::Options server_options;
+    server_options.socket_path = socket_path;
+    server::Server server(runtime, server_options);
+    std::thread serving([&server] {
+        server.run();
+    });
+
+    typedef std::chrono::steady_clock Clock;
+    std::mutex latencies_mutex;
+    std::vector<double> latencies;
+    auto record = [&](const std::vector<double>& client_latencies) {
+        std::lock_guard<std::mutex> lock(latencies_mutex);
+        latencies.insert(latencies.end(), client_latencies.begin(), client_latencies.end());
+    };
+    // Runs client(k) for each of the clients on its own thread, client k
+    // sending batches k, k + clients...
+    auto load = [&](const std::function<void(size_t)>& client) {
+        std::vector<std::thread> threads;
+        for(size_t k = 0; k < clients; ++k) {
+            threads.push_back(std::thread(client, k));
+        }
+        for(auto& thread : threads) {
+            thread.join();
+        }
+    };
+
+    std::vector<std::pair<std::string, std::function<void()>>> cases = {
+        {"server/cold", [&] {
+            std::vector<double> client_latencies;
+            for(auto& batch : batches) {
+                auto start = Clock::now();
+                runtime::Runtime cold(1);
+                bench::prepare_runtime(cold);
+                bench::load_library(cold, library);
+                std::ostringstream out;
+                for(auto& form : read_forms(batch)) {
+                    out << *cold.eval(form) << "\n";
+                }
+                client_latencies.push_back(std::chrono::duration<double>(Clock::now() - start).count());
+            }
+            record(client_latencies);
+        }},
+        {"server/warm", [&] {
+            load([&](size_t k) {
+                server::Client client(socket_path);
+                std::vector<double> client_latencies;
+                for(size_t i = k; i < batches.size(); i += clients) {
+                    auto start = Clock::now();
+                    client.evaluate(batches[i]);
+                    client_latencies.push_back(std::chrono::duration<double>(Clock::now() - start).count());
+                }
+                record(client_latencies);
+            });
+        }},
+        {"server/pipelined", [&] {
+            load([&](size_t k) {
+                server::Client client(socket_path);
+                std::vector<double> client_latencies;
+                std::deque<Clock::time_point> in_flight;
+                size_t i = k;
+                while(i < batches.size() or !in_flight.empty()) {
+                    while(i < batches.size() and in_flight.size() < window) {
+                        in_flight.push_back(Clock::now());
+                        client.send(batches[i]);
+                        i += clients;
+                    }
+                    client.receive();
+                    client_latencies.push_back(std::chrono::duration<double>(Clock::now() - in_flight.front()).count());
+                    in_flight.pop_front();
+                }
+                record(client_latencies);
+            });
+        }},
+    };
+    for(auto& c : cases) {
+        if(!selected(options, c.first)) {
+            continue;
+        }
+        // The latencies are those of the last run.
+        auto m = measure(options.repeat, [&] {
+            latencies.clear();
+            c.second();
+        });
+        std::sort(latencies.begin(), latencies.end());
+        double p50 = latencies[latencies.size() / 2];
+        double p99 = latencies[std::min(latencies.size() - 1, latencies.size() * 99 / 100)];
+        std::cerr << c.first << ": p50 " << p50 * 1e6 << " us, p99 " << p99 * 1e6 << " us, " << batches.size() / m.seconds << " batches/s" << std::endl;
+        Json json;
+        json.field("name", c.first).field("batches", static_cast<uint64_t>(batches.size())).field("forms_per_batch", static_cast<uint64_t>(forms));
+        json.field("p50_us", p50 * 1e6).field("p99_us", p99 * 1e6).field("batches_per_s", batches.size() / m.seconds).field("forms_per_s", batches.size() * forms / m.seconds);
+        results.push_back(json.measurement(m).str());
+    }
+    server.stop();
+    serving.join();
+}
+
+static void usage(const char * program) {
+    std::cerr << "usage: " << program << " [--size bytes] [--repeat n] [--filter substring] [--output file]" << std::endl;
+}
+
+int main(int argc, const char * argv[])
+{
+    Options options;
+    for(int i = 1; i < argc; ++i) {
+        std::string argument = argv[i];
+        if(i + 1 >= argc) {
+            usage(argv[0]);
+            return 1;
+        }
+        if(argument == "--size") {
+            options.size = std::strtoull(argv[++i], nullptr, 10);
+        } else if(argument == "--repeat") {
+            options.repeat = std::max<size_t>(std::strtoull(argv[++i], nullptr, 10), 1);
+        } else if(argument == "--filter") {
+            options.filter = argv[++i];
+        } else if(argument == "--output") {
+            options.output = argv[++i];
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    std::vector<std::string> results;
+    run_corpora(options, results);
+    run_profile(options, results);
+    run_parallel(options, results);
+    run_rope(options, results);
+    run_snapshot(options, results);
+    run_modules(options, results);
+    run_macros(options, results);
+    run_persistent(options, results);
+    run_server(options, results);
+
+    std::ostringstream json;
+    json << "{\"size\": " << options.size << ", \"repeat\": " << options.repeat << ", \"results\": [\n";
+    for(size_t i = 0; i < results.size(); ++i) {
+        json << "  " << results[i] << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    json << "]}\n";
+    if(options.output.empty()) {
+        std::cout << json.str();
+    } else {
+        std::ofstream(options.output) << json.str();
+    }
+    return 0;
+}
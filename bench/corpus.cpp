@@ -0,0 +1,242 @@
+//
+//  corpus.cpp
+//  rdvlisp
+//
+//  Created by Ruben De Visscher on 18/10/26.
+//  Copyright (c) 2026 Ruben De Visscher. All rights reserved.
+//
+
+#include "corpus.h"
+#include <random>
+#include "optimize.h"
+#include "reader.h"
+
+using namespace rdvlisp::bench;
+using namespace rdvlisp;
+
+static const size_t identifier_count = 256;
+static const size_t number_count = 16;
+
+static std::string identifier(std::mt19937& rng) {
+    return "v" + std::to_string(rng() % identifier_count);
+}
+
+static std::string number(std::mt19937& rng) {
+    switch(rng() % 6) {
+        case 0:
+            return std::to_string(rng() % 100);
+        case 1:
+            return "-" + std::to_string(rng() % 100000);
+        case 2:
+            return std::to_string(rng());
+        case 3: {
+            char buffer[32];
+            snprintf(buffer, sizeof(buffer), "0x%x", static_cast<unsigned>(rng()));
+            return buffer;
+        }
+        case 4:
+            return std::to_string(rng() % 1000) + "." + std::to_string(rng() % 1000);
+        default:
+            return std::to_string(rng() % 100) + "." + std::to_string(rng() % 100000) + "e-" + std::to_string(rng() % 30);
+    }
+}
+
+static std::string string(std::mt19937& rng) {
+    static const std::string words[] = {"lorem", "ipsum", "dolor", "sit", "amet", "consectetur", "adipiscing", "elit"};
+    std::string result = "\"";
+    size_t length = 8 + rng() % 192;
+    bool escapes = rng() % 10 == 0;
+    while(result.size() < length) {
+        result += words[rng() % 8];
+        result += escapes and rng() % 4 == 0 ? "\\n" : " ";
+    }
+    return result + "\"";
+}
+
+static std::string atom(std::mt19937& rng) {
+    switch(rng() % 3) {
+        case 0:
+            return identifier(rng);
+        case 1:
+            return number(rng);
+        default:
+            return string(rng);
+    }
+}
+
+// Arithmetic of the given depth on literals and the variables n0 to n15, with
+// calls of square. Divisors are non-zero literals.
+static std::string arithmetic(std::mt19937& rng, size_t depth) {
+    if(depth == 0) {
+        switch(rng() % 5) {
+            case 0:
+                return std::to_string(rng() % 100);
+            case 1:
+                return std::to_string(rng() % 100000);
+            case 2:
+                return std::to_string(rng() % 1000) + "." + std::to_string(rng() % 100);
+            case 3:
+                return "-" + std::to_string(rng() % 100);
+            default:
+                return "n" + std::to_string(rng() % number_count);
+        }
+    }
+    switch(rng() % 5) {
+        case 0:
+            return "(+ " + arithmetic(rng, depth - 1) + " " + arithmetic(rng, depth - 1) + ")";
+        case 1:
+            return "(- " + arithmetic(rng, depth - 1) + " " + arithmetic(rng, depth - 1) + ")";
+        case 2:
+            return "(* " + arithmetic(rng, depth - 1) + " " + arithmetic(rng, depth - 1) + ")";
+        case 3:
+            return "(/ " + arithmetic(rng, depth - 1) + " " + std::to_string(1 + rng() % 16) + ")";
+        default:
+            return "(square " + arithmetic(rng, depth - 1) + ")";
+    }
+}
+
+template <typename F>
+static Corpus generate(const std::string& name, size_t size, F form) {
+    Corpus corpus{name, ""};
+    while(corpus.source.size() < size) {
+        corpus.source += form();
+        corpus.source += "\n";
+    }
+    return corpus;
+}
+
+template <typename F>
+static std::string list_of(size_t count, F element) {
+    std::string result = "(list";
+    for(size_t i = 0; i < count; ++i) {
+        result += " ";
+        result += element();
+    }
+    return result + ")";
+}
+
+std::vector<Corpus> rdvlisp::bench::make_corpora(size_t size, uint32_t seed) {
+    std::mt19937 rng(seed);
+    std::vector<Corpus> corpora;
+    corpora.push_back(generate("wide", size, [&] {
+        return list_of(10000, [&] { return atom(rng); });
+    }));
+    corpora.push_back(generate("deep", size, [&] {
+        std::string result;
+        size_t depth = 256;
+        for(size_t i = 0; i < depth; ++i) {
+            result += "(list " + atom(rng) + " ";
+        }
+        result += atom(rng);
+        return result + std::string(depth, ')');
+    }));
+    corpora.push_back(generate("strings", size, [&] {
+        return list_of(8, [&] { return string(rng); });
+    }));
+    corpora.push_back(generate("numeric", size, [&] {
+        return list_of(16, [&] { return number(rng); });
+    }));
+    corpora.push_back(generate("identifiers", size, [&] {
+        return list_of(16, [&] { return identifier(rng); });
+    }));
+    corpora.push_back(generate("arithmetic", size, [&] {
+        return "(array " + arithmetic(rng, 4) + " (array " + arithmetic(rng, 3) + " " + arithmetic(rng, 3) + ") (concat \"" + std::to_string(rng()) + "\" \"" + std::to_string(rng()) + "\"))";
+    }));
+    return corpora;
+}
+
+static runtime::ValueRef list(runtime::Runtime& runtime, const std::vector<runtime::ValueRef>& arguments) {
+    return runtime::make_value(runtime::Array(arguments, types::undetermined));
+}
+
+void rdvlisp::bench::install_builtins(runtime::Runtime& runtime) {
+    runtime.value_namespace.bind("list", runtime::make_value(runtime::Builtin("list", list)));
+}
+
+void rdvlisp::bench::prepare_runtime(runtime::Runtime& runtime) {
+    install_builtins(runtime);
+    auto square = read("(* x x)").get();
+    runtime.value_namespace.bind("square", runtime::make_value(runtime::Function{{ast::Identifier("x")}, square}));
+    for(size_t i = 0; i < number_count; ++i) {
+        runtime.value_namespace.bind("n" + std::to_string(i), runtime::make_value(runtime::Integer(static_cast<int32_t>(i * 7))));
+    }
+    for(size_t i = 0; i < identifier_count; ++i) {
+        runtime.value_namespace.bind("v" + std::to_string(i), runtime::make_value(runtime::String("value " + std::to_string(i))));
+    }
+}
+
+void rdvlisp::bench::load_library(runtime::Runtime& runtime, size_t count, uint32_t seed) {
+    std::mt19937 rng(seed);
+    runtime::Namespace library("library");
+    for(size_t i = 0; i < count; ++i) {
+        auto body = read("(+ x (* y " + arithmetic(rng, 3) + ") (square " + arithmetic(rng, 2) + "))").get();
+        runtime::Function function{{ast::Identifier("x"), ast::Identifier("y")}, body};
+        library.bind("f" + std::to_string(i), runtime::make_value(optimize::optimize(runtime, function)));
+        auto table = read("(list " + arithmetic(rng, 2) + " " + arithmetic(rng, 2) + " \"" + std::to_string(rng()) + "\")").get();
+        library.bind("t" + std::to_string(i), runtime.eval(table));
+    }
+    runtime.value_namespace.bind("library", runtime::make_value(std::move(library)));
+}
+
+std::vector<Corpus> rdvlisp::bench::make_modules(size_t count, size_t definitions, uint32_t seed) {
+    std::mt19937 rng(seed);
+    std::vector<Corpus> modules;
+    for(size_t i = 0; i < count; ++i) {
+        Corpus module{"lib.m" + std::to_string(i), ""};
+        for(size_t j = 0; j < definitions; ++j) {
+            auto n = std::to_string(j);
+            module.source += "(function f" + n + " (x y) (+ x (* y " + arithmetic(rng, 3) + ") (square " + arithmetic(rng, 2) + ")))\n";
+            module.source += "(function g" + n + " (x) (f" + n + " x x))\n";
+            module.source += "(define t" + n + " (list " + arithmetic(rng, 2) + " " + arithmetic(rng, 2) + " \"" + std::to_string(rng()) + "\"))\n";
+            if(i > 0 and j % 8 == 0) {
+                module.source += "(define u" + n + " (lib.m" + std::to_string(i - 1) + ".g" + n + " 3))\n";
+            }
+        }
+        modules.push_back(module);
+    }
+    return modules;
+}
+
+// Arithmetic of the given depth through the macros of make_macro_corpus.
+static std::string macro_arithmetic(std::mt19937& rng, size_t depth) {
+    if(depth == 0) {
+        return arithmetic(rng, 1);
+    }
+    switch(rng() % 4) {
+        case 0:
+            return "(twice " + macro_arithmetic(rng, depth - 1) + ")";
+        case 1:
+            return "(sum " + macro_arithmetic(rng, depth - 1) + " " + macro_arithmetic(rng, depth - 1) + " " + arithmetic(rng, 1) + ")";
+        case 2:
+            return "(poly " + arithmetic(rng, 1) + " " + macro_arithmetic(rng, depth - 1) + " 3 " + arithmetic(rng, 1) + ")";
+        default:
+            return "(mean " + macro_arithmetic(rng, depth - 1) + " " + arithmetic(rng, 2) + ")";
+    }
+}
+
+Corpus rdvlisp::bench::make_macro_corpus(size_t size, uint32_t seed) {
+    std::mt19937 rng(seed);
+    Corpus corpus{"macros", ""};
+    corpus.source += "(macro twice (x) '(+ ,x ,x))\n";
+    corpus.source += "(macro sum (&xs) '(+ 0 ,&xs))\n";
+    corpus.source += "(macro poly (x a b c) '(+ (* ,a (square ,x)) (* ,b ,x) ,c))\n";
+    corpus.source += "(macro mean (a b) '(/ (sum ,a ,b) 2))\n";
+    corpus.source += "(macro both (x y) '(list ,x ,y (twice ,x)))\n";
+    while(corpus.source.size() < size) {
+        corpus.source += "(both " + macro_arithmetic(rng, 4) + " " + macro_arithmetic(rng, 2) + ")\n";
+    }
+    return corpus;
+}
+
+std::vector<std::string> rdvlisp::bench::make_batches(size_t count, size_t forms, size_t library, uint32_t seed) {
+    std::mt19937 rng(seed);
+    std::vector<std::string> batches;
+    for(size_t i = 0; i < count; ++i) {
+        std::string batch;
+        for(size_t j = 0; j < forms; ++j) {
+            batch += "(library.f" + std::to_string(rng() % library) + " " + arithmetic(rng, 2) + " " + arithmetic(rng, 2) + ")\n";
+        }
+        batches.push_back(batch);
+    }
+    return batches;
+}
@@ -0,0 +1,60 @@
+//
+//  corpus.h
+//  rdvlisp
+//
+//  Created by Ruben De Visscher on 18/10/26.
+//  Copyright (c) 2026 Ruben De Visscher. All rights reserved.
+//
+
+#ifndef __rdvlisp__bench__corpus__
+#define __rdvlisp__bench__corpus__
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "eval.h"
+
+namespace rdvlisp {
+    namespace bench {
+        class Corpus {
+        public:
+            std::string name;
+            std::string source;
+        };
+        
+        // Synthetic sources of roughly size bytes each: wide tuples, deep
+        // nesting, string-heavy, numeric-heavy, identifier-heavy and constant
+        // arithmetic. Every form evaluates in a runtime set up by
+        // prepare_runtime.
+        std::vector<Corpus> make_corpora(size_t size, uint32_t seed=42);
+        
+        // Binds list, which returns its arguments as an array like array but
+        // isn't pure.
+        void install_builtins(runtime::Runtime& runtime);
+
+        // Installs the builtins and binds the function square and the
+        // identifiers v0 to v255 and n0 to n15 the corpora refer to.
+        void prepare_runtime(runtime::Runtime& runtime);
+
+        // Binds the namespace library to count optimized functions f0, f1...
+        // of x and y and as many arrays t0, t1... built by evaluation, the
+        // kind of work done at startup. runtime must be prepared.
+        void load_library(runtime::Runtime& runtime, size_t count, uint32_t seed=42);
+
+        // Sources of count modules lib.m0, lib.m1... with definitions functions
+        // and arrays each, every module using the one before it.
+        std::vector<Corpus> make_modules(size_t count, size_t definitions, uint32_t seed=42);
+
+        // Macro definitions followed by forms of roughly size bytes in all
+        // that call them, nested; their expansions evaluate in a prepared
+        // runtime.
+        Corpus make_macro_corpus(size_t size, uint32_t seed=42);
+
+        // count sources of forms forms each, as a client of a server would
+        // send them, calling the functions of a library of library
+        // functions; they evaluate in a prepared runtime it is loaded in.
+        std::vector<std::string> make_batches(size_t count, size_t forms, size_t library, uint32_t seed=42);
+    }
+}
+
+#endif /* defined(__rdvlisp__bench__corpus__) */
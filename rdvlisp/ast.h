@@ -9,11 +9,18 @@
 #ifndef rdvlisp_ast_h
 #define rdvlisp_ast_h
 
+#include <cstdint>
 #include <memory>
 #include <iostream>
 #include <boost/variant.hpp>
+#include "memory.h"
+#include "rope.h"
 
 namespace rdvlisp {
+    namespace runtime {
+        class Value;
+    }
+    
     namespace ast {
         class Expression;
         typedef std::shared_ptr<Expression> ExpressionRef;
@@ -47,36 +54,50 @@ namespace rdvlisp {
         };
         std::ostream& operator<<(std::ostream& os, Keyword keyword);
         
+        // Literals are converted by the reader and stored in the smallest type
+        // that holds them, see numeric.h.
         class Integer {
         public:
-            std::string value;
-            Integer(const std::string& value) : value(value) {}
+            boost::variant<int8_t, uint8_t, int16_t, uint16_t, int32_t, uint32_t, int64_t, uint64_t> value;
+            Integer(decltype(value) value) : value(value) {}
         };
         std::ostream& operator<<(std::ostream& os, Integer integer);
         class FloatingPoint {
         public:
-            std::string value;
-            FloatingPoint(const std::string& value) : value(value) {}
+            boost::variant<float, double> value;
+            FloatingPoint(decltype(value) value) : value(value) {}
         };
         std::ostream& operator<<(std::ostream& os, FloatingPoint floating_point);
         
         class Tuple {
         public:
-            std::vector<ExpressionRef> elements;
-            Tuple(const std::vector<ExpressionRef>& elements) : elements(elements) {}
+            typedef std::vector<ExpressionRef, memory::Allocator<ExpressionRef, memory::Subsystem::Ast>> Elements;
+            Elements elements;
+            Tuple(const std::vector<ExpressionRef>& elements) : elements(elements.begin(), elements.end()) {}
+            Tuple(Elements elements) : elements(std::move(elements)) {}
         };
         std::ostream& operator<<(std::ostream& os, Tuple array);
         
         class String {
         public:
-            std::string contents;
-            String(const std::string& contents) : contents(contents) {}
+            Rope contents;
+            String(const Rope& contents) : contents(contents) {}
         };
         std::ostream& operator<<(std::ostream& os, String string);
         
+        // A value computed before evaluation, see optimize.h. Prints as the
+        // expression it replaced.
+        class Constant {
+        public:
+            std::shared_ptr<runtime::Value> value;
+            ExpressionRef original;
+            Constant(const std::shared_ptr<runtime::Value>& value, const ExpressionRef& original) : value(value), original(original) {}
+        };
+        std::ostream& operator<<(std::ostream& os, Constant constant);
+        
         class Expression {
         public:
-            boost::variant<Identifier, Integer, FloatingPoint, Tuple, String, Keyword> variant;
+            boost::variant<Identifier, Integer, FloatingPoint, Tuple, String, Keyword, Constant> variant;
             Expression(decltype(variant) variant) : variant(variant) {}
             Expression(const Expression& expression) : variant(expression.variant) {}
             Expression(ExpressionRef expression_ref) : variant(expression_ref->variant) {}
@@ -86,6 +107,7 @@ namespace rdvlisp {
             Expression(String x) : variant(x) {}
             Expression(Integer x) : variant(x) {}
             Expression(Keyword x) : variant(x) {}
+            Expression(Constant x) : variant(x) {}
         };
         std::ostream& operator<<(std::ostream& os, Expression expression);
     }
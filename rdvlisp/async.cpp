@@ -0,0 +1,334 @@
+//
+//  async.cpp
+//  rdvlisp
+//
+//  Created by Ruben De Visscher on 18/10/26.
+//  Copyright (c) 2026 Ruben De Visscher. All rights reserved.
+//
+
+#include "async.h"
+#include "builtins.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <system_error>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/epoll.h>
+#endif
+
+using namespace rdvlisp::async;
+using namespace rdvlisp::runtime;
+using namespace rdvlisp;
+
+Evaluation::Evaluation(Runtime& runtime, const ast::ExpressionRef& expression) : runtime_(runtime), done_(false) {
+    try {
+        enter(expression, nullptr);
+    } catch(...) {
+        error_ = std::current_exception();
+        done_ = true;
+    }
+}
+
+void Evaluation::enter(const ast::ExpressionRef& expression, const std::shared_ptr<Namespace>& locals) {
+    auto tuple = boost::get<ast::Tuple>(&expression->variant);
+    if(tuple == nullptr) {
+        deliver(runtime_.eval(expression, locals));
+    } else if(tuple->elements.size() == 0) {
+        throw EvalError("cannot evaluate an empty tuple");
+    } else {
+        frames_.push_back(Frame(expression, locals));
+    }
+}
+
+void Evaluation::deliver(const ValueRef& value) {
+    if(frames_.empty()) {
+        result_ = value;
+        done_ = true;
+    } else {
+        frames_.back().values.push_back(value);
+    }
+}
+
+void Evaluation::call() {
+    Frame frame = std::move(frames_.back());
+    frames_.pop_back();
+    auto& callable = frame.values[0];
+    std::vector<ValueRef> arguments(++frame.values.begin(), frame.values.end());
+    if(auto function = boost::get<Function>(&callable->variant)) {
+        enter(function->body, runtime_.bind_arguments(*function, arguments));
+    } else if(auto async_builtin = boost::get<AsyncBuiltin>(&callable->variant)) {
+        suspension_ = async_builtin->start(runtime_, arguments);
+    } else {
+        deliver(runtime_.apply(callable, arguments));
+    }
+}
+
+SuspensionRef Evaluation::step() {
+    try {
+        while(!done_) {
+            if(suspension_.get() != nullptr) {
+                auto value = suspension_->resume();
+                if(value.get() == nullptr) {
+                    return suspension_;
+                }
+                suspension_.reset();
+                deliver(value);
+                continue;
+            }
+            auto& frame = frames_.back();
+            auto& tuple = boost::get<ast::Tuple>(frame.expression->variant);
+            if(frame.values.size() < tuple.elements.size()) {
+                auto element = tuple.elements[frame.values.size()];
+                auto locals = frame.locals;
+                enter(element, locals);
+            } else {
+                call();
+            }
+        }
+    } catch(...) {
+        error_ = std::current_exception();
+        done_ = true;
+        frames_.clear();
+        suspension_.reset();
+    }
+    return nullptr;
+}
+
+ValueRef Evaluation::result() const {
+    if(error_) {
+        std::rethrow_exception(error_);
+    }
+    return result_;
+}
+
+EventLoop::EventLoop() : poll_fd_(-1) {
+#ifdef __linux__
+    poll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+    if(poll_fd_ < 0) {
+        throw std::system_error(errno, std::generic_category(), "epoll_create1");
+    }
+#endif
+}
+
+EventLoop::~EventLoop() {
+    if(poll_fd_ >= 0) {
+        close(poll_fd_);
+    }
+}
+
+void EventLoop::spawn(Runtime& runtime, const ast::ExpressionRef& expression, const Callback& callback) {
+    runnable_.push_back(std::make_shared<Instance>(runtime, expression, callback));
+}
+
+void EventLoop::run() {
+    while(size() > 0) {
+        while(!runnable_.empty()) {
+            auto instance = runnable_.front();
+            runnable_.pop_front();
+            auto suspension = instance->evaluation.step();
+            if(suspension.get() == nullptr) {
+                instance->callback(instance->evaluation);
+            } else if(suspension->fd < 0) {
+                instance->waiting_on = suspension;
+                auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(Suspension::retry_delay);
+                sleeping_.insert(std::make_pair(deadline, instance));
+            } else {
+                instance->waiting_on = suspension;
+                park(instance);
+            }
+        }
+        if(!waiting_.empty() or !sleeping_.empty()) {
+            wait_for_events(next_timeout());
+            wake_sleeping();
+        }
+    }
+}
+
+int EventLoop::next_timeout() const {
+    if(sleeping_.empty()) {
+        return -1;
+    }
+    auto left = std::chrono::duration_cast<std::chrono::milliseconds>(sleeping_.begin()->first - std::chrono::steady_clock::now()).count();
+    // Rounded up, so that the earliest deadline has passed when woken.
+    return std::max<int>(static_cast<int>(left) + 1, 0);
+}
+
+void EventLoop::wake_sleeping() {
+    auto now = std::chrono::steady_clock::now();
+    while(!sleeping_.empty() and sleeping_.begin()->first <= now) {
+        runnable_.push_back(sleeping_.begin()->second);
+        sleeping_.erase(sleeping_.begin());
+    }
+}
+
+#ifdef __linux__
+
+void EventLoop::park(const InstanceRef& instance) {
+    epoll_event event;
+    event.events = (instance->waiting_on->for_writing ? EPOLLOUT : EPOLLIN) | EPOLLONESHOT;
+    event.data.ptr = instance.get();
+    if(epoll_ctl(poll_fd_, EPOLL_CTL_ADD, instance->waiting_on->fd, &event) == 0) {
+        waiting_[instance.get()] = instance;
+    } else if(errno == EPERM) {
+        // Regular files can't be polled, they are always ready.
+        runnable_.push_back(instance);
+    } else {
+        throw std::system_error(errno, std::generic_category(), "epoll_ctl");
+    }
+}
+
+void EventLoop::wait_for_events(int timeout) {
+    epoll_event events[64];
+    int n = epoll_wait(poll_fd_, events, 64, timeout);
+    if(n < 0) {
+        if(errno == EINTR) {
+            return;
+        }
+        throw std::system_error(errno, std::generic_category(), "epoll_wait");
+    }
+    for(int i = 0; i < n; ++i) {
+        auto it = waiting_.find(static_cast<Instance *>(events[i].data.ptr));
+        epoll_ctl(poll_fd_, EPOLL_CTL_DEL, it->second->waiting_on->fd, nullptr);
+        runnable_.push_back(it->second);
+        waiting_.erase(it);
+    }
+}
+
+#else
+
+void EventLoop::park(const InstanceRef& instance) {
+    waiting_[instance.get()] = instance;
+}
+
+void EventLoop::wait_for_events(int timeout) {
+    std::vector<pollfd> descriptors;
+    std::vector<Instance *> instances;
+    for(auto& entry : waiting_) {
+        auto& suspension = *entry.second->waiting_on;
+        descriptors.push_back(pollfd{suspension.fd, static_cast<short>(suspension.for_writing ? POLLOUT : POLLIN), 0});
+        instances.push_back(entry.first);
+    }
+    if(poll(descriptors.data(), descriptors.size(), timeout) < 0) {
+        if(errno == EINTR) {
+            return;
+        }
+        throw std::system_error(errno, std::generic_category(), "poll");
+    }
+    for(size_t i = 0; i < descriptors.size(); ++i) {
+        if(descriptors[i].revents != 0) {
+            auto it = waiting_.find(instances[i]);
+            runnable_.push_back(it->second);
+            waiting_.erase(it);
+        }
+    }
+}
+
+#endif
+
+// The descriptor and buffered data of an in-flight read-file or write-file.
+class FileOperation {
+public:
+    std::string name;
+    std::string path;
+    int flags;
+    int fd;
+    std::string contents;
+    size_t written;
+    FileOperation(const std::string& name, const std::string& path, int flags) : name(name), path(path), flags(flags), fd(-1), written(0) {
+        reopen();
+    }
+    ~FileOperation() {
+        finish();
+    }
+    // Opening a FIFO for writing fails with ENXIO until it has a reader,
+    // leaving fd -1 to try again later.
+    void reopen() {
+        fd = open(path.c_str(), flags | O_NONBLOCK | O_CLOEXEC, 0666);
+        if(fd < 0 and errno != ENXIO) {
+            fail();
+        }
+    }
+    void finish() {
+        if(fd >= 0) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    void fail() {
+        std::string message = name + ": " + path + ": " + std::strerror(errno);
+        finish();
+        throw EvalError(message);
+    }
+};
+
+// A FIFO opened without blocking reads as empty until a writer connects, but
+// only reports a hangup once one has and is gone again.
+static bool writer_gone(int fd) {
+    pollfd descriptor{fd, POLLIN, 0};
+    return poll(&descriptor, 1, 0) > 0 and (descriptor.revents & POLLHUP);
+}
+
+static SuspensionRef read_file(Runtime& runtime, const std::vector<ValueRef>& arguments) {
+    check_arity("read-file", arguments, 1);
+    auto operation = std::make_shared<FileOperation>("read-file", string_argument("read-file", arguments[0]).contents.str(), O_RDONLY);
+    struct stat status;
+    bool fifo = fstat(operation->fd, &status) == 0 and S_ISFIFO(status.st_mode);
+    return std::make_shared<Suspension>(operation->fd, false, [operation, fifo]() -> ValueRef {
+        char chunk[65536];
+        while(true) {
+            ssize_t n = read(operation->fd, chunk, sizeof(chunk));
+            if(n > 0) {
+                operation->contents.append(chunk, n);
+            } else if(n == 0 and fifo and !writer_gone(operation->fd)) {
+                return nullptr;
+            } else if(n == 0) {
+                operation->finish();
+                return make_value(String(std::move(operation->contents)));
+            } else if(errno == EAGAIN or errno == EWOULDBLOCK) {
+                return nullptr;
+            } else if(errno != EINTR) {
+                operation->fail();
+            }
+        }
+    });
+}
+
+static SuspensionRef write_file(Runtime& runtime, const std::vector<ValueRef>& arguments) {
+    check_arity("write-file", arguments, 2);
+    auto operation = std::make_shared<FileOperation>("write-file", string_argument("write-file", arguments[0]).contents.str(), O_WRONLY | O_CREAT | O_TRUNC);
+    operation->contents = string_argument("write-file", arguments[1]).contents.str();
+    auto path = arguments[0];
+    auto suspension = std::make_shared<Suspension>(operation->fd, true, nullptr);
+    Suspension * waiting = suspension.get();
+    suspension->resume = [operation, path, waiting]() -> ValueRef {
+        if(operation->fd < 0) {
+            operation->reopen();
+            waiting->fd = operation->fd;
+            if(operation->fd < 0) {
+                return nullptr;
+            }
+        }
+        while(operation->written < operation->contents.size()) {
+            ssize_t n = write(operation->fd, operation->contents.data() + operation->written, operation->contents.size() - operation->written);
+            if(n >= 0) {
+                operation->written += n;
+            } else if(errno == EAGAIN or errno == EWOULDBLOCK) {
+                return nullptr;
+            } else if(errno != EINTR) {
+                operation->fail();
+            }
+        }
+        operation->finish();
+        return path;
+    };
+    return suspension;
+}
+
+void rdvlisp::async::install_async_builtins(Runtime& runtime) {
+    runtime.value_namespace.bind("read-file", make_value(AsyncBuiltin("read-file", read_file)));
+    runtime.value_namespace.bind("write-file", make_value(AsyncBuiltin("write-file", write_file)));
+}
@@ -0,0 +1,109 @@
+//
+//  async.h
+//  rdvlisp
+//
+//  Created by Ruben De Visscher on 18/10/26.
+//  Copyright (c) 2026 Ruben De Visscher. All rights reserved.
+//
+
+#ifndef __rdvlisp__async__
+#define __rdvlisp__async__
+
+#include <chrono>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <map>
+#include "eval.h"
+
+namespace rdvlisp {
+    namespace async {
+        // Evaluates an expression with an explicit stack of partially applied
+        // tuples instead of recursing through Runtime::eval, so that it can stop
+        // whenever an AsyncBuiltin has to wait and pick up where it left off.
+        // Calls to Function values replace the caller's frame (tail calls) and
+        // builtins run synchronously; only AsyncBuiltins suspend.
+        class Evaluation {
+            class Frame {
+            public:
+                ast::ExpressionRef expression;
+                std::shared_ptr<runtime::Namespace> locals;
+                std::vector<runtime::ValueRef> values;
+                Frame(const ast::ExpressionRef& expression, const std::shared_ptr<runtime::Namespace>& locals) : expression(expression), locals(locals) {}
+            };
+
+            runtime::Runtime& runtime_;
+            std::vector<Frame> frames_;
+            runtime::SuspensionRef suspension_;
+            runtime::ValueRef result_;
+            std::exception_ptr error_;
+            bool done_;
+
+            void enter(const ast::ExpressionRef& expression, const std::shared_ptr<runtime::Namespace>& locals);
+            void deliver(const runtime::ValueRef& value);
+            void call();
+        public:
+            Evaluation(runtime::Runtime& runtime, const ast::ExpressionRef& expression);
+
+            // Runs until the evaluation finishes or has to wait, in which case the
+            // suspension it waits on is returned. Returns nullptr once done.
+            runtime::SuspensionRef step();
+
+            bool done() const {
+                return done_;
+            }
+            // The value of the expression, rethrows the error that ended it.
+            runtime::ValueRef result() const;
+        };
+
+        // Multiplexes many evaluations on the thread calling run. Suspended
+        // evaluations are parked on epoll (poll outside of Linux) until their
+        // descriptor is ready, or until their retry delay passed if they have
+        // none. Run one EventLoop per thread to use several.
+        class EventLoop {
+        public:
+            typedef std::function<void(const Evaluation&)> Callback;
+        private:
+            class Instance {
+            public:
+                Evaluation evaluation;
+                Callback callback;
+                runtime::SuspensionRef waiting_on;
+                Instance(runtime::Runtime& runtime, const ast::ExpressionRef& expression, const Callback& callback) : evaluation(runtime, expression), callback(callback) {}
+            };
+            typedef std::shared_ptr<Instance> InstanceRef;
+
+            std::deque<InstanceRef> runnable_;
+            std::map<Instance *, InstanceRef> waiting_;
+            std::multimap<std::chrono::steady_clock::time_point, InstanceRef> sleeping_;
+            int poll_fd_;
+
+            void park(const InstanceRef& instance);
+            // Waits at most timeout milliseconds, -1 for no limit.
+            void wait_for_events(int timeout);
+            int next_timeout() const;
+            void wake_sleeping();
+        public:
+            EventLoop();
+            ~EventLoop();
+            EventLoop(const EventLoop&) = delete;
+            EventLoop& operator=(const EventLoop&) = delete;
+
+            // callback is called from run once the evaluation is done.
+            void spawn(runtime::Runtime& runtime, const ast::ExpressionRef& expression, const Callback& callback);
+            // Runs until every spawned evaluation is done.
+            void run();
+            size_t size() const {
+                return runnable_.size() + waiting_.size() + sleeping_.size();
+            }
+        };
+
+        // Binds read-file and write-file in the root value namespace.
+        //   (read-file path)           contents of the file or pipe at path
+        //   (write-file path contents) writes contents to path, returns path
+        // On a FIFO both wait for the other end to be opened.
+        void install_async_builtins(runtime::Runtime& runtime);
+    }
+}
+
+#endif /* defined(__rdvlisp__async__) */
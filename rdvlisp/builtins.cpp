@@ -0,0 +1,469 @@
+//
+//  builtins.cpp
+//  rdvlisp
+//
+//  Created by Ruben De Visscher on 18/10/26.
+//  Copyright (c) 2026 Ruben De Visscher. All rights reserved.
+//
+
+#include "builtins.h"
+#include <algorithm>
+#include <limits>
+#include <type_traits>
+
+using namespace rdvlisp::runtime;
+using namespace rdvlisp;
+
+void rdvlisp::runtime::check_arity(const std::string& name, const std::vector<ValueRef>& arguments, size_t arity) {
+    if(arguments.size() != arity) {
+        std::stringstream ss;
+        ss << name << " expects " << arity << " arguments, got " << arguments.size();
+        throw EvalError(ss.str());
+    }
+}
+
+const Array& rdvlisp::runtime::array_argument(const std::string& name, const ValueRef& argument) {
+    auto array = boost::get<Array>(&argument->variant);
+    if(array == nullptr) {
+        throw EvalError(name + " expects an array");
+    }
+    return *array;
+}
+
+const String& rdvlisp::runtime::string_argument(const std::string& name, const ValueRef& argument) {
+    auto string = boost::get<String>(&argument->variant);
+    if(string == nullptr) {
+        throw EvalError(name + " expects a string");
+    }
+    return *string;
+}
+
+class type_of_visitor : public boost::static_visitor<types::TypeRef> {
+public:
+    types::TypeRef operator()(const String& string) const {
+        return string.type;
+    }
+    types::TypeRef operator()(const Integer& integer) const {
+        return integer.type;
+    }
+    types::TypeRef operator()(const Array& array) const {
+        return array.type;
+    }
+    template <typename T>
+    types::TypeRef operator()(const T& t) const {
+        return types::undetermined;
+    }
+};
+
+// The common element type of values, or undetermined if they differ.
+static types::TypeRef common_type(const std::vector<ValueRef>& values) {
+    if(values.size() == 0) {
+        return types::undetermined;
+    }
+    auto type = boost::apply_visitor(type_of_visitor(), values[0]->variant);
+    for(auto& value : values) {
+        if(boost::apply_visitor(type_of_visitor(), value->variant) != type) {
+            return types::undetermined;
+        }
+    }
+    return type;
+}
+
+// Runs body over [0, size[ in chunks of ThreadPool::grain_for(size). Small
+// ranges run inline, without starting the runtime's thread pool, but names
+// are resolved the same way, without loading anything, in both cases.
+static void for_chunks(Runtime& runtime, size_t size, const parallel::ThreadPool::RangeBody& body) {
+    Runtime::Concurrent concurrent(runtime);
+    size_t grain = parallel::ThreadPool::grain_for(size);
+    if(size <= parallel_inline_threshold) {
+        for(size_t begin = 0; begin < size; begin += grain) {
+            body(begin, std::min(size, begin + grain));
+        }
+    } else {
+        runtime.thread_pool().parallel_for(0, size, grain, body);
+    }
+}
+
+static ValueRef pmap(Runtime& runtime, const std::vector<ValueRef>& arguments) {
+    check_arity("pmap", arguments, 2);
+    auto& function = arguments[0];
+    auto& array = array_argument("pmap", arguments[1]);
+    std::vector<ValueRef> results(array.elements.size());
+    for_chunks(runtime, array.elements.size(), [&](size_t begin, size_t end) {
+        for(size_t i = begin; i < end; ++i) {
+            results[i] = runtime.apply(function, {array.elements[i]});
+        }
+    });
+    return make_value(Array(results, common_type(results)));
+}
+
+static ValueRef preduce(Runtime& runtime, const std::vector<ValueRef>& arguments) {
+    check_arity("preduce", arguments, 3);
+    auto& function = arguments[0];
+    auto& array = array_argument("preduce", arguments[2]);
+    size_t size = array.elements.size();
+    size_t grain = parallel::ThreadPool::grain_for(size);
+    // Each chunk is folded on its own, the partial results are then folded
+    // into init in chunk order. The grouping only depends on the array size.
+    std::vector<ValueRef> partials((size + grain - 1) / grain);
+    for_chunks(runtime, size, [&](size_t begin, size_t end) {
+        ValueRef accumulator = array.elements[begin];
+        for(size_t i = begin + 1; i < end; ++i) {
+            accumulator = runtime.apply(function, {accumulator, array.elements[i]});
+        }
+        partials[begin / grain] = accumulator;
+    });
+    ValueRef result = arguments[1];
+    for(auto& partial : partials) {
+        result = runtime.apply(function, {result, partial});
+    }
+    return result;
+}
+
+static ValueRef pfor_each(Runtime& runtime, const std::vector<ValueRef>& arguments) {
+    check_arity("pfor-each", arguments, 2);
+    auto& function = arguments[0];
+    auto& array = array_argument("pfor-each", arguments[1]);
+    for_chunks(runtime, array.elements.size(), [&](size_t begin, size_t end) {
+        for(size_t i = begin; i < end; ++i) {
+            runtime.apply(function, {array.elements[i]});
+        }
+    });
+    return arguments[1];
+}
+
+void rdvlisp::runtime::install_parallel_builtins(Runtime& runtime) {
+    runtime.value_namespace.bind("pmap", make_value(Builtin("pmap", pmap)));
+    runtime.value_namespace.bind("preduce", make_value(Builtin("preduce", preduce)));
+    runtime.value_namespace.bind("pfor-each", make_value(Builtin("pfor-each", pfor_each)));
+}
+
+// An integer operand as 64 bits two's complement, with the width and
+// signedness of its type.
+class IntegerOperand {
+public:
+    uint64_t value;
+    uint64_t bits;
+    bool is_signed;
+};
+
+class widen_visitor : public boost::static_visitor<uint64_t> {
+public:
+    template <typename T>
+    uint64_t operator()(T t) const {
+        typedef typename std::conditional<std::is_signed<T>::value, int64_t, uint64_t>::type Wide;
+        return static_cast<uint64_t>(static_cast<Wide>(t));
+    }
+};
+
+static IntegerOperand integer_operand(const Integer& integer) {
+    auto& type = boost::get<types::Integer>(integer.type->variant);
+    return IntegerOperand{boost::apply_visitor(widen_visitor(), integer.value), type.bits, type.is_signed};
+}
+
+class to_double_visitor : public boost::static_visitor<double> {
+public:
+    template <typename T>
+    double operator()(T t) const {
+        return static_cast<double>(t);
+    }
+};
+
+enum class Operation {
+    Add,
+    Subtract,
+    Multiply,
+    Divide
+};
+
+// Integers are promoted to 64 bits the way C promotes to int, so to int64
+// unless either is a uint64, and wrap around only beyond that. A floating
+// point operand makes the result a double: literals are stored as floats
+// whenever that is exact, which says nothing about the precision wanted.
+static Value arithmetic(const std::string& name, Operation operation, const Value& a, const Value& b) {
+    auto x = boost::get<Integer>(&a.variant);
+    auto y = boost::get<Integer>(&b.variant);
+    if(x != nullptr and y != nullptr) {
+        auto p = integer_operand(*x);
+        auto q = integer_operand(*y);
+        bool is_signed = !((p.bits == 64 and !p.is_signed) or (q.bits == 64 and !q.is_signed));
+        uint64_t u = p.value;
+        uint64_t v = q.value;
+        uint64_t result;
+        switch(operation) {
+            case Operation::Add:
+                result = u + v;
+                break;
+            case Operation::Subtract:
+                result = u - v;
+                break;
+            case Operation::Multiply:
+                result = u * v;
+                break;
+            case Operation::Divide:
+                if(v == 0) {
+                    throw EvalError(name + ": division by zero");
+                }
+                if(!is_signed) {
+                    result = u / v;
+                } else if(static_cast<int64_t>(u) == std::numeric_limits<int64_t>::min() and static_cast<int64_t>(v) == -1) {
+                    result = u;
+                } else {
+                    result = static_cast<uint64_t>(static_cast<int64_t>(u) / static_cast<int64_t>(v));
+                }
+                break;
+            default:
+                throw EvalError(name + ": unknown operation");
+        }
+        return is_signed ? Value{Integer(static_cast<int64_t>(result))} : Value{Integer(result)};
+    }
+    auto f = boost::get<FloatingPoint>(&a.variant);
+    auto g = boost::get<FloatingPoint>(&b.variant);
+    if((x == nullptr and f == nullptr) or (y == nullptr and g == nullptr)) {
+        throw EvalError(name + " expects numbers");
+    }
+    auto operand = [](const Integer * integer, const FloatingPoint * floating_point) {
+        return integer != nullptr ? boost::apply_visitor(to_double_visitor(), integer->value) : boost::apply_visitor(to_double_visitor(), floating_point->value);
+    };
+    double u = operand(x, f);
+    double v = operand(y, g);
+    double result;
+    switch(operation) {
+        case Operation::Add:
+            result = u + v;
+            break;
+        case Operation::Subtract:
+            result = u - v;
+            break;
+        case Operation::Multiply:
+            result = u * v;
+            break;
+        case Operation::Divide:
+            result = u / v;
+            break;
+        default:
+            throw EvalError(name + ": unknown operation");
+    }
+    return Value{FloatingPoint(result)};
+}
+
+// Folds the arguments from the left. A single argument is returned as is,
+// except by - which negates it.
+static ValueRef arithmetic(const std::string& name, Operation operation, const std::vector<ValueRef>& arguments) {
+    if(arguments.size() == 0 or (operation == Operation::Divide and arguments.size() == 1)) {
+        throw EvalError(name + " expects at least " + (operation == Operation::Divide ? "2 arguments" : "1 argument"));
+    }
+    if(arguments.size() == 1) {
+        auto& x = *arguments[0];
+        auto integer = boost::get<Integer>(&x.variant);
+        if(integer == nullptr and boost::get<FloatingPoint>(&x.variant) == nullptr) {
+            throw EvalError(name + " expects numbers");
+        } else if(operation != Operation::Subtract) {
+            return arguments[0];
+        } else if(integer != nullptr) {
+            return make_value(arithmetic(name, operation, Value{Integer(int64_t(0))}, x));
+        } else {
+            return make_value(arithmetic(name, Operation::Multiply, Value{FloatingPoint(-1.0)}, x));
+        }
+    }
+    Value result = arithmetic(name, operation, *arguments[0], *arguments[1]);
+    for(size_t i = 2; i < arguments.size(); ++i) {
+        result = arithmetic(name, operation, result, *arguments[i]);
+    }
+    return make_value(std::move(result));
+}
+
+static ValueRef concat(Runtime& runtime, const std::vector<ValueRef>& arguments) {
+    Rope result;
+    for(auto& argument : arguments) {
+        result = result + string_argument("concat", argument).contents;
+    }
+    return make_value(String(result));
+}
+
+static ValueRef array(Runtime& runtime, const std::vector<ValueRef>& arguments) {
+    return make_value(Array(arguments, common_type(arguments)));
+}
+
+const Vector& rdvlisp::runtime::vector_argument(const std::string& name, const ValueRef& argument) {
+    auto vector = boost::get<Vector>(&argument->variant);
+    if(vector == nullptr) {
+        throw EvalError(name + " expects a vector");
+    }
+    return *vector;
+}
+
+const Map& rdvlisp::runtime::map_argument(const std::string& name, const ValueRef& argument) {
+    auto map = boost::get<Map>(&argument->variant);
+    if(map == nullptr) {
+        throw EvalError(name + " expects a map");
+    }
+    return *map;
+}
+
+// argument as an index into a container of size elements, which may be size
+// itself if end is set.
+static size_t index_argument(const std::string& name, const ValueRef& argument, size_t size, bool end=false) {
+    auto integer = boost::get<Integer>(&argument->variant);
+    if(integer == nullptr) {
+        throw EvalError(name + " expects an integer index");
+    }
+    auto p = integer_operand(*integer);
+    if((p.is_signed and static_cast<int64_t>(p.value) < 0) or p.value > size or (p.value == size and !end)) {
+        throw EvalError(name + ": index out of range");
+    }
+    return static_cast<size_t>(p.value);
+}
+
+static ValueRef vector_of(Runtime& runtime, const std::vector<ValueRef>& arguments) {
+    persistent::Vector<ValueRef>::Transient elements;
+    for(auto& argument : arguments) {
+        elements.push_back(argument);
+    }
+    return make_value(Vector{elements.persistent()});
+}
+
+static ValueRef hash_map_of(Runtime& runtime, const std::vector<ValueRef>& arguments) {
+    if(arguments.size() % 2 != 0) {
+        throw EvalError("hash-map expects keys and values");
+    }
+    decltype(Map::entries)::Transient entries;
+    for(size_t i = 0; i < arguments.size(); i += 2) {
+        entries.insert(arguments[i], arguments[i + 1]);
+    }
+    return make_value(Map{entries.persistent()});
+}
+
+static ValueRef get(Runtime& runtime, const std::vector<ValueRef>& arguments) {
+    if(arguments.size() != 2 and arguments.size() != 3) {
+        throw EvalError("get expects 2 or 3 arguments");
+    }
+    auto& container = arguments[0]->variant;
+    if(auto map = boost::get<Map>(&container)) {
+        if(auto value = map->entries.find(arguments[1])) {
+            return *value;
+        } else if(arguments.size() == 3) {
+            return arguments[2];
+        }
+        throw EvalError("get: key not found");
+    }
+    size_t size;
+    if(auto vector = boost::get<Vector>(&container)) {
+        size = vector->elements.size();
+    } else if(auto array = boost::get<Array>(&container)) {
+        size = array->elements.size();
+    } else {
+        throw EvalError("get expects a vector, map or array");
+    }
+    if(arguments.size() == 3 and boost::get<Integer>(&arguments[1]->variant) != nullptr) {
+        auto p = integer_operand(boost::get<Integer>(arguments[1]->variant));
+        if((p.is_signed and static_cast<int64_t>(p.value) < 0) or p.value >= size) {
+            return arguments[2];
+        }
+    }
+    size_t index = index_argument("get", arguments[1], size);
+    if(auto vector = boost::get<Vector>(&container)) {
+        return vector->elements[index];
+    }
+    return boost::get<Array>(container).elements[index];
+}
+
+// Pairs of updates go through a transient, so that only the result is
+// copied.
+static ValueRef assoc(Runtime& runtime, const std::vector<ValueRef>& arguments) {
+    if(arguments.size() < 3 or arguments.size() % 2 != 1) {
+        throw EvalError("assoc expects a container, keys and values");
+    }
+    if(auto vector = boost::get<Vector>(&arguments[0]->variant)) {
+        if(arguments.size() == 3) {
+            size_t index = index_argument("assoc", arguments[1], vector->elements.size(), true);
+            if(index == vector->elements.size()) {
+                return make_value(Vector{vector->elements.push_back(arguments[2])});
+            }
+            return make_value(Vector{vector->elements.set(index, arguments[2])});
+        }
+        persistent::Vector<ValueRef>::Transient elements(vector->elements);
+        for(size_t i = 1; i < arguments.size(); i += 2) {
+            size_t index = index_argument("assoc", arguments[i], elements.size(), true);
+            if(index == elements.size()) {
+                elements.push_back(arguments[i + 1]);
+            } else {
+                elements.set(index, arguments[i + 1]);
+            }
+        }
+        return make_value(Vector{elements.persistent()});
+    }
+    auto& map = map_argument("assoc", arguments[0]);
+    if(arguments.size() == 3) {
+        return make_value(Map{map.entries.insert(arguments[1], arguments[2])});
+    }
+    decltype(Map::entries)::Transient entries(map.entries);
+    for(size_t i = 1; i < arguments.size(); i += 2) {
+        entries.insert(arguments[i], arguments[i + 1]);
+    }
+    return make_value(Map{entries.persistent()});
+}
+
+static ValueRef dissoc(Runtime& runtime, const std::vector<ValueRef>& arguments) {
+    if(arguments.size() == 0) {
+        throw EvalError("dissoc expects a map");
+    }
+    auto& map = map_argument("dissoc", arguments[0]);
+    if(arguments.size() == 2) {
+        return make_value(Map{map.entries.erase(arguments[1])});
+    }
+    decltype(Map::entries)::Transient entries(map.entries);
+    for(size_t i = 1; i < arguments.size(); ++i) {
+        entries.erase(arguments[i]);
+    }
+    return make_value(Map{entries.persistent()});
+}
+
+static ValueRef push(Runtime& runtime, const std::vector<ValueRef>& arguments) {
+    if(arguments.size() == 0) {
+        throw EvalError("push expects a vector");
+    }
+    auto& vector = vector_argument("push", arguments[0]);
+    if(arguments.size() == 2) {
+        return make_value(Vector{vector.elements.push_back(arguments[1])});
+    }
+    persistent::Vector<ValueRef>::Transient elements(vector.elements);
+    for(size_t i = 1; i < arguments.size(); ++i) {
+        elements.push_back(arguments[i]);
+    }
+    return make_value(Vector{elements.persistent()});
+}
+
+static ValueRef count(Runtime& runtime, const std::vector<ValueRef>& arguments) {
+    check_arity("count", arguments, 1);
+    auto& container = arguments[0]->variant;
+    if(auto vector = boost::get<Vector>(&container)) {
+        return make_value(Integer(static_cast<int64_t>(vector->elements.size())));
+    } else if(auto map = boost::get<Map>(&container)) {
+        return make_value(Integer(static_cast<int64_t>(map->entries.size())));
+    } else if(auto array = boost::get<Array>(&container)) {
+        return make_value(Integer(static_cast<int64_t>(array->elements.size())));
+    }
+    throw EvalError("count expects a vector, map or array");
+}
+
+void rdvlisp::runtime::install_pure_builtins(Runtime& runtime) {
+    auto bind = [&runtime](const std::string& name, Operation operation) {
+        runtime.value_namespace.bind(name, make_value(Builtin(name, [name, operation](Runtime& runtime, const std::vector<ValueRef>& arguments) {
+            return arithmetic(name, operation, arguments);
+        }, true)));
+    };
+    bind("+", Operation::Add);
+    bind("-", Operation::Subtract);
+    bind("*", Operation::Multiply);
+    bind("/", Operation::Divide);
+    runtime.value_namespace.bind("concat", make_value(Builtin("concat", concat, true)));
+    runtime.value_namespace.bind("array", make_value(Builtin("array", array, true)));
+    runtime.value_namespace.bind("vector", make_value(Builtin("vector", vector_of, true)));
+    runtime.value_namespace.bind("hash-map", make_value(Builtin("hash-map", hash_map_of, true)));
+    runtime.value_namespace.bind("get", make_value(Builtin("get", get, true)));
+    runtime.value_namespace.bind("assoc", make_value(Builtin("assoc", assoc, true)));
+    runtime.value_namespace.bind("dissoc", make_value(Builtin("dissoc", dissoc, true)));
+    runtime.value_namespace.bind("push", make_value(Builtin("push", push, true)));
+    runtime.value_namespace.bind("count", make_value(Builtin("count", count, true)));
+}
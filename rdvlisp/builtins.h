@@ -0,0 +1,55 @@
+//
+//  builtins.h
+//  rdvlisp
+//
+//  Created by Ruben De Visscher on 18/10/26.
+//  Copyright (c) 2026 Ruben De Visscher. All rights reserved.
+//
+
+#ifndef __rdvlisp__builtins__
+#define __rdvlisp__builtins__
+
+#include "eval.h"
+
+namespace rdvlisp {
+    namespace runtime {
+        // Arrays with at most this many elements are processed on the calling
+        // thread, scheduling them on the pool costs more than it saves.
+        static const size_t parallel_inline_threshold = 64;
+        
+        // Argument checks shared by the builtins, they throw EvalError naming the
+        // builtin on mismatch.
+        void check_arity(const std::string& name, const std::vector<ValueRef>& arguments, size_t arity);
+        const Array& array_argument(const std::string& name, const ValueRef& argument);
+        const String& string_argument(const std::string& name, const ValueRef& argument);
+        const Vector& vector_argument(const std::string& name, const ValueRef& argument);
+        const Map& map_argument(const std::string& name, const ValueRef& argument);
+        
+        // Binds pmap, preduce and pfor-each in the root value namespace.
+        //   (pmap f array)         array of (f x) for each x, in order
+        //   (preduce f init array) folds array with f, which must be associative
+        //   (pfor-each f array)    calls (f x) for each x, returns array
+        // f runs under a Runtime::Concurrent, so it can't load modules.
+        void install_parallel_builtins(Runtime& runtime);
+        
+        // Binds the pure builtins in the root value namespace.
+        //   (+ x ...), (- x ...), (* x ...), (/ x y ...)
+        //                          arithmetic on integers and floating point
+        //                          numbers, see arithmetic in builtins.cpp for
+        //                          the type of the result; (- x) negates x
+        //   (concat s ...)         the strings s joined together
+        //   (array x ...)          an array of the arguments
+        //   (vector x ...)         a persistent vector of the arguments
+        //   (hash-map k v ...)     a persistent map from each k to the v after it
+        //   (get c k [default])    element k of a vector, map or array, default
+        //                          if there is none
+        //   (assoc c k v ...)      c with element k set to v, for a vector k
+        //                          may be its count to append v
+        //   (dissoc m k ...)       m without the keys k
+        //   (push v x ...)         v with x appended
+        //   (count c)              number of elements of a vector, map or array
+        void install_pure_builtins(Runtime& runtime);
+    }
+}
+
+#endif /* defined(__rdvlisp__builtins__) */
@@ -7,6 +7,12 @@
 //
 
 #include "eval.h"
+#include "builtins.h"
+#include "async.h"
+#include <cerrno>
+#include <cstring>
+#include <type_traits>
+#include <poll.h>
 
 using namespace rdvlisp::runtime;
 using namespace rdvlisp;
@@ -19,7 +25,7 @@ ValueRef Namespace::lookup(const std::string& name) {
     if(it == bindings_.end()) {
         throw NameError(ast::Identifier(name));
     } else {
-        return bindings_[name];
+        return it->second;
     }
 }
 ValueRef Namespace::lookup(const ast::Identifier& identifier) {
@@ -27,7 +33,7 @@ ValueRef Namespace::lookup(const ast::Identifier& identifier) {
     if(identifier.name.size() > 1) {
         for(auto component : std::vector<std::string>(identifier.name.begin(), std::prev(identifier.name.end()))) {
             auto result = current_namespace->lookup(component);
-            auto new_namespace = boost::get<Namespace *>(result->variant);
+            auto new_namespace = boost::get<Namespace>(&result->variant);
             if(new_namespace != nullptr) {
                 current_namespace = new_namespace;
             } else {
@@ -36,4 +42,281 @@ ValueRef Namespace::lookup(const ast::Identifier& identifier) {
         }
     }
     return current_namespace->lookup(*identifier.name.rbegin());
-}
\ No newline at end of file
+}
+
+// An integer as whether it is negative and its 64 bits two's complement, the
+// same for every type that can hold its value.
+class integer_key_visitor : public boost::static_visitor<std::pair<bool, uint64_t>> {
+public:
+    template <typename T>
+    std::pair<bool, uint64_t> operator()(T t) const {
+        typedef typename std::conditional<std::is_signed<T>::value, int64_t, uint64_t>::type Wide;
+        Wide wide = t;
+        return std::make_pair(wide < 0, static_cast<uint64_t>(wide));
+    }
+};
+
+static std::pair<bool, uint64_t> integer_key(const Integer& integer) {
+    return boost::apply_visitor(integer_key_visitor(), integer.value);
+}
+
+static double floating_point_key(const FloatingPoint& floating_point) {
+    if(auto x = boost::get<float32_t>(&floating_point.value)) {
+        return *x;
+    }
+    return boost::get<float64_t>(floating_point.value);
+}
+
+static uint64_t mix(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+size_t ValueHash::operator()(const ValueRef& value) const {
+    auto& variant = value->variant;
+    if(auto string = boost::get<String>(&variant)) {
+        uint64_t hash = 14695981039346656037ULL;
+        string->contents.for_each_piece([&hash](const char * data, size_t size) {
+            for(size_t i = 0; i < size; ++i) {
+                hash ^= static_cast<uint8_t>(data[i]);
+                hash *= 1099511628211ULL;
+            }
+        });
+        return hash;
+    } else if(auto integer = boost::get<Integer>(&variant)) {
+        return mix(integer_key(*integer).second);
+    } else if(auto floating_point = boost::get<FloatingPoint>(&variant)) {
+        // 0.0 and -0.0 are equal, so they must hash the same.
+        double x = floating_point_key(*floating_point) + 0.0;
+        uint64_t bits;
+        std::memcpy(&bits, &x, sizeof(bits));
+        return mix(bits ^ 0x5555555555555555ULL);
+    } else if(auto array = boost::get<Array>(&variant)) {
+        uint64_t hash = array->elements.size();
+        for(auto& element : array->elements) {
+            hash = mix(hash * 31 + (*this)(element));
+        }
+        return hash;
+    } else if(auto vector = boost::get<Vector>(&variant)) {
+        uint64_t hash = vector->elements.size();
+        vector->elements.for_each([this, &hash](const ValueRef& element) {
+            hash = mix(hash * 31 + (*this)(element));
+        });
+        return hash;
+    } else if(auto map = boost::get<Map>(&variant)) {
+        // Independent of the order of the entries.
+        uint64_t hash = map->entries.size();
+        map->entries.for_each([this, &hash](const ValueRef& key, const ValueRef& value) {
+            hash += mix((*this)(key) ^ mix((*this)(value)));
+        });
+        return hash;
+    } else {
+        return mix(reinterpret_cast<uintptr_t>(value.get()));
+    }
+}
+
+bool ValueEqual::operator()(const ValueRef& a, const ValueRef& b) const {
+    if(a == b) {
+        return true;
+    }
+    auto& x = a->variant;
+    auto& y = b->variant;
+    if(x.which() != y.which()) {
+        return false;
+    }
+    if(auto string = boost::get<String>(&x)) {
+        return string->contents == boost::get<String>(y).contents;
+    } else if(auto integer = boost::get<Integer>(&x)) {
+        return integer_key(*integer) == integer_key(boost::get<Integer>(y));
+    } else if(auto floating_point = boost::get<FloatingPoint>(&x)) {
+        return floating_point_key(*floating_point) == floating_point_key(boost::get<FloatingPoint>(y));
+    } else if(auto array = boost::get<Array>(&x)) {
+        auto& other = boost::get<Array>(y).elements;
+        if(array->elements.size() != other.size()) {
+            return false;
+        }
+        for(size_t i = 0; i < other.size(); ++i) {
+            if(!(*this)(array->elements[i], other[i])) {
+                return false;
+            }
+        }
+        return true;
+    } else if(auto vector = boost::get<Vector>(&x)) {
+        auto& other = boost::get<Vector>(y).elements;
+        if(vector->elements.size() != other.size()) {
+            return false;
+        }
+        bool equal = true;
+        size_t i = 0;
+        vector->elements.for_each([this, &other, &equal, &i](const ValueRef& element) {
+            equal = equal and (*this)(element, other[i++]);
+        });
+        return equal;
+    } else if(auto map = boost::get<Map>(&x)) {
+        auto& other = boost::get<Map>(y).entries;
+        if(map->entries.size() != other.size()) {
+            return false;
+        }
+        bool equal = true;
+        map->entries.for_each([this, &other, &equal](const ValueRef& key, const ValueRef& value) {
+            if(equal) {
+                auto found = other.find(key);
+                equal = found != nullptr and (*this)(value, *found);
+            }
+        });
+        return equal;
+    } else {
+        return false;
+    }
+}
+
+std::ostream& rdvlisp::runtime::operator<<(std::ostream& os, const Value& value) {
+    auto& variant = value.variant;
+    if(auto string = boost::get<String>(&variant)) {
+        return os << ast::String(string->contents);
+    } else if(auto integer = boost::get<Integer>(&variant)) {
+        return os << ast::Integer(integer->value);
+    } else if(auto floating_point = boost::get<FloatingPoint>(&variant)) {
+        return os << ast::FloatingPoint(floating_point->value);
+    } else if(auto array = boost::get<Array>(&variant)) {
+        os << "(array";
+        for(auto& element : array->elements) {
+            os << " " << *element;
+        }
+        return os << ")";
+    } else if(auto vector = boost::get<Vector>(&variant)) {
+        os << "(vector";
+        vector->elements.for_each([&os](const ValueRef& element) {
+            os << " " << *element;
+        });
+        return os << ")";
+    } else if(auto map = boost::get<Map>(&variant)) {
+        os << "(hash-map";
+        map->entries.for_each([&os](const ValueRef& key, const ValueRef& value) {
+            os << " " << *key << " " << *value;
+        });
+        return os << ")";
+    } else if(auto space = boost::get<Namespace>(&variant)) {
+        return os << "<namespace " << space->name() << ">";
+    } else if(auto builtin = boost::get<Builtin>(&variant)) {
+        return os << "<builtin " << builtin->name << ">";
+    } else if(auto async_builtin = boost::get<AsyncBuiltin>(&variant)) {
+        return os << "<builtin " << async_builtin->name << ">";
+    } else {
+        return os << "<function>";
+    }
+}
+
+Runtime::Runtime(size_t concurrency) : concurrency_(concurrency == 0 ? std::thread::hardware_concurrency() : concurrency), profiler_(nullptr) {
+    install_parallel_builtins(*this);
+    install_pure_builtins(*this);
+    async::install_async_builtins(*this);
+}
+
+parallel::ThreadPool& Runtime::thread_pool() {
+    std::call_once(thread_pool_flag_, [this] {
+        thread_pool_.reset(new parallel::ThreadPool(concurrency_));
+    });
+    return *thread_pool_;
+}
+
+static std::string callable_name(const Value& callable, const ast::Expression * head) {
+    if(auto builtin = boost::get<Builtin>(&callable.variant)) {
+        return builtin->name;
+    } else if(auto async_builtin = boost::get<AsyncBuiltin>(&callable.variant)) {
+        return async_builtin->name;
+    } else if(head != nullptr and boost::get<ast::Identifier>(&head->variant) != nullptr) {
+        std::stringstream ss;
+        ss << *head;
+        return ss.str();
+    } else {
+        return "<function>";
+    }
+}
+
+ValueRef Runtime::apply(const ValueRef& callable, const std::vector<ValueRef>& arguments) {
+    return apply(callable, arguments, nullptr);
+}
+
+ValueRef Runtime::apply(const ValueRef& callable, const std::vector<ValueRef>& arguments, const ast::Expression * head) {
+    profile::Scope scope(profiler_, callable.get(), [&callable, head] {
+        return callable_name(*callable, head);
+    });
+    if(auto builtin = boost::get<Builtin>(&callable->variant)) {
+        return builtin->implementation(*this, arguments);
+    } else if(auto function = boost::get<Function>(&callable->variant)) {
+        return eval(function->body, bind_arguments(*function, arguments));
+    } else if(auto async_builtin = boost::get<AsyncBuiltin>(&callable->variant)) {
+        auto suspension = async_builtin->start(*this, arguments);
+        ValueRef result;
+        while((result = suspension->resume()).get() == nullptr) {
+            // poll ignores a negative fd and just waits.
+            pollfd descriptor{suspension->fd, static_cast<short>(suspension->for_writing ? POLLOUT : POLLIN), 0};
+            if(poll(&descriptor, 1, suspension->fd < 0 ? Suspension::retry_delay : -1) < 0 and errno != EINTR) {
+                throw EvalError(std::string(async_builtin->name) + ": " + std::strerror(errno));
+            }
+        }
+        return result;
+    } else {
+        throw EvalError("value is not callable");
+    }
+}
+
+std::shared_ptr<Namespace> Runtime::bind_arguments(const Function& function, const std::vector<ValueRef>& arguments) {
+    if(arguments.size() != function.argument_names.size()) {
+        std::stringstream ss;
+        ss << "function expects " << function.argument_names.size() << " arguments, got " << arguments.size();
+        throw EvalError(ss.str());
+    }
+    auto locals = memory::make_shared<memory::Subsystem::Values, Namespace>("");
+    for(size_t i = 0; i < arguments.size(); ++i) {
+        auto& argument_name = function.argument_names[i];
+        if(argument_name.name.size() != 1) {
+            std::stringstream ss;
+            ss << "argument name " << argument_name << " must not be qualified";
+            throw EvalError(ss.str());
+        }
+        locals->bind(argument_name.name[0], arguments[i]);
+    }
+    return locals;
+}
+
+class literal_visitor : public boost::static_visitor<ValueRef> {
+public:
+    template <typename T>
+    ValueRef operator()(T t) const {
+        return make_value(Integer(t));
+    }
+    ValueRef operator()(float t) const {
+        return make_value(FloatingPoint(t));
+    }
+    ValueRef operator()(double t) const {
+        return make_value(FloatingPoint(t));
+    }
+};
+
+ValueRef Runtime::eval_visitor::operator()(const ast::Integer& integer) {
+    return boost::apply_visitor(literal_visitor(), integer.value);
+}
+
+ValueRef Runtime::eval_visitor::operator()(const ast::FloatingPoint& floating_point) {
+    return boost::apply_visitor(literal_visitor(), floating_point.value);
+}
+
+ValueRef Runtime::eval_visitor::operator()(const ast::Tuple& tuple) {
+    if(tuple.elements.size() == 0) {
+        throw EvalError("cannot evaluate an empty tuple");
+    }
+    profile::Scope scope(runtime.profiler_, tuple);
+    auto callable = runtime.eval(tuple.elements[0], locals);
+    std::vector<ValueRef> arguments;
+    arguments.reserve(tuple.elements.size()-1);
+    for(auto it = ++tuple.elements.begin(); it != tuple.elements.end(); ++it) {
+        arguments.push_back(runtime.eval(*it, locals));
+    }
+    return runtime.apply(callable, arguments, tuple.elements[0].get());
+}
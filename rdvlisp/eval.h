@@ -10,7 +10,6 @@
 #define __rdvlisp__eval__
 #include <boost/optional.hpp>
 #include <boost/variant.hpp>
-#include <boost/bind.hpp>
 #include <map>
 #include <string>
 #include <vector>
@@ -18,12 +17,20 @@
 #include <initializer_list>
 #include <memory>
 #include "types.h"
+#include "memory.h"
+#include "parallel.h"
+#include "persistent.h"
+#include "profile.h"
 #include <array>
+#include <atomic>
+#include <functional>
+#include <mutex>
 
 namespace rdvlisp {
     namespace runtime {
         class Value;
         typedef std::shared_ptr<Value> ValueRef;
+        class Runtime;
         
         class Typed {
         public:
@@ -33,8 +40,8 @@ namespace rdvlisp {
         
         class String : public Typed {
         public:
-            std::string contents;
-            String(const std::string& contents) : contents(contents), Typed(types::string) {}
+            Rope contents;
+            String(const Rope& contents) : contents(contents), Typed(types::string) {}
         };
         
         class Integer : public Typed {
@@ -57,8 +64,32 @@ namespace rdvlisp {
         class Array : public Typed {
         public:
             std::vector<ValueRef> elements;
-            Array(const std::vector<ValueRef>& elements, types::TypeRef inner_type) : Typed(std::make_shared<types::Type>(types::Array(inner_type))), elements(elements) {}
-            Array(const std::vector<ValueRef>& elements, types::TypeRef inner_type, size_t length) : Typed(std::make_shared<types::Type>(types::Array(inner_type, length))), elements(elements) {}
+            Array(const std::vector<ValueRef>& elements, types::TypeRef inner_type) : Typed(types::ref(types::Array(inner_type))), elements(elements) {}
+            Array(const std::vector<ValueRef>& elements, types::TypeRef inner_type, size_t length) : Typed(types::ref(types::Array(inner_type, length))), elements(elements) {}
+        };
+        
+        // Strings, numbers and containers hash and compare by contents, an
+        // integer equals an integer of another type with the same value;
+        // other values by identity.
+        class ValueHash {
+        public:
+            size_t operator()(const ValueRef& value) const;
+        };
+        class ValueEqual {
+        public:
+            bool operator()(const ValueRef& a, const ValueRef& b) const;
+        };
+        
+        // Persistent containers, see persistent.h; unlike Array an update
+        // shares all but O(log32 n) of the original.
+        class Vector {
+        public:
+            persistent::Vector<ValueRef> elements;
+        };
+        
+        class Map {
+        public:
+            persistent::Map<ValueRef, ValueRef, ValueHash, ValueEqual> entries;
         };
         
         class Function {
@@ -67,6 +98,41 @@ namespace rdvlisp {
             ast::ExpressionRef body;
         };
         
+        class Builtin {
+        public:
+            std::string name;
+            std::function<ValueRef(Runtime&, const std::vector<ValueRef>&)> implementation;
+            // The result only depends on the arguments and nothing else is
+            // affected, so calls on constants can be evaluated ahead of time.
+            bool pure;
+            Builtin(const std::string& name, decltype(implementation) implementation, bool pure=false) : name(name), implementation(implementation), pure(pure) {}
+        };
+        
+        // An I/O operation an AsyncBuiltin is waiting on. resume performs as much
+        // of it as possible without blocking and returns nullptr as long as it has
+        // to wait for fd to become readable (or writable) again. While there is
+        // nothing to wait on yet, fd is -1 and resume is retried after
+        // retry_delay milliseconds; resume may change fd.
+        class Suspension {
+        public:
+            static const int retry_delay = 10;
+            int fd;
+            bool for_writing;
+            std::function<ValueRef()> resume;
+            Suspension(int fd, bool for_writing, decltype(resume) resume) : fd(fd), for_writing(for_writing), resume(resume) {}
+        };
+        typedef std::shared_ptr<Suspension> SuspensionRef;
+        
+        // A builtin whose result depends on I/O. Under async::Evaluation the
+        // evaluation is suspended while the operation waits, Runtime::apply
+        // blocks instead.
+        class AsyncBuiltin {
+        public:
+            std::string name;
+            std::function<SuspensionRef(Runtime&, const std::vector<ValueRef>&)> start;
+            AsyncBuiltin(const std::string& name, decltype(start) start) : name(name), start(start) {}
+        };
+        
         typedef float float32_t;
         typedef double float64_t;
         
@@ -100,6 +166,11 @@ namespace rdvlisp {
             NameError(const ast::Identifier& identifier, Reason reason=Reason::NotFound) : identifier_(identifier), reason_(reason), std::runtime_error(construct_message(identifier, reason)) {}
         };
         
+        class EvalError : public std::runtime_error {
+        public:
+            EvalError(const std::string& what) : std::runtime_error(what) {}
+        };
+        
         class Namespace {
             std::string name_;
             std::map<std::string, ValueRef> bindings_;
@@ -107,37 +178,123 @@ namespace rdvlisp {
             Namespace(const std::string& name, std::initializer_list<std::pair<const std::string, ValueRef>> bindings={}) : name_(name), bindings_(bindings) {}
             ValueRef lookup(const std::string& name);
             ValueRef lookup(const ast::Identifier& identifier);
+            bool contains(const std::string& name) const {
+                return bindings_.find(name) != bindings_.end();
+            }
+            void bind(const std::string& name, ValueRef value) {
+                bindings_[name] = value;
+            }
+            void unbind(const std::string& name) {
+                bindings_.erase(name);
+            }
+            const std::string& name() const {
+                return name_;
+            }
+            const std::map<std::string, ValueRef>& bindings() const {
+                return bindings_;
+            }
         };
         
         class Value {
         public:
-            boost::variant<String, Integer, Array, Namespace, FloatingPoint, Function> variant;
+            boost::variant<String, Integer, Array, Namespace, FloatingPoint, Function, Builtin, AsyncBuiltin, Vector, Map> variant;
         };
         
+        // Numbers, strings and containers print as an expression that evaluates
+        // to an equal value, other values as a description in angle brackets.
+        std::ostream& operator<<(std::ostream& os, const Value& value);
+        
+        // Allocates a value, accounted to memory::Subsystem::Values.
+        template <typename T>
+        ValueRef make_value(T&& x) {
+            return memory::make_shared<memory::Subsystem::Values, Value>(Value{std::forward<T>(x)});
+        }
+        
         
         class CombinedNamespace {
+        public:
+            // Called with an identifier that isn't bound, returns whether it
+            // bound something that may resolve it.
+            typedef std::function<bool(const ast::Identifier&)> Resolver;
+        private:
             std::shared_ptr<Namespace> root_namespace;
             std::vector<std::shared_ptr<Namespace>> imported_namespaces;
-        public:
-            CombinedNamespace() : root_namespace(new Namespace("")) {
-                imported_namespaces.push_back(root_namespace);
-            }
+            Resolver resolver_;
+            std::atomic<size_t> concurrent_;
             
-            ValueRef lookup(const ast::Identifier& identifier) {
+            ValueRef find(const ast::Identifier& identifier) {
                 ValueRef result;
                 for(auto current_namespace : imported_namespaces) {
-                    if(result.get() != nullptr) {
-                        result = current_namespace->lookup(identifier);
+                    ValueRef found;
+                    try {
+                        found = current_namespace->lookup(identifier);
+                    } catch(const NameError&) {
+                        continue;
+                    }
+                    if(result.get() == nullptr) {
+                        result = found;
                     } else {
                         throw NameError(identifier, NameError::Reason::Ambiguous);
                     }
                 }
+                return result;
+            }
+        public:
+            // While one is alive, lookups don't call the resolver: threads
+            // evaluating concurrently then only read the namespaces, and
+            // names must resolve without binding anything.
+            class Concurrent {
+                CombinedNamespace& space_;
+            public:
+                Concurrent(CombinedNamespace& space) : space_(space) {
+                    ++space_.concurrent_;
+                }
+                ~Concurrent() {
+                    --space_.concurrent_;
+                }
+                Concurrent(const Concurrent&) = delete;
+                Concurrent& operator=(const Concurrent&) = delete;
+            };
+
+            CombinedNamespace() : root_namespace(new Namespace("")), concurrent_(0) {
+                imported_namespaces.push_back(root_namespace);
+            }
+            
+            ValueRef lookup(const ast::Identifier& identifier) {
+                ValueRef result = find(identifier);
+                if(result.get() == nullptr and resolver_ and concurrent_ == 0 and resolver_(identifier)) {
+                    result = find(identifier);
+                }
                 if(result.get() != nullptr) {
                     return result;
                 } else {
                     throw NameError(identifier, NameError::Reason::NotFound);
                 }
             }
+            
+            void bind(const std::string& name, ValueRef value) {
+                root_namespace->bind(name, value);
+            }
+            
+            // Makes the names bound in imported visible; a name bound in more
+            // than one namespace is ambiguous.
+            void import(const std::shared_ptr<Namespace>& imported) {
+                imported_namespaces.push_back(imported);
+            }
+            // The root namespace followed by the imported ones.
+            const std::vector<std::shared_ptr<Namespace>>& namespaces() const {
+                return imported_namespaces;
+            }
+            std::shared_ptr<Namespace> root() const {
+                return root_namespace;
+            }
+            
+            // Lets resolver bind names on demand, e.g. by loading the module
+            // they are in, unless a Concurrent is alive; an empty function
+            // removes it.
+            void set_resolver(const Resolver& resolver) {
+                resolver_ = resolver;
+            }
         };
         
         class Runtime {
@@ -147,23 +304,74 @@ namespace rdvlisp {
         private:
             class eval_visitor : public boost::static_visitor<ValueRef> {
                 Runtime& runtime;
+                const std::shared_ptr<Namespace>& locals;
             public:
-                eval_visitor(Runtime& runtime) : runtime(runtime) {}
+                eval_visitor(Runtime& runtime, const std::shared_ptr<Namespace>& locals) : runtime(runtime), locals(locals) {}
                 template <typename T>
                 ValueRef operator()(T t) {
                     return runtime.value_namespace.lookup(ast::Identifier("void"));
                 }
                 
                 ValueRef operator()(const ast::Identifier& identifier) {
+                    if(locals.get() != nullptr and identifier.name.size() == 1 and locals->contains(identifier.name[0])) {
+                        return locals->lookup(identifier.name[0]);
+                    }
                     return runtime.value_namespace.lookup(identifier);
                 }
+                
+                ValueRef operator()(const ast::Tuple& tuple);
+                
+                ValueRef operator()(const ast::String& string) {
+                    return make_value(String(string.contents));
+                }
+                
+                ValueRef operator()(const ast::Integer& integer);
+                ValueRef operator()(const ast::FloatingPoint& floating_point);
+                
+                ValueRef operator()(const ast::Constant& constant) {
+                    return constant.value;
+                }
             };
+            
+            size_t concurrency_;
+            std::unique_ptr<parallel::ThreadPool> thread_pool_;
+            std::once_flag thread_pool_flag_;
+            profile::Profiler * profiler_;
+            
+            // head is the expression callable was evaluated from, if any, to
+            // name it in the profile.
+            ValueRef apply(const ValueRef& callable, const std::vector<ValueRef>& arguments, const ast::Expression * head);
         public:
-            Runtime() {}
-            ValueRef eval(const ast::ExpressionRef& expression) {
-                eval_visitor v(*this);
+            // Held while threads may evaluate in the runtime concurrently, by
+            // the parallel builtins and the server, see
+            // CombinedNamespace::Concurrent.
+            class Concurrent {
+                CombinedNamespace::Concurrent values_;
+                CombinedNamespace::Concurrent types_;
+            public:
+                Concurrent(Runtime& runtime) : values_(runtime.value_namespace), types_(runtime.type_namespace) {}
+            };
+
+            // concurrency is the number of threads used by the parallel builtins,
+            // 0 means one per hardware thread. The pool is only started the first
+            // time a builtin needs it.
+            Runtime(size_t concurrency=0);
+            ValueRef eval(const ast::ExpressionRef& expression, const std::shared_ptr<Namespace>& locals=nullptr) {
+                eval_visitor v(*this, locals);
                 return expression->variant.apply_visitor(v);
             }
+            ValueRef apply(const ValueRef& callable, const std::vector<ValueRef>& arguments);
+            std::shared_ptr<Namespace> bind_arguments(const Function& function, const std::vector<ValueRef>& arguments);
+            parallel::ThreadPool& thread_pool();
+            
+            // Every call and evaluated tuple is reported to profiler, which must
+            // outlive its use; nullptr, the default, turns profiling off.
+            void set_profiler(profile::Profiler * profiler) {
+                profiler_ = profiler;
+            }
+            profile::Profiler * profiler() const {
+                return profiler_;
+            }
         };
     }
 }
@@ -0,0 +1,243 @@
+//
+//  incremental.cpp
+//  rdvlisp
+//
+//  Created by Ruben De Visscher on 18/10/26.
+//  Copyright (c) 2026 Ruben De Visscher. All rights reserved.
+//
+
+#include "incremental.h"
+#include <algorithm>
+#include <cctype>
+#include <cstddef>
+#include <iterator>
+#include <stdexcept>
+
+using namespace rdvlisp;
+
+typedef IncrementalReader::Node Node;
+
+static Node make_node(const Span& span, const ast::ExpressionRef& expression, size_t base) {
+    Node node;
+    node.offset = span.start - base;
+    node.length = span.end - span.start;
+    node.expression = expression;
+    if(auto tuple = boost::get<ast::Tuple>(&expression->variant)) {
+        node.elements.reserve(span.elements.size());
+        for(size_t i = 0; i < span.elements.size(); ++i) {
+            node.elements.push_back(make_node(span.elements[i], tuple->elements[i], span.start));
+        }
+    }
+    return node;
+}
+
+static bool is_tuple(const Node& node) {
+    return boost::get<ast::Tuple>(&node.expression->variant) != nullptr;
+}
+
+static void rebuild(Node& node) {
+    ast::Tuple::Elements elements;
+    elements.reserve(node.elements.size());
+    for(auto& element : node.elements) {
+        elements.push_back(element.expression);
+    }
+    node.expression = memory::make_shared<memory::Subsystem::Ast, ast::Expression>(ast::Tuple(std::move(elements)));
+}
+
+IncrementalReader::IncrementalReader(const std::string& source) : source_(source), source_map_(source_) {
+    read_all();
+}
+
+void IncrementalReader::read_all() {
+    nodes_.clear();
+    good_ = true;
+    size_t current = 0;
+    while(true) {
+        while(current < source_.size() and std::isspace(source_[current])) {
+            ++current;
+        }
+        if(current >= source_.size()) {
+            break;
+        }
+        Span span;
+        auto r = read(source_, current, span);
+        if(r.fail()) {
+            good_ = false;
+            error_ = r.error();
+            error_start_ = r.start;
+            error_end_ = r.end;
+            nodes_.clear();
+            break;
+        }
+        nodes_.push_back(make_node(span, r.get(), 0));
+        current = r.end;
+    }
+    last_reparsed_ = source_.size();
+}
+
+Result<std::vector<ast::ExpressionRef>> IncrementalReader::forms() const {
+    if(!good_) {
+        return Result<std::vector<ast::ExpressionRef>>(error_, error_start_, error_end_);
+    }
+    std::vector<ast::ExpressionRef> forms;
+    forms.reserve(nodes_.size());
+    for(auto& node : nodes_) {
+        forms.push_back(node.expression);
+    }
+    return Result<std::vector<ast::ExpressionRef>>(forms, 0, source_.size());
+}
+
+// Re-reads the elements of one container (a tuple starting at base and
+// closing at close, or the whole buffer) that the edit of [start, old_end[
+// into [start, new_end[ touches. Reading stops as soon as it is back in step
+// with an element after the edit; from there on the old elements are kept.
+// Returns false, leaving elements as they were, if the result doesn't fit in
+// the container, in which case the enclosing one has to be re-read.
+bool IncrementalReader::reparse(std::vector<Node>& elements, size_t base, size_t close, bool is_root, size_t start, size_t old_end, size_t new_end) {
+    std::ptrdiff_t delta = static_cast<std::ptrdiff_t>(new_end) - static_cast<std::ptrdiff_t>(old_end);
+    auto old_start = [&](size_t index) {
+        return base + elements[index].offset;
+    };
+    auto shifted_start = [&](size_t index) {
+        return static_cast<size_t>(static_cast<std::ptrdiff_t>(old_start(index)) + delta);
+    };
+
+    // Elements [first, after[ touch the edit, including ones that end right
+    // where it starts or start right where it ends, as they may merge with it.
+    size_t n = elements.size();
+    size_t first = std::lower_bound(elements.begin(), elements.end(), start, [base](const Node& node, size_t position) {
+        return base + node.offset + node.length < position;
+    }) - elements.begin();
+    size_t after = std::upper_bound(elements.begin(), elements.end(), old_end, [base](size_t position, const Node& node) {
+        return position < base + node.offset;
+    }) - elements.begin();
+
+    size_t current = first < after ? std::min(old_start(first), start) : start;
+    // Whatever precedes current is the start of the container or an untouched
+    // element followed by whitespace.
+    bool separated = true;
+    size_t resume = after;
+    std::vector<Node> fresh;
+    size_t reparsed = 0;
+    while(true) {
+        size_t next = current;
+        while(next < source_.size() and std::isspace(source_[next])) {
+            ++next;
+        }
+        if(next > current) {
+            separated = true;
+        }
+        while(resume < n and shifted_start(resume) < next) {
+            ++resume;
+        }
+        if(resume < n and shifted_start(resume) == next) {
+            if(!separated and !is_root) {
+                return false;
+            }
+            break;
+        }
+        if(next >= close) {
+            if(next != close or resume != n) {
+                return false;
+            }
+            break;
+        }
+        if(!separated and !is_root) {
+            return false;
+        }
+        Span span;
+        auto r = read(source_, next, span);
+        if(r.fail() or r.end > close) {
+            return false;
+        }
+        fresh.push_back(make_node(span, r.get(), base));
+        reparsed += r.end - next;
+        current = r.end;
+        separated = false;
+    }
+
+    // Splice the new elements in place, most edits replace one element by one.
+    size_t replaced = resume - first;
+    if(fresh.size() == replaced) {
+        std::move(fresh.begin(), fresh.end(), elements.begin() + first);
+    } else {
+        elements.erase(elements.begin() + first, elements.begin() + resume);
+        elements.insert(elements.begin() + first, std::make_move_iterator(fresh.begin()), std::make_move_iterator(fresh.end()));
+    }
+    if(delta != 0) {
+        for(size_t i = first + fresh.size(); i < elements.size(); ++i) {
+            elements[i].offset = static_cast<size_t>(static_cast<std::ptrdiff_t>(elements[i].offset) + delta);
+        }
+    }
+    last_reparsed_ = reparsed;
+    return true;
+}
+
+void IncrementalReader::edit(size_t start, size_t end, const std::string& replacement) {
+    if(start > end or end > source_.size()) {
+        throw std::out_of_range("edit range outside of buffer");
+    }
+    source_.replace(start, end-start, replacement);
+    source_map_.edit(start, end, replacement);
+    if(!good_) {
+        read_all();
+        return;
+    }
+    size_t new_end = start + replacement.size();
+    std::ptrdiff_t delta = static_cast<std::ptrdiff_t>(new_end) - static_cast<std::ptrdiff_t>(end);
+
+    // The tuples strictly around the edit (it doesn't touch their parentheses),
+    // outermost first, with their start positions.
+    std::vector<std::pair<Node *, size_t>> path;
+    std::vector<Node> * elements = &nodes_;
+    size_t base = 0;
+    while(true) {
+        auto it = std::upper_bound(elements->begin(), elements->end(), start, [base](size_t position, const Node& node) {
+            return position < base + node.offset;
+        });
+        if(it == elements->begin()) {
+            break;
+        }
+        --it;
+        size_t node_start = base + it->offset;
+        // 'x and ,x are tuples without parentheses, edits in them re-read them whole.
+        if(!is_tuple(*it) or source_[node_start] != '(' or !(node_start < start and end < node_start + it->length)) {
+            break;
+        }
+        path.push_back(std::make_pair(&*it, node_start));
+        elements = &it->elements;
+        base = node_start;
+    }
+
+    // Re-read the innermost tuple, or the next one out if that fails.
+    size_t level = path.size();
+    while(level > 0) {
+        Node& node = *path[level-1].first;
+        size_t node_start = path[level-1].second;
+        size_t close = static_cast<size_t>(static_cast<std::ptrdiff_t>(node_start + node.length - 1) + delta);
+        if(reparse(node.elements, node_start, close, false, start, end, new_end)) {
+            node.length = static_cast<size_t>(static_cast<std::ptrdiff_t>(node.length) + delta);
+            rebuild(node);
+            break;
+        }
+        --level;
+    }
+    if(level == 0 and !reparse(nodes_, 0, source_.size(), true, start, end, new_end)) {
+        read_all();
+        return;
+    }
+
+    // Propagate the new length and expression up to the top-level forms.
+    for(size_t i = level; i > 0; --i) {
+        Node& child = *path[i-1].first;
+        std::vector<Node>& siblings = i > 1 ? path[i-2].first->elements : nodes_;
+        for(size_t j = &child - siblings.data() + 1; j < siblings.size(); ++j) {
+            siblings[j].offset = static_cast<size_t>(static_cast<std::ptrdiff_t>(siblings[j].offset) + delta);
+        }
+        if(i > 1) {
+            Node& parent = *path[i-2].first;
+            parent.length = static_cast<size_t>(static_cast<std::ptrdiff_t>(parent.length) + delta);
+            rebuild(parent);
+        }
+    }
+}
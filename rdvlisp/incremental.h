@@ -0,0 +1,71 @@
+//
+//  incremental.h
+//  rdvlisp
+//
+//  Created by Ruben De Visscher on 18/10/26.
+//  Copyright (c) 2026 Ruben De Visscher. All rights reserved.
+//
+
+#ifndef __rdvlisp__incremental__
+#define __rdvlisp__incremental__
+
+#include <string>
+#include <vector>
+#include "reader.h"
+
+namespace rdvlisp {
+    // Keeps the top-level forms of a buffer up to date as it is edited. An edit
+    // only re-reads the elements it touches of the innermost tuple around it,
+    // falling back to enclosing tuples when it changes their structure; every
+    // other subtree is shared with the previous forms.
+    class IncrementalReader {
+    public:
+        // A form and, for tuples, its elements. offset is relative to the start
+        // of the enclosing tuple, or of the buffer for top-level forms, so an
+        // edit only shifts the nodes after it on the path to the root.
+        class Node {
+        public:
+            size_t offset;
+            size_t length;
+            ast::ExpressionRef expression;
+            std::vector<Node> elements;
+        };
+    private:
+        std::string source_;
+        SourceMap source_map_;
+        std::vector<Node> nodes_;
+        bool good_;
+        std::string error_;
+        size_t error_start_, error_end_;
+        size_t last_reparsed_;
+
+        void read_all();
+        bool reparse(std::vector<Node>& elements, size_t base, size_t close, bool is_root, size_t start, size_t old_end, size_t new_end);
+    public:
+        IncrementalReader(const std::string& source="");
+        IncrementalReader(const IncrementalReader&) = delete;
+        IncrementalReader& operator=(const IncrementalReader&) = delete;
+
+        // Replaces [start, end[ of the buffer with replacement.
+        void edit(size_t start, size_t end, const std::string& replacement);
+
+        const std::string& source() const {
+            return source_;
+        }
+        const SourceMap& source_map() const {
+            return source_map_;
+        }
+        const std::vector<Node>& nodes() const {
+            return nodes_;
+        }
+        // The top-level forms, or the error the buffer currently fails to read
+        // with. After an error the next edit reads the whole buffer again.
+        Result<std::vector<ast::ExpressionRef>> forms() const;
+        // Number of source bytes read by the last edit.
+        size_t last_reparsed_bytes() const {
+            return last_reparsed_;
+        }
+    };
+}
+
+#endif /* defined(__rdvlisp__incremental__) */
@@ -0,0 +1,327 @@
+//
+//  macros.cpp
+//  rdvlisp
+//
+//  Created by Ruben De Visscher on 18/10/26.
+//  Copyright (c) 2026 Ruben De Visscher. All rights reserved.
+//
+
+#include "macros.h"
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <type_traits>
+#include "memory.h"
+
+using namespace rdvlisp::macros;
+using namespace rdvlisp;
+
+static uint64_t combine(uint64_t hash, uint64_t x) {
+    return hash ^ (x + 0x9e3779b97f4a7c15ULL + (hash << 6) + (hash >> 2));
+}
+
+static uint64_t hash_string(const std::string& s) {
+    return std::hash<std::string>()(s);
+}
+
+class integer_bits_visitor : public boost::static_visitor<uint64_t> {
+public:
+    template <typename T>
+    uint64_t operator()(T t) const {
+        typedef typename std::conditional<std::is_signed<T>::value, int64_t, uint64_t>::type Wide;
+        return static_cast<uint64_t>(static_cast<Wide>(t));
+    }
+};
+
+class structure_hash_visitor : public boost::static_visitor<uint64_t> {
+public:
+    uint64_t operator()(const ast::Identifier& identifier) const {
+        uint64_t hash = identifier.name.size();
+        for(auto& component : identifier.name) {
+            hash = combine(hash, hash_string(component));
+        }
+        return hash;
+    }
+    uint64_t operator()(const ast::Integer& integer) const {
+        return combine(integer.value.which(), boost::apply_visitor(integer_bits_visitor(), integer.value));
+    }
+    uint64_t operator()(const ast::FloatingPoint& floating_point) const {
+        uint64_t bits = 0;
+        if(auto x = boost::get<float>(&floating_point.value)) {
+            std::memcpy(&bits, x, sizeof(*x));
+        } else {
+            std::memcpy(&bits, &boost::get<double>(floating_point.value), sizeof(double));
+        }
+        return combine(floating_point.value.which(), bits);
+    }
+    uint64_t operator()(const ast::Tuple& tuple) const {
+        uint64_t hash = tuple.elements.size();
+        for(auto& element : tuple.elements) {
+            hash = combine(hash, rdvlisp::macros::hash(element));
+        }
+        return hash;
+    }
+    uint64_t operator()(const ast::String& string) const {
+        return hash_string(string.contents.str());
+    }
+    uint64_t operator()(const ast::Keyword& keyword) const {
+        return hash_string(keyword.name);
+    }
+    uint64_t operator()(const ast::Constant& constant) const {
+        return std::hash<const void *>()(constant.value.get());
+    }
+};
+
+uint64_t rdvlisp::macros::hash(const ast::ExpressionRef& expression) {
+    return combine(expression->variant.which(), boost::apply_visitor(structure_hash_visitor(), expression->variant));
+}
+
+bool rdvlisp::macros::equal(const ast::ExpressionRef& a, const ast::ExpressionRef& b) {
+    if(a == b) {
+        return true;
+    } else if(a->variant.which() != b->variant.which()) {
+        return false;
+    }
+    auto& x = a->variant;
+    auto& y = b->variant;
+    if(auto identifier = boost::get<ast::Identifier>(&x)) {
+        return identifier->name == boost::get<ast::Identifier>(y).name;
+    } else if(auto integer = boost::get<ast::Integer>(&x)) {
+        return integer->value == boost::get<ast::Integer>(y).value;
+    } else if(auto floating_point = boost::get<ast::FloatingPoint>(&x)) {
+        return floating_point->value == boost::get<ast::FloatingPoint>(y).value;
+    } else if(auto tuple = boost::get<ast::Tuple>(&x)) {
+        auto& other = boost::get<ast::Tuple>(y).elements;
+        if(tuple->elements.size() != other.size()) {
+            return false;
+        }
+        for(size_t i = 0; i < other.size(); ++i) {
+            if(!equal(tuple->elements[i], other[i])) {
+                return false;
+            }
+        }
+        return true;
+    } else if(auto string = boost::get<ast::String>(&x)) {
+        return string->contents.str() == boost::get<ast::String>(y).contents.str();
+    } else if(auto keyword = boost::get<ast::Keyword>(&x)) {
+        return keyword->name == boost::get<ast::Keyword>(y).name;
+    } else {
+        auto& constant = boost::get<ast::Constant>(x);
+        return constant.value == boost::get<ast::Constant>(y).value and equal(constant.original, boost::get<ast::Constant>(y).original);
+    }
+}
+
+void Cache::insert(uint64_t hash, Entry entry) {
+    if(entries_.size() >= capacity_) {
+        entries_.clear();
+    }
+    entries_.insert(std::make_pair(hash, std::move(entry)));
+}
+
+static ast::ExpressionRef make_expression(const ast::Expression& expression) {
+    return memory::make_shared<memory::Subsystem::Ast, ast::Expression>(expression);
+}
+
+static const std::string * simple_name(const ast::ExpressionRef& expression) {
+    auto identifier = boost::get<ast::Identifier>(&expression->variant);
+    return identifier != nullptr and identifier->name.size() == 1 ? &identifier->name[0] : nullptr;
+}
+
+// The name x of (head x) for the given head.
+static const std::string * operand_of(const ast::ExpressionRef& expression, const char * head) {
+    auto tuple = boost::get<ast::Tuple>(&expression->variant);
+    if(tuple == nullptr or tuple->elements.size() != 2) {
+        return nullptr;
+    }
+    auto name = simple_name(tuple->elements[0]);
+    if(name == nullptr or *name != head) {
+        return nullptr;
+    }
+    return simple_name(tuple->elements[1]);
+}
+
+static const std::string * head_name(const ast::ExpressionRef& expression) {
+    auto tuple = boost::get<ast::Tuple>(&expression->variant);
+    return tuple != nullptr and tuple->elements.size() > 0 ? simple_name(tuple->elements[0]) : nullptr;
+}
+
+// Checks that a template only unquotes parameters, and the rest parameter
+// only as an element of a tuple.
+static void check_template(const Macro& macro, const ast::ExpressionRef& expression, bool in_tuple) {
+    auto head = head_name(expression);
+    if(head != nullptr and *head == "quasiquote") {
+        throw ExpansionError("macro " + macro.name + ": nested quasiquote");
+    } else if(head != nullptr and *head == "unquote") {
+        auto name = operand_of(expression, "unquote");
+        bool is_parameter = name != nullptr and std::find(macro.parameters.begin(), macro.parameters.end(), *name) != macro.parameters.end();
+        bool is_rest = name != nullptr and !macro.rest.empty() and *name == macro.rest;
+        if(!is_parameter and !(is_rest and in_tuple)) {
+            throw ExpansionError("macro " + macro.name + ": only parameters can be unquoted, the rest parameter only in a tuple");
+        }
+    } else if(auto tuple = boost::get<ast::Tuple>(&expression->variant)) {
+        for(auto& element : tuple->elements) {
+            check_template(macro, element, true);
+        }
+    }
+}
+
+bool Expander::is_definition(const ast::ExpressionRef& form) {
+    auto head = head_name(form);
+    return head != nullptr and *head == "macro";
+}
+
+void Expander::define(const ast::ExpressionRef& form) {
+    auto tuple = is_definition(form) ? boost::get<ast::Tuple>(&form->variant) : nullptr;
+    auto parameters = tuple != nullptr and tuple->elements.size() == 4 ? boost::get<ast::Tuple>(&tuple->elements[2]->variant) : nullptr;
+    auto quasiquote = parameters != nullptr ? head_name(tuple->elements[3]) : nullptr;
+    if(quasiquote == nullptr or *quasiquote != "quasiquote" or simple_name(tuple->elements[1]) == nullptr or boost::get<ast::Tuple>(tuple->elements[3]->variant).elements.size() != 2) {
+        throw ExpansionError("expected (macro name (parameters...) 'template)");
+    }
+    auto& elements = tuple->elements;
+    Macro macro;
+    macro.name = *simple_name(elements[1]);
+    for(auto& parameter : parameters->elements) {
+        auto name = simple_name(parameter);
+        if(name == nullptr or !macro.rest.empty()) {
+            throw ExpansionError("macro " + macro.name + ": parameters must be names, only the last one can start with &");
+        } else if((*name)[0] == '&') {
+            macro.rest = *name;
+        } else {
+            macro.parameters.push_back(*name);
+        }
+    }
+    macro.body = boost::get<ast::Tuple>(elements[3]->variant).elements[1];
+    check_template(macro, macro.body, false);
+    macro.version = hash(form) | 1;
+    macros_[macro.name] = macro;
+}
+
+// One expansion of a template: parameters replaced by the arguments, and the
+// names bound by function forms of the template by fresh ones.
+class Instantiation {
+    const std::map<std::string, ast::ExpressionRef>& arguments_;
+    const std::string& rest_name_;
+    const std::vector<ast::ExpressionRef>& rest_;
+    uint64_t& renames_;
+
+    ast::ExpressionRef rename(const ast::ExpressionRef& expression, const std::map<std::string, std::string>& renames) const {
+        auto name = simple_name(expression);
+        auto it = name != nullptr ? renames.find(*name) : renames.end();
+        return it != renames.end() ? make_expression(ast::Identifier(it->second)) : expression;
+    }
+public:
+    Instantiation(const std::map<std::string, ast::ExpressionRef>& arguments, const std::string& rest_name, const std::vector<ast::ExpressionRef>& rest, uint64_t& renames) : arguments_(arguments), rest_name_(rest_name), rest_(rest), renames_(renames) {}
+
+    ast::ExpressionRef run(const ast::ExpressionRef& expression, const std::map<std::string, std::string>& renames) {
+        if(auto name = operand_of(expression, "unquote")) {
+            return arguments_.at(*name);
+        }
+        auto tuple = boost::get<ast::Tuple>(&expression->variant);
+        if(tuple == nullptr) {
+            return rename(expression, renames);
+        }
+        auto scope = &renames;
+        std::map<std::string, std::string> inner;
+        auto head = head_name(expression);
+        auto parameters = tuple->elements.size() == 4 ? boost::get<ast::Tuple>(&tuple->elements[2]->variant) : nullptr;
+        if(head != nullptr and *head == "function" and parameters != nullptr) {
+            inner = renames;
+            for(auto& parameter : parameters->elements) {
+                if(auto name = simple_name(parameter)) {
+                    inner[*name] = *name + "`" + std::to_string(++renames_);
+                }
+            }
+            scope = &inner;
+        }
+        ast::Tuple::Elements elements;
+        for(auto& element : tuple->elements) {
+            auto name = operand_of(element, "unquote");
+            if(name != nullptr and *name == rest_name_) {
+                elements.insert(elements.end(), rest_.begin(), rest_.end());
+            } else {
+                elements.push_back(run(element, *scope));
+            }
+        }
+        return make_expression(ast::Tuple(std::move(elements)));
+    }
+};
+
+ast::ExpressionRef Expander::instantiate(const Macro& macro, const std::vector<ast::ExpressionRef>& arguments) {
+    if(arguments.size() < macro.parameters.size() or (macro.rest.empty() and arguments.size() > macro.parameters.size())) {
+        throw ExpansionError("macro " + macro.name + " expects " + (macro.rest.empty() ? "" : "at least ") + std::to_string(macro.parameters.size()) + " arguments, got " + std::to_string(arguments.size()));
+    }
+    std::map<std::string, ast::ExpressionRef> bound;
+    for(size_t i = 0; i < macro.parameters.size(); ++i) {
+        bound[macro.parameters[i]] = arguments[i];
+    }
+    std::vector<ast::ExpressionRef> rest(arguments.begin() + macro.parameters.size(), arguments.end());
+    return Instantiation(bound, macro.rest, rest, renames_).run(macro.body, std::map<std::string, std::string>());
+}
+
+ast::ExpressionRef Expander::expand(const ast::ExpressionRef& form, size_t depth, std::map<std::string, uint64_t>& heads) {
+    auto tuple = boost::get<ast::Tuple>(&form->variant);
+    if(tuple == nullptr) {
+        return form;
+    }
+    if(auto head = head_name(form)) {
+        if(*head == "quasiquote" or *head == "unquote" or *head == "macro") {
+            throw ExpansionError(*head + " outside of a macro definition");
+        }
+        auto it = macros_.find(*head);
+        heads[*head] = it != macros_.end() ? it->second.version : 0;
+        if(it != macros_.end()) {
+            if(depth >= depth_limit_) {
+                throw ExpansionError("expansion of macro " + *head + " nested too deeply");
+            }
+            ++statistics_.calls;
+            return expand(instantiate(it->second, std::vector<ast::ExpressionRef>(tuple->elements.begin() + 1, tuple->elements.end())), depth + 1, heads);
+        }
+    }
+    ast::Tuple::Elements elements;
+    elements.reserve(tuple->elements.size());
+    bool changed = false;
+    for(auto& element : tuple->elements) {
+        elements.push_back(expand(element, depth, heads));
+        changed = changed or elements.back() != element;
+    }
+    return changed ? make_expression(ast::Tuple(std::move(elements))) : form;
+}
+
+ast::ExpressionRef Expander::expand(const ast::ExpressionRef& form) {
+    ++statistics_.forms;
+    uint64_t form_hash = 0;
+    if(cache_ != nullptr) {
+        form_hash = hash(form);
+        auto range = cache_->entries().equal_range(form_hash);
+        for(auto it = range.first; it != range.second; ++it) {
+            auto& entry = it->second;
+            bool valid = equal(entry.form, form);
+            for(size_t i = 0; valid and i < entry.heads.size(); ++i) {
+                auto macro = macros_.find(entry.heads[i].first);
+                valid = (macro != macros_.end() ? macro->second.version : 0) == entry.heads[i].second;
+            }
+            if(valid) {
+                ++statistics_.cached;
+                return entry.expansion;
+            }
+        }
+    }
+    std::map<std::string, uint64_t> heads;
+    auto expansion = expand(form, 0, heads);
+    if(cache_ != nullptr) {
+        cache_->insert(form_hash, Cache::Entry{form, expansion, std::vector<std::pair<std::string, uint64_t>>(heads.begin(), heads.end())});
+    }
+    return expansion;
+}
+
+std::vector<ast::ExpressionRef> Expander::expand_all(const std::vector<ast::ExpressionRef>& forms) {
+    std::vector<ast::ExpressionRef> expanded;
+    for(auto& form : forms) {
+        if(is_definition(form)) {
+            define(form);
+        } else {
+            expanded.push_back(expand(form));
+        }
+    }
+    return expanded;
+}
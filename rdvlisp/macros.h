@@ -0,0 +1,121 @@
+//
+//  macros.h
+//  rdvlisp
+//
+//  Created by Ruben De Visscher on 18/10/26.
+//  Copyright (c) 2026 Ruben De Visscher. All rights reserved.
+//
+
+#ifndef __rdvlisp__macros__
+#define __rdvlisp__macros__
+
+#include <cstdint>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "ast.h"
+
+namespace rdvlisp {
+    namespace macros {
+        class ExpansionError : public std::runtime_error {
+        public:
+            ExpansionError(const std::string& what) : std::runtime_error(what) {}
+        };
+
+        // Hash and equality of the structure of expressions, as read.
+        uint64_t hash(const ast::ExpressionRef& expression);
+        bool equal(const ast::ExpressionRef& a, const ast::ExpressionRef& b);
+
+        // (macro name (a b &rest) 'template): a call (name x y z...) expands
+        // to template with ,a replaced by x, ,b by y and ,&rest in a tuple by
+        // z... spliced into it. version hashes the definition.
+        class Macro {
+        public:
+            std::string name;
+            std::vector<std::string> parameters;
+            std::string rest;
+            ast::ExpressionRef body;
+            uint64_t version;
+        };
+
+        // Expansions of top-level forms by their structure, each valid as long
+        // as the names it called with a tuple are bound to the same versions
+        // of macros, or still to none. Shared by expanders, so that the same
+        // code read again isn't expanded again. Not thread-safe.
+        class Cache {
+        public:
+            class Entry {
+            public:
+                ast::ExpressionRef form;
+                ast::ExpressionRef expansion;
+                // version 0 means it wasn't a macro.
+                std::vector<std::pair<std::string, uint64_t>> heads;
+            };
+        private:
+            std::unordered_multimap<uint64_t, Entry> entries_;
+            size_t capacity_;
+        public:
+            // Everything is dropped once there are more than capacity entries.
+            Cache(size_t capacity=1 << 16) : capacity_(capacity) {}
+            const std::unordered_multimap<uint64_t, Entry>& entries() const {
+                return entries_;
+            }
+            void insert(uint64_t hash, Entry entry);
+            size_t size() const {
+                return entries_.size();
+            }
+            void clear() {
+                entries_.clear();
+            }
+        };
+
+        // Expands macro calls in forms before they are evaluated, outermost
+        // first, until none are left. Expansion is hygienic for the names a
+        // template binds itself: those in the argument list of a function
+        // form in it are renamed to names containing a `, which the reader
+        // never produces, so they never capture the names in the arguments
+        // of the call. Other names in templates are left as is.
+        class Expander {
+        public:
+            class Statistics {
+            public:
+                size_t forms = 0;
+                size_t cached = 0;
+                size_t calls = 0;
+            };
+        private:
+            std::map<std::string, Macro> macros_;
+            Cache * cache_;
+            size_t depth_limit_;
+            uint64_t renames_;
+            Statistics statistics_;
+
+            ast::ExpressionRef expand(const ast::ExpressionRef& form, size_t depth, std::map<std::string, uint64_t>& heads);
+            ast::ExpressionRef instantiate(const Macro& macro, const std::vector<ast::ExpressionRef>& arguments);
+        public:
+            // Expansions nested deeper than depth_limit are taken to be
+            // infinite and rejected.
+            Expander(Cache * cache=nullptr, size_t depth_limit=256) : cache_(cache), depth_limit_(depth_limit), renames_(0) {}
+
+            static bool is_definition(const ast::ExpressionRef& form);
+            // Adds or replaces the macro defined by form.
+            void define(const ast::ExpressionRef& form);
+            const std::map<std::string, Macro>& macros() const {
+                return macros_;
+            }
+
+            ast::ExpressionRef expand(const ast::ExpressionRef& form);
+            // Defines the definitions among forms, in order, and returns the
+            // expansions of the other forms.
+            std::vector<ast::ExpressionRef> expand_all(const std::vector<ast::ExpressionRef>& forms);
+
+            Statistics statistics() const {
+                return statistics_;
+            }
+        };
+    }
+}
+
+#endif /* defined(__rdvlisp__macros__) */
@@ -6,36 +6,111 @@
 //  Copyright (c) 2014 Ruben De Visscher. All rights reserved.
 //
 
+#include <atomic>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <string>
+#include <vector>
 #include "reader.h"
 #include "eval.h"
+#include "modules.h"
+#include "server.h"
 
-std::vector<std::istream::streampos> line_start_positions(std::istream& is) {
-    auto initial = is.tellg();
-    is.seekg(0);
-    std::vector<std::istream::streampos> positions;
-    if(is.good()) {
-        positions.push_back(is.tellg());
+// Read by the signal handler, so atomic.
+static std::atomic<rdvlisp::server::Server *> running_server(nullptr);
+
+static void stop_server(int) {
+    if(auto server = running_server.load()) {
+        server->stop();
+    }
+}
+
+// Lets SIGINT and SIGTERM stop server while it's alive; they're back to
+// their defaults by the time it's destroyed, however serve returns.
+class StopOnSignal {
+public:
+    StopOnSignal(rdvlisp::server::Server& server) {
+        running_server.store(&server);
+        std::signal(SIGINT, stop_server);
+        std::signal(SIGTERM, stop_server);
     }
-    while(is.good()) {
-        if(is.get() == '\n') {
-            positions.push_back(is.tellg());
+    ~StopOnSignal() {
+        std::signal(SIGINT, SIG_DFL);
+        std::signal(SIGTERM, SIG_DFL);
+        running_server.store(nullptr);
+    }
+};
+
+static int usage(const char * program) {
+    std::cerr << "usage: " << program << " [--serve socket [--workers n] [--module-path directory]... [--module-cache directory] [--require module]...]" << std::endl;
+    return 2;
+}
+
+// Serves batches on socket from one runtime until interrupted. The modules
+// to require are loaded up front, forms are evaluated concurrently and can't
+// load any.
+static int serve(const rdvlisp::server::Server::Options& options, const std::vector<std::string>& search_path, const std::string& cache_directory, const std::vector<std::string>& modules) {
+    try {
+        rdvlisp::runtime::Runtime runtime;
+        {
+            rdvlisp::modules::Loader loader(runtime, search_path, cache_directory);
+            for(auto& module : modules) {
+                loader.require(module);
+            }
+        }
+        rdvlisp::server::Server server(runtime, options);
+        std::signal(SIGPIPE, SIG_IGN);
+        {
+            StopOnSignal stop_on_signal(server);
+            server.run();
         }
+        auto statistics = server.statistics();
+        std::cerr << statistics.connections << " connections, " << statistics.batches << " batches, " << statistics.forms << " forms, " << statistics.errors << " errors" << std::endl;
+    } catch(const std::exception& e) {
+        std::cerr << "Error " << e.what() << std::endl;
+        return 1;
     }
-    is.seekg(initial);
-    return positions;
+    return 0;
 }
 
 int main(int argc, const char * argv[])
 {
+    if(argc > 1) {
+        rdvlisp::server::Server::Options options;
+        std::vector<std::string> search_path;
+        std::string cache_directory;
+        std::vector<std::string> modules;
+        for(int i = 1; i < argc; ++i) {
+            if(i + 1 >= argc) {
+                return usage(argv[0]);
+            } else if(std::strcmp(argv[i], "--serve") == 0) {
+                options.socket_path = argv[++i];
+            } else if(std::strcmp(argv[i], "--workers") == 0) {
+                options.workers = std::strtoull(argv[++i], nullptr, 10);
+            } else if(std::strcmp(argv[i], "--module-path") == 0) {
+                search_path.push_back(argv[++i]);
+            } else if(std::strcmp(argv[i], "--module-cache") == 0) {
+                cache_directory = argv[++i];
+            } else if(std::strcmp(argv[i], "--require") == 0) {
+                modules.push_back(argv[++i]);
+            } else {
+                return usage(argv[0]);
+            }
+        }
+        if(options.socket_path.empty()) {
+            return usage(argv[0]);
+        }
+        return serve(options, search_path, cache_directory, modules);
+    }
     std::string s(" ( print-ln \"Hello, World!\\n\"    :newline! 1.23e-23 02345\n-0.1 )  " );
     auto result = rdvlisp::read(s);
     if(result.good()) {
         std::cout << *result.get() << std::endl;
     } else if(result.end != 0) {
-        std::cerr << "Error " << rdvlisp::ReadError(result.error(), result.start, result.end).what() << std::endl;
+        rdvlisp::SourceMap source_map(s);
+        std::cerr << "Error " << rdvlisp::ReadError(result.error(), result.start, result.end, source_map).what() << std::endl;
     }
     return 0;
 }
-
@@ -0,0 +1,55 @@
+//
+//  memory.cpp
+//  rdvlisp
+//
+//  Created by Ruben De Visscher on 18/10/26.
+//  Copyright (c) 2026 Ruben De Visscher. All rights reserved.
+//
+
+#include "memory.h"
+#include <cstdlib>
+#include <iomanip>
+
+using namespace rdvlisp::memory;
+using namespace rdvlisp;
+
+Counters rdvlisp::memory::counters[subsystem_count];
+
+static const char * subsystem_names[subsystem_count] = {"reader", "ast", "types", "values"};
+
+const char * rdvlisp::memory::name(Subsystem subsystem) {
+    return subsystem_names[static_cast<size_t>(subsystem)];
+}
+
+Usage rdvlisp::memory::usage(Subsystem subsystem) {
+    auto& c = counters[static_cast<size_t>(subsystem)];
+    return Usage{c.live_bytes.load(), c.peak_bytes.load(), c.allocations.load(), c.deallocations.load()};
+}
+
+uint64_t rdvlisp::memory::total_allocations() {
+    uint64_t total = 0;
+    for(auto& c : counters) {
+        total += c.allocations.load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+void rdvlisp::memory::reset_peak() {
+    for(auto& c : counters) {
+        c.peak_bytes = c.live_bytes.load();
+    }
+}
+
+void rdvlisp::memory::dump(std::ostream& os) {
+    os << std::setw(8) << "" << std::setw(14) << "live bytes" << std::setw(14) << "peak bytes" << std::setw(14) << "allocations" << std::setw(14) << "frees" << std::endl;
+    for(size_t i = 0; i < subsystem_count; ++i) {
+        auto u = usage(static_cast<Subsystem>(i));
+        os << std::setw(8) << subsystem_names[i] << std::setw(14) << u.live_bytes << std::setw(14) << u.peak_bytes << std::setw(14) << u.allocations << std::setw(14) << u.deallocations << std::endl;
+    }
+}
+
+static void dump_at_exit() {
+    dump(std::cerr);
+}
+
+static bool dump_registered = std::getenv("RDVLISP_MEMORY_DUMP") != nullptr and std::atexit(dump_at_exit) == 0;
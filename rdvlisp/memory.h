@@ -0,0 +1,142 @@
+//
+//  memory.h
+//  rdvlisp
+//
+//  Created by Ruben De Visscher on 18/10/26.
+//  Copyright (c) 2026 Ruben De Visscher. All rights reserved.
+//
+
+#ifndef __rdvlisp__memory__
+#define __rdvlisp__memory__
+
+#include <atomic>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <string>
+
+namespace rdvlisp {
+    namespace memory {
+        // The parts of the interpreter whose memory is accounted separately:
+        // the source buffers and tokens of the reader, expression nodes and
+        // the element lists of tuples, interned types, and runtime values and
+        // namespaces. Rope nodes and the buffers of ropes not sliced from a
+        // source aren't accounted, ropes being shared by the AST and values.
+        enum class Subsystem {
+            Reader,
+            Ast,
+            Types,
+            Values
+        };
+        static const size_t subsystem_count = 4;
+        const char * name(Subsystem subsystem);
+
+        class Usage {
+        public:
+            uint64_t live_bytes;
+            uint64_t peak_bytes;
+            uint64_t allocations;
+            uint64_t deallocations;
+        };
+
+        class Counters {
+        public:
+            std::atomic<uint64_t> live_bytes;
+            std::atomic<uint64_t> peak_bytes;
+            std::atomic<uint64_t> allocations;
+            std::atomic<uint64_t> deallocations;
+        };
+        extern Counters counters[subsystem_count];
+
+        inline void record_allocation(Subsystem subsystem, size_t bytes) {
+            auto& c = counters[static_cast<size_t>(subsystem)];
+            c.allocations.fetch_add(1, std::memory_order_relaxed);
+            uint64_t live = c.live_bytes.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+            uint64_t peak = c.peak_bytes.load(std::memory_order_relaxed);
+            while(live > peak and !c.peak_bytes.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {}
+        }
+
+        inline void record_deallocation(Subsystem subsystem, size_t bytes) {
+            auto& c = counters[static_cast<size_t>(subsystem)];
+            c.deallocations.fetch_add(1, std::memory_order_relaxed);
+            c.live_bytes.fetch_sub(bytes, std::memory_order_relaxed);
+        }
+
+        Usage usage(Subsystem subsystem);
+        // Allocations made so far by all subsystems, usable as the allocation
+        // counter of a profile::Profiler.
+        uint64_t total_allocations();
+        // Lowers the peak of every subsystem to its current live bytes.
+        void reset_peak();
+        // One line per subsystem with its live and peak bytes and allocation
+        // counts. Also written to stderr at exit if RDVLISP_MEMORY_DUMP is set.
+        void dump(std::ostream& os);
+
+        // A std::allocator that accounts what it allocates to subsystem.
+        template <typename T, Subsystem subsystem>
+        class Allocator {
+        public:
+            typedef T value_type;
+            template <typename U>
+            class rebind {
+            public:
+                typedef Allocator<U, subsystem> other;
+            };
+            Allocator() noexcept {}
+            template <typename U>
+            Allocator(const Allocator<U, subsystem>&) noexcept {}
+            T * allocate(size_t n) {
+                T * p = static_cast<T *>(::operator new(n * sizeof(T)));
+                record_allocation(subsystem, n * sizeof(T));
+                return p;
+            }
+            void deallocate(T * p, size_t n) noexcept {
+                record_deallocation(subsystem, n * sizeof(T));
+                ::operator delete(p);
+            }
+        };
+        template <typename T, typename U, Subsystem subsystem>
+        bool operator==(const Allocator<T, subsystem>&, const Allocator<U, subsystem>&) {
+            return true;
+        }
+        template <typename T, typename U, Subsystem subsystem>
+        bool operator!=(const Allocator<T, subsystem>&, const Allocator<U, subsystem>&) {
+            return false;
+        }
+
+        template <Subsystem subsystem>
+        using String = std::basic_string<char, std::char_traits<char>, Allocator<char, subsystem>>;
+
+        // Owns a std::string with its characters accounted to subsystem, for
+        // buffers that must be a std::string, e.g. to be sliced by a Rope.
+        template <Subsystem subsystem>
+        class AccountedString {
+        public:
+            const std::string string;
+            AccountedString(std::string&& s) : string(std::move(s)) {
+                record_allocation(subsystem, string.capacity());
+            }
+            ~AccountedString() {
+                record_deallocation(subsystem, string.capacity());
+            }
+            AccountedString(const AccountedString&) = delete;
+            AccountedString& operator=(const AccountedString&) = delete;
+        };
+
+        // std::make_shared, with the object and its control block accounted to
+        // subsystem.
+        template <Subsystem subsystem, typename T, typename... Args>
+        std::shared_ptr<T> make_shared(Args&&... args) {
+            return std::allocate_shared<T>(Allocator<T, subsystem>(), std::forward<Args>(args)...);
+        }
+
+        // s as a shared buffer, accounted to subsystem with its characters.
+        template <Subsystem subsystem>
+        std::shared_ptr<const std::string> make_shared_string(std::string s) {
+            auto owner = make_shared<subsystem, AccountedString<subsystem>>(std::move(s));
+            return std::shared_ptr<const std::string>(owner, &owner->string);
+        }
+    }
+}
+
+#endif /* defined(__rdvlisp__memory__) */
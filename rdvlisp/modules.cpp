@@ -0,0 +1,492 @@
+//
+//  modules.cpp
+//  rdvlisp
+//
+//  Created by Ruben De Visscher on 18/10/26.
+//  Copyright (c) 2026 Ruben De Visscher. All rights reserved.
+//
+
+#include "modules.h"
+#include <cctype>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <set>
+#include <sstream>
+#include <sys/stat.h>
+#include "optimize.h"
+#include "reader.h"
+#include "snapshot.h"
+
+using namespace rdvlisp::modules;
+using namespace rdvlisp::runtime;
+using namespace rdvlisp;
+
+// Cache entry layout, in native byte order:
+//   magic, version, u64 hash of the source, u64 key
+//   u32 count, dependencies: u32 size, name, u64 key
+//   u64 size, snapshot of the namespace of the module
+static const char cache_magic[8] = {'R', 'D', 'V', 'M', 'O', 'D', '\0', '\0'};
+static const uint32_t cache_version = 1;
+
+typedef std::vector<std::pair<std::string, uint64_t>> Dependencies;
+
+static uint64_t fnv1a(const void * data, size_t size, uint64_t hash=14695981039346656037ULL) {
+    auto bytes = static_cast<const unsigned char *>(data);
+    for(size_t i = 0; i < size; ++i) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static uint64_t module_key(uint64_t source_hash, const Dependencies& dependencies) {
+    uint64_t hash = fnv1a(&cache_version, sizeof(cache_version));
+    hash = fnv1a(&source_hash, sizeof(source_hash), hash);
+    for(auto& dependency : dependencies) {
+        hash = fnv1a(dependency.first.c_str(), dependency.first.size() + 1, hash);
+        hash = fnv1a(&dependency.second, sizeof(dependency.second), hash);
+    }
+    return hash;
+}
+
+static std::vector<std::string> split_module_name(const std::string& name) {
+    std::vector<std::string> components;
+    std::stringstream ss(name);
+    std::string component;
+    while(std::getline(ss, component, '.')) {
+        components.push_back(component);
+    }
+    return components;
+}
+
+static std::string join(std::vector<std::string>::const_iterator begin, std::vector<std::string>::const_iterator end, char separator) {
+    std::string result;
+    for(auto it = begin; it != end; ++it) {
+        if(it != begin) {
+            result += separator;
+        }
+        result += *it;
+    }
+    return result;
+}
+
+// Only names that map to a path below the search path.
+static bool is_module_name(const std::vector<std::string>& components) {
+    if(components.empty()) {
+        return false;
+    }
+    for(auto& component : components) {
+        if(component.empty()) {
+            return false;
+        }
+        for(char c : component) {
+            if(!isalnum(static_cast<unsigned char>(c)) and c != '_' and c != '-') {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static bool read_file(const std::string& path, std::string& contents) {
+    std::ifstream in(path, std::ios::binary);
+    if(!in) {
+        return false;
+    }
+    std::ostringstream ss;
+    ss << in.rdbuf();
+    contents = ss.str();
+    return !in.bad();
+}
+
+// A define or function form of a module.
+class ModuleDefinition {
+public:
+    std::string name;
+    bool is_function;
+    std::vector<ast::Identifier> parameters;
+    ast::ExpressionRef body;
+    // Index of the form it was read from.
+    size_t form;
+};
+
+static bool is_simple_identifier(const ast::ExpressionRef& expression) {
+    auto identifier = boost::get<ast::Identifier>(&expression->variant);
+    return identifier != nullptr and identifier->name.size() == 1;
+}
+
+static ModuleDefinition parse_definition(const ast::ExpressionRef& form) {
+    auto tuple = boost::get<ast::Tuple>(&form->variant);
+    auto head = tuple != nullptr and tuple->elements.size() > 0 ? boost::get<ast::Identifier>(&tuple->elements[0]->variant) : nullptr;
+    if(head == nullptr or head->name.size() != 1 or (head->name[0] != "define" and head->name[0] != "function")) {
+        throw ModuleError("expected (define name expression) or (function name (arguments...) body)");
+    }
+    ModuleDefinition definition;
+    definition.is_function = head->name[0] == "function";
+    auto& elements = tuple->elements;
+    if(elements.size() != (definition.is_function ? 4 : 3) or !is_simple_identifier(elements[1])) {
+        throw ModuleError("malformed " + head->name[0]);
+    }
+    definition.name = boost::get<ast::Identifier>(elements[1]->variant).name[0];
+    if(definition.is_function) {
+        auto parameters = boost::get<ast::Tuple>(&elements[2]->variant);
+        if(parameters == nullptr) {
+            throw ModuleError("arguments of function " + definition.name + " must be a tuple");
+        }
+        for(auto& parameter : parameters->elements) {
+            if(!is_simple_identifier(parameter)) {
+                throw ModuleError("arguments of function " + definition.name + " must be names");
+            }
+            definition.parameters.push_back(boost::get<ast::Identifier>(parameter->variant));
+        }
+    }
+    definition.body = elements.back();
+    return definition;
+}
+
+// expression with the names of definitions of the module not shadowed by
+// parameters replaced by qualified ones, so that they resolve once the
+// expression is evaluated outside of the module.
+static ast::ExpressionRef qualify(const ast::ExpressionRef& expression, const std::vector<std::string>& module, const std::set<std::string>& definitions, const std::set<std::string>& parameters) {
+    if(auto identifier = boost::get<ast::Identifier>(&expression->variant)) {
+        if(identifier->name.size() == 1 and definitions.count(identifier->name[0]) > 0 and parameters.count(identifier->name[0]) == 0) {
+            auto name = module;
+            name.push_back(identifier->name[0]);
+            return memory::make_shared<memory::Subsystem::Ast, ast::Expression>(ast::Identifier(name));
+        }
+    } else if(auto tuple = boost::get<ast::Tuple>(&expression->variant)) {
+        ast::Tuple::Elements elements;
+        bool changed = false;
+        for(auto& element : tuple->elements) {
+            elements.push_back(qualify(element, module, definitions, parameters));
+            changed = changed or elements.back() != element;
+        }
+        if(changed) {
+            return memory::make_shared<memory::Subsystem::Ast, ast::Expression>(ast::Tuple(std::move(elements)));
+        }
+    }
+    return expression;
+}
+
+static void collect_identifiers(const ast::ExpressionRef& expression, std::vector<const ast::Identifier *>& identifiers) {
+    if(auto identifier = boost::get<ast::Identifier>(&expression->variant)) {
+        identifiers.push_back(identifier);
+    } else if(auto tuple = boost::get<ast::Tuple>(&expression->variant)) {
+        for(auto& element : tuple->elements) {
+            collect_identifiers(element, identifiers);
+        }
+    }
+}
+
+Loader::Loader(Runtime& runtime, const std::vector<std::string>& search_path, const std::string& cache_directory) : runtime_(runtime), search_path_(search_path), cache_directory_(cache_directory) {
+    runtime_.value_namespace.set_resolver([this](const ast::Identifier& identifier) {
+        return resolve(identifier);
+    });
+}
+
+Loader::~Loader() {
+    runtime_.value_namespace.set_resolver(CombinedNamespace::Resolver());
+}
+
+const std::string& Loader::find(const std::string& name) {
+    auto it = paths_.find(name);
+    if(it != paths_.end()) {
+        return it->second;
+    }
+    std::string& path = paths_[name];
+    auto components = split_module_name(name);
+    if(!is_module_name(components)) {
+        return path;
+    }
+    std::string relative = join(components.begin(), components.end(), '/') + ".rdv";
+    for(auto& directory : search_path_) {
+        struct stat status;
+        std::string candidate = directory + "/" + relative;
+        if(stat(candidate.c_str(), &status) == 0 and S_ISREG(status.st_mode)) {
+            path = candidate;
+            break;
+        }
+    }
+    return path;
+}
+
+uint64_t Loader::load(const std::string& name) {
+    auto it = modules_.find(name);
+    if(it != modules_.end()) {
+        if(it->second.state == State::Loading) {
+            throw ModuleError("module " + name + " depends on itself");
+        }
+        return it->second.key;
+    }
+    auto& path = find(name);
+    if(path.empty()) {
+        throw ModuleError("module " + name + " not found");
+    }
+    std::string contents;
+    if(!read_file(path, contents)) {
+        throw ModuleError(path + ": " + std::strerror(errno));
+    }
+    auto source = make_source(std::move(contents));
+    modules_[name] = Module{State::Loading, 0};
+    uint64_t key;
+    try {
+        if(restore(name, *source, key)) {
+            ++statistics_.restored;
+        } else {
+            key = compile(name, path, source);
+            ++statistics_.compiled;
+        }
+    } catch(...) {
+        modules_.erase(name);
+        throw;
+    }
+    modules_[name] = Module{State::Loaded, key};
+    return key;
+}
+
+// Binds the cached namespace of name if the cache entry is current, loading
+// the dependencies it lists.
+bool Loader::restore(const std::string& name, const std::string& source, uint64_t& key) {
+    std::string data;
+    if(cache_directory_.empty() or !read_file(cache_directory_ + "/" + name + ".rdvc", data)) {
+        return false;
+    }
+    size_t position = 0;
+    auto get = [&data, &position](void * x, size_t size) {
+        if(data.size() - position < size) {
+            return false;
+        }
+        std::memcpy(x, data.data() + position, size);
+        position += size;
+        return true;
+    };
+    char magic[sizeof(cache_magic)];
+    uint32_t version, count;
+    uint64_t source_hash, stored_key;
+    if(!get(magic, sizeof(magic)) or std::memcmp(magic, cache_magic, sizeof(magic)) != 0 or !get(&version, sizeof(version)) or version != cache_version) {
+        return false;
+    }
+    if(!get(&source_hash, sizeof(source_hash)) or source_hash != fnv1a(source.data(), source.size()) or !get(&stored_key, sizeof(stored_key)) or !get(&count, sizeof(count))) {
+        return false;
+    }
+    Dependencies dependencies;
+    for(uint32_t i = 0; i < count; ++i) {
+        uint32_t size;
+        if(!get(&size, sizeof(size)) or data.size() - position < size) {
+            return false;
+        }
+        std::string dependency = data.substr(position, size);
+        position += size;
+        uint64_t dependency_key;
+        if(!get(&dependency_key, sizeof(dependency_key)) or find(dependency).empty() or load(dependency) != dependency_key) {
+            return false;
+        }
+        dependencies.push_back(std::make_pair(dependency, dependency_key));
+    }
+    uint64_t size;
+    if(!get(&size, sizeof(size)) or data.size() - position != size or module_key(source_hash, dependencies) != stored_key) {
+        return false;
+    }
+    std::shared_ptr<Namespace> restored;
+    try {
+        restored = snapshot::load_namespace(runtime_, data.data() + position, size);
+    } catch(const snapshot::SnapshotError&) {
+        return false;
+    }
+    auto& space = install(name);
+    for(auto& binding : restored->bindings()) {
+        space.bind(binding.first, binding.second);
+    }
+    key = stored_key;
+    return true;
+}
+
+uint64_t Loader::compile(const std::string& name, const std::string& path, const SourceRef& buffer) {
+    auto& source = *buffer;
+    SourceMap source_map(source);
+    std::vector<ast::ExpressionRef> forms;
+    std::vector<size_t> offsets;
+    size_t current = 0;
+    while(true) {
+        while(current < source.size() and std::isspace(static_cast<unsigned char>(source[current]))) {
+            ++current;
+        }
+        if(current >= source.size()) {
+            break;
+        }
+        auto r = read(buffer, current);
+        if(r.fail()) {
+            throw ModuleError(path + ": " + ReadError(r.error(), r.start, r.end, source_map).what());
+        }
+        forms.push_back(r.get());
+        offsets.push_back(current);
+        current = r.end;
+    }
+    auto where = [&](size_t i) {
+        std::ostringstream ss;
+        ss << path << ":" << source_map.position(offsets[i]) << ": ";
+        return ss.str();
+    };
+
+    // Macros are expanded first, they are local to the module.
+    macros::Expander expander(&expansions_);
+    std::vector<ModuleDefinition> definitions;
+    std::set<std::string> names;
+    for(size_t i = 0; i < forms.size(); ++i) {
+        try {
+            if(macros::Expander::is_definition(forms[i])) {
+                expander.define(forms[i]);
+                continue;
+            }
+            definitions.push_back(parse_definition(expander.expand(forms[i])));
+            definitions.back().form = i;
+        } catch(const ModuleError& e) {
+            throw ModuleError(where(i) + e.what());
+        } catch(const macros::ExpansionError& e) {
+            throw ModuleError(where(i) + e.what());
+        }
+        if(!names.insert(definitions.back().name).second) {
+            throw ModuleError(where(i) + definitions.back().name + " is defined twice");
+        }
+    }
+
+    auto module = split_module_name(name);
+    std::set<std::string> dependency_names;
+    for(auto& definition : definitions) {
+        std::set<std::string> parameters;
+        for(auto& parameter : definition.parameters) {
+            parameters.insert(parameter.name[0]);
+        }
+        definition.body = qualify(definition.body, module, names, parameters);
+        // The longest prefix of a qualified name that is a module.
+        std::vector<const ast::Identifier *> identifiers;
+        collect_identifiers(definition.body, identifiers);
+        for(auto identifier : identifiers) {
+            for(size_t n = identifier->name.size() - 1; n > 0; --n) {
+                auto prefix = join(identifier->name.begin(), identifier->name.begin() + n, '.');
+                if(prefix == name) {
+                    break;
+                } else if(!find(prefix).empty()) {
+                    dependency_names.insert(prefix);
+                    break;
+                }
+            }
+        }
+    }
+    Dependencies dependencies;
+    for(auto& dependency : dependency_names) {
+        dependencies.push_back(std::make_pair(dependency, load(dependency)));
+    }
+
+    // Definitions are bound as they are compiled, for the later ones to use.
+    auto& space = install(name);
+    Namespace compiled(name);
+    auto unbind = [&space, &compiled] {
+        for(auto& binding : compiled.bindings()) {
+            space.unbind(binding.first);
+        }
+    };
+    for(auto& definition : definitions) {
+        try {
+            ValueRef value;
+            if(definition.is_function) {
+                value = make_value(optimize::optimize(runtime_, Function{definition.parameters, definition.body}));
+            } else {
+                value = runtime_.eval(definition.body);
+            }
+            space.bind(definition.name, value);
+            compiled.bind(definition.name, value);
+        } catch(const ModuleError&) {
+            unbind();
+            throw;
+        } catch(const std::exception& e) {
+            unbind();
+            throw ModuleError(where(definition.form) + e.what());
+        }
+    }
+
+    uint64_t source_hash = fnv1a(source.data(), source.size());
+    uint64_t key = module_key(source_hash, dependencies);
+    if(cache_directory_.empty()) {
+        return key;
+    }
+    std::string image = snapshot::save(compiled);
+    std::string entry(cache_magic, sizeof(cache_magic));
+    auto put = [&entry](const void * x, size_t size) {
+        entry.append(static_cast<const char *>(x), size);
+    };
+    put(&cache_version, sizeof(cache_version));
+    put(&source_hash, sizeof(source_hash));
+    put(&key, sizeof(key));
+    uint32_t count = static_cast<uint32_t>(dependencies.size());
+    put(&count, sizeof(count));
+    for(auto& dependency : dependencies) {
+        uint32_t size = static_cast<uint32_t>(dependency.first.size());
+        put(&size, sizeof(size));
+        put(dependency.first.data(), size);
+        put(&dependency.second, sizeof(dependency.second));
+    }
+    uint64_t size = image.size();
+    put(&size, sizeof(size));
+    entry += image;
+    // The cache only saves time, failing to write it is not an error.
+    std::string path_in_cache = cache_directory_ + "/" + name + ".rdvc";
+    std::string temporary = path_in_cache + ".tmp";
+    {
+        std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+        out.write(entry.data(), entry.size());
+    }
+    if(std::rename(temporary.c_str(), path_in_cache.c_str()) != 0) {
+        std::remove(temporary.c_str());
+    }
+    return key;
+}
+
+// The namespace of module name in the root namespace, created if needed.
+Namespace& Loader::install(const std::string& name) {
+    Namespace * current = runtime_.value_namespace.root().get();
+    for(auto& component : split_module_name(name)) {
+        ValueRef value;
+        if(current->contains(component)) {
+            value = current->lookup(component);
+        } else {
+            value = make_value(Namespace(component));
+            current->bind(component, value);
+        }
+        current = boost::get<Namespace>(&value->variant);
+        if(current == nullptr) {
+            throw ModuleError("cannot load module " + name + ", " + component + " is bound to something that is not a namespace");
+        }
+    }
+    return *current;
+}
+
+bool Loader::resolve(const ast::Identifier& identifier) {
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    for(size_t n = identifier.name.size(); n > 0; --n) {
+        auto name = join(identifier.name.begin(), identifier.name.begin() + n, '.');
+        if(modules_.count(name) == 0 and !find(name).empty()) {
+            load(name);
+            return true;
+        }
+    }
+    return false;
+}
+
+void Loader::require(const std::string& name) {
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    load(name);
+}
+
+bool Loader::is_loaded(const std::string& name) const {
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    auto it = modules_.find(name);
+    return it != modules_.end() and it->second.state == State::Loaded;
+}
+
+Loader::Statistics Loader::statistics() const {
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    return statistics_;
+}
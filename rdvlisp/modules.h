@@ -0,0 +1,98 @@
+//
+//  modules.h
+//  rdvlisp
+//
+//  Created by Ruben De Visscher on 18/10/26.
+//  Copyright (c) 2026 Ruben De Visscher. All rights reserved.
+//
+
+#ifndef __rdvlisp__modules__
+#define __rdvlisp__modules__
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "eval.h"
+#include "macros.h"
+#include "reader.h"
+
+namespace rdvlisp {
+    namespace modules {
+        class ModuleError : public std::runtime_error {
+        public:
+            ModuleError(const std::string& what) : std::runtime_error(what) {}
+        };
+
+        // Loads modules into the value namespace of a runtime. Module a.b is
+        // the file a/b.rdv in the first directory of the search path that has
+        // it, a sequence of the forms
+        //   (define name expression)    binds name to the value of expression
+        //   (function name (x y) body)  binds name to a function of x and y
+        // bound in namespace a.b. Other code refers to them as a.b.name, the
+        // module itself by name alone. Forms (macro name (a b) 'template)
+        // define macros for the rest of the module, see macros::Expander.
+        //
+        // A module is compiled once: its function bodies are optimized, its
+        // expressions evaluated and the namespace that results is saved as a
+        // snapshot in the cache directory. The modules a module refers to by
+        // qualified name are its dependencies, loaded before it. Its cache
+        // entry is keyed by its source and the keys of its dependencies, so an
+        // edit recompiles the module and those depending on it, and only them.
+        //
+        // Nothing is loaded up front: the loader resolves the identifiers the
+        // runtime can't find by loading the module they are in, except under
+        // a Runtime::Concurrent: modules used by the parallel builtins or the
+        // server must be required beforehand.
+        class Loader {
+        public:
+            class Statistics {
+            public:
+                size_t compiled = 0;
+                size_t restored = 0;
+            };
+        private:
+            enum class State {
+                Loading,
+                Loaded
+            };
+            class Module {
+            public:
+                State state;
+                uint64_t key;
+            };
+
+            runtime::Runtime& runtime_;
+            std::vector<std::string> search_path_;
+            std::string cache_directory_;
+            std::map<std::string, Module> modules_;
+            // Path of the source of a module, empty if there is none.
+            std::map<std::string, std::string> paths_;
+            macros::Cache expansions_;
+            Statistics statistics_;
+            mutable std::recursive_mutex mutex_;
+
+            const std::string& find(const std::string& name);
+            uint64_t load(const std::string& name);
+            bool restore(const std::string& name, const std::string& source, uint64_t& key);
+            uint64_t compile(const std::string& name, const std::string& path, const SourceRef& source);
+            runtime::Namespace& install(const std::string& name);
+            bool resolve(const ast::Identifier& identifier);
+        public:
+            // cache_directory must exist, if it is empty nothing is cached.
+            Loader(runtime::Runtime& runtime, const std::vector<std::string>& search_path, const std::string& cache_directory="");
+            ~Loader();
+            Loader(const Loader&) = delete;
+            Loader& operator=(const Loader&) = delete;
+
+            // Loads module name and its dependencies, unless already loaded.
+            void require(const std::string& name);
+            bool is_loaded(const std::string& name) const;
+            Statistics statistics() const;
+        };
+    }
+}
+
+#endif /* defined(__rdvlisp__modules__) */
@@ -0,0 +1,216 @@
+//
+//  numeric.cpp
+//  rdvlisp
+//
+//  Created by Ruben De Visscher on 18/10/26.
+//  Copyright (c) 2026 Ruben De Visscher. All rights reserved.
+//
+
+#include "numeric.h"
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+#include <string>
+
+using namespace rdvlisp;
+
+static int digit_value(char c) {
+    if(c >= '0' and c <= '9') {
+        return c - '0';
+    } else if(c >= 'a' and c <= 'f') {
+        return c - 'a' + 10;
+    } else if(c >= 'A' and c <= 'F') {
+        return c - 'A' + 10;
+    } else {
+        return -1;
+    }
+}
+
+template <typename T>
+static bool fits(uint64_t magnitude, bool negative) {
+    if(negative) {
+        // The magnitude of the most negative value is one more than the maximum.
+        return magnitude <= static_cast<uint64_t>(std::numeric_limits<T>::max()) + 1;
+    } else {
+        return magnitude <= static_cast<uint64_t>(std::numeric_limits<T>::max());
+    }
+}
+
+template <typename T>
+static T negate(uint64_t magnitude) {
+    // Negate in unsigned arithmetic, the most negative value has no positive counterpart.
+    return static_cast<T>(static_cast<int64_t>(~magnitude + 1));
+}
+
+bool numeric::parse_integer(const char * begin, const char * end, decltype(ast::Integer::value)& value) {
+    const char * current = begin;
+    bool negative = false;
+    if(current != end and (*current == '+' or *current == '-')) {
+        negative = *current == '-';
+        ++current;
+    }
+    unsigned base = 10;
+    if(end - current > 2 and current[0] == '0' and (current[1] == 'x' or current[1] == 'b')) {
+        base = current[1] == 'x' ? 16 : 2;
+        current += 2;
+    }
+    uint64_t magnitude = 0;
+    const uint64_t limit = std::numeric_limits<uint64_t>::max();
+    for(; current != end; ++current) {
+        unsigned digit = static_cast<unsigned>(digit_value(*current));
+        if(magnitude > (limit - digit) / base) {
+            return false;
+        }
+        magnitude = magnitude * base + digit;
+    }
+    
+    if(negative) {
+        if(fits<int8_t>(magnitude, true)) {
+            value = negate<int8_t>(magnitude);
+        } else if(fits<int16_t>(magnitude, true)) {
+            value = negate<int16_t>(magnitude);
+        } else if(fits<int32_t>(magnitude, true)) {
+            value = negate<int32_t>(magnitude);
+        } else if(fits<int64_t>(magnitude, true)) {
+            value = negate<int64_t>(magnitude);
+        } else {
+            return false;
+        }
+    } else if(base == 10) {
+        if(fits<int8_t>(magnitude, false)) {
+            value = static_cast<int8_t>(magnitude);
+        } else if(fits<int16_t>(magnitude, false)) {
+            value = static_cast<int16_t>(magnitude);
+        } else if(fits<int32_t>(magnitude, false)) {
+            value = static_cast<int32_t>(magnitude);
+        } else if(fits<int64_t>(magnitude, false)) {
+            value = static_cast<int64_t>(magnitude);
+        } else {
+            value = magnitude;
+        }
+    } else {
+        if(fits<uint8_t>(magnitude, false)) {
+            value = static_cast<uint8_t>(magnitude);
+        } else if(fits<uint16_t>(magnitude, false)) {
+            value = static_cast<uint16_t>(magnitude);
+        } else if(fits<uint32_t>(magnitude, false)) {
+            value = static_cast<uint32_t>(magnitude);
+        } else {
+            value = magnitude;
+        }
+    }
+    return true;
+}
+
+// Powers of ten that are exactly representable as a double.
+static const double exact_powers_of_ten[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+// Clinger's fast path: when the decimal significand and the power of ten are
+// both exact doubles, a single multiplication or division rounds correctly.
+static bool parse_fast(uint64_t significand, int64_t exponent, double& result) {
+    const uint64_t max_exact_significand = uint64_t(1) << 53;
+    if(significand > max_exact_significand) {
+        return false;
+    }
+    double value = static_cast<double>(significand);
+    if(exponent < 0) {
+        if(exponent < -22) {
+            return false;
+        }
+        result = value / exact_powers_of_ten[-exponent];
+        return true;
+    }
+    if(exponent > 22) {
+        // 123e25 is 123000e22, which is still exact if the significand grows
+        // into no more than 53 bits.
+        if(exponent > 22 + 15) {
+            return false;
+        }
+        for(; exponent > 22; --exponent) {
+            if(significand > max_exact_significand / 10) {
+                return false;
+            }
+            significand *= 10;
+        }
+        value = static_cast<double>(significand);
+    }
+    result = value * exact_powers_of_ten[exponent];
+    return true;
+}
+
+bool numeric::parse_floating_point(const char * begin, const char * end, decltype(ast::FloatingPoint::value)& value) {
+    const char * current = begin;
+    bool negative = false;
+    if(current != end and (*current == '+' or *current == '-')) {
+        negative = *current == '-';
+        ++current;
+    }
+    uint64_t significand = 0;
+    int digits = 0;
+    int64_t exponent = 0;
+    bool truncated = false;
+    bool seen_point = false;
+    for(; current != end and *current != 'e' and *current != 'E'; ++current) {
+        if(*current == '.') {
+            seen_point = true;
+            continue;
+        }
+        int digit = *current - '0';
+        if(significand == 0 and digit == 0) {
+            // Leading zeros don't count towards the 19 digits that fit.
+            if(seen_point) {
+                --exponent;
+            }
+            continue;
+        }
+        if(digits < 19) {
+            significand = significand * 10 + digit;
+            ++digits;
+            if(seen_point) {
+                --exponent;
+            }
+        } else {
+            truncated = truncated or digit != 0;
+            if(!seen_point) {
+                ++exponent;
+            }
+        }
+    }
+    if(current != end) {
+        ++current;
+        bool exponent_negative = false;
+        if(*current == '+' or *current == '-') {
+            exponent_negative = *current == '-';
+            ++current;
+        }
+        int64_t written = 0;
+        for(; current != end; ++current) {
+            // Anything beyond this is zero or infinity anyway.
+            if(written < 100000) {
+                written = written * 10 + (*current - '0');
+            }
+        }
+        exponent += exponent_negative ? -written : written;
+    }
+    
+    double result = 0.0;
+    if(significand != 0 and (truncated or !parse_fast(significand, exponent, result))) {
+        // strtod rounds correctly, but is slow and depends on the locale's
+        // decimal point, which stays '.' unless the program calls setlocale.
+        result = std::fabs(std::strtod(std::string(begin, end).c_str(), nullptr));
+    }
+    if(std::isinf(result)) {
+        return false;
+    }
+    result = negative ? -result : result;
+    float narrowed = static_cast<float>(result);
+    if(static_cast<double>(narrowed) == result) {
+        value = narrowed;
+    } else {
+        value = result;
+    }
+    return true;
+}
@@ -0,0 +1,31 @@
+//
+//  numeric.h
+//  rdvlisp
+//
+//  Created by Ruben De Visscher on 18/10/26.
+//  Copyright (c) 2026 Ruben De Visscher. All rights reserved.
+//
+
+#ifndef __rdvlisp__numeric__
+#define __rdvlisp__numeric__
+
+#include "ast.h"
+
+namespace rdvlisp {
+    namespace numeric {
+        // Converts an integer literal as accepted by the lexer: an optional sign
+        // followed by decimal digits, or by 0x and hexadecimal or 0b and binary
+        // digits. Decimal literals get the smallest signed type that holds them
+        // (uint64 beyond int64); hexadecimal and binary literals are bit
+        // patterns and get the smallest unsigned type, or a signed one when
+        // negated. Returns false if the value doesn't fit in 64 bits.
+        bool parse_integer(const char * begin, const char * end, decltype(ast::Integer::value)& value);
+        
+        // Converts a decimal floating point literal, correctly rounded. Literals
+        // that are exactly representable as a float are stored as one, all
+        // others as a double. Returns false if the value overflows a double.
+        bool parse_floating_point(const char * begin, const char * end, decltype(ast::FloatingPoint::value)& value);
+    }
+}
+
+#endif /* defined(__rdvlisp__numeric__) */
@@ -0,0 +1,228 @@
+//
+//  optimize.cpp
+//  rdvlisp
+//
+//  Created by Ruben De Visscher on 18/10/26.
+//  Copyright (c) 2026 Ruben De Visscher. All rights reserved.
+//
+
+#include "optimize.h"
+#include <algorithm>
+#include <map>
+#include <set>
+
+using namespace rdvlisp::optimize;
+using namespace rdvlisp::runtime;
+using namespace rdvlisp;
+
+static ast::ExpressionRef make_expression(const ast::Expression& expression) {
+    return memory::make_shared<memory::Subsystem::Ast, ast::Expression>(expression);
+}
+
+// The expression a folded value is replaced by.
+class to_expression_visitor : public boost::static_visitor<ast::ExpressionRef> {
+    const ValueRef& value;
+    const ast::ExpressionRef& original;
+public:
+    to_expression_visitor(const ValueRef& value, const ast::ExpressionRef& original) : value(value), original(original) {}
+    ast::ExpressionRef operator()(const Integer& integer) const {
+        return make_expression(ast::Integer(integer.value));
+    }
+    ast::ExpressionRef operator()(const FloatingPoint& floating_point) const {
+        return make_expression(ast::FloatingPoint(floating_point.value));
+    }
+    ast::ExpressionRef operator()(const String& string) const {
+        return make_expression(ast::String(string.contents));
+    }
+    template <typename T>
+    ast::ExpressionRef operator()(const T& t) const {
+        return make_expression(ast::Constant(value, original));
+    }
+};
+
+static bool is_constant(const ast::ExpressionRef& expression) {
+    auto& variant = expression->variant;
+    return boost::get<ast::Integer>(&variant) != nullptr or boost::get<ast::FloatingPoint>(&variant) != nullptr or boost::get<ast::String>(&variant) != nullptr or boost::get<ast::Constant>(&variant) != nullptr;
+}
+
+static bool is_trivial(const ast::ExpressionRef& expression) {
+    return is_constant(expression) or boost::get<ast::Identifier>(&expression->variant) != nullptr;
+}
+
+static const std::string * parameter_name(const ast::ExpressionRef& expression, const std::set<std::string>& parameters) {
+    auto identifier = boost::get<ast::Identifier>(&expression->variant);
+    if(identifier != nullptr and identifier->name.size() == 1 and parameters.count(identifier->name[0]) > 0) {
+        return &identifier->name[0];
+    }
+    return nullptr;
+}
+
+static size_t count_uses(const ast::ExpressionRef& expression, const std::string& name) {
+    if(auto identifier = boost::get<ast::Identifier>(&expression->variant)) {
+        return identifier->name.size() == 1 and identifier->name[0] == name ? 1 : 0;
+    } else if(auto tuple = boost::get<ast::Tuple>(&expression->variant)) {
+        size_t uses = 0;
+        for(auto& element : tuple->elements) {
+            uses += count_uses(element, name);
+        }
+        return uses;
+    }
+    return 0;
+}
+
+static ast::ExpressionRef substitute(const ast::ExpressionRef& expression, const std::map<std::string, ast::ExpressionRef>& arguments) {
+    if(auto identifier = boost::get<ast::Identifier>(&expression->variant)) {
+        if(identifier->name.size() == 1) {
+            auto it = arguments.find(identifier->name[0]);
+            if(it != arguments.end()) {
+                return it->second;
+            }
+        }
+    } else if(auto tuple = boost::get<ast::Tuple>(&expression->variant)) {
+        ast::Tuple::Elements elements;
+        elements.reserve(tuple->elements.size());
+        for(auto& element : tuple->elements) {
+            elements.push_back(substitute(element, arguments));
+        }
+        return make_expression(ast::Tuple(std::move(elements)));
+    }
+    return expression;
+}
+
+class Optimizer {
+    Runtime& runtime_;
+    const Options& options_;
+    std::set<std::string> locals_;
+    size_t depth_;
+
+    bool is_local(const ast::Identifier& identifier) const {
+        return identifier.name.size() == 1 and locals_.count(identifier.name[0]) > 0;
+    }
+
+    // The value a global identifier is bound to, nullptr for anything else.
+    ValueRef resolve(const ast::ExpressionRef& expression) const {
+        auto identifier = boost::get<ast::Identifier>(&expression->variant);
+        if(identifier == nullptr or is_local(*identifier)) {
+            return nullptr;
+        }
+        try {
+            return runtime_.value_namespace.lookup(*identifier);
+        } catch(const NameError&) {
+            return nullptr;
+        }
+    }
+
+    // Whether evaluating expression only calls pure builtins. If parameters is
+    // given, the only identifiers allowed outside of call heads are those, and
+    // nodes counts the size of expression.
+    bool is_pure(const ast::ExpressionRef& expression, const std::set<std::string> * parameters, size_t& nodes) const {
+        ++nodes;
+        if(is_constant(expression)) {
+            return true;
+        } else if(boost::get<ast::Identifier>(&expression->variant) != nullptr) {
+            return parameters == nullptr or parameter_name(expression, *parameters) != nullptr;
+        } else if(auto tuple = boost::get<ast::Tuple>(&expression->variant)) {
+            if(tuple->elements.size() == 0 or (parameters != nullptr and parameter_name(tuple->elements[0], *parameters) != nullptr)) {
+                return false;
+            }
+            auto callable = resolve(tuple->elements[0]);
+            auto builtin = callable.get() != nullptr ? boost::get<Builtin>(&callable->variant) : nullptr;
+            if(builtin == nullptr or !builtin->pure) {
+                return false;
+            }
+            for(auto it = ++tuple->elements.begin(); it != tuple->elements.end(); ++it) {
+                if(!is_pure(*it, parameters, nodes)) {
+                    return false;
+                }
+            }
+            return true;
+        }
+        return false;
+    }
+
+    // The body of function with arguments substituted, or nullptr if it can't
+    // be inlined. Arguments that aren't trivial must be pure and used at most
+    // once, so that inlining neither drops nor repeats side effects or work.
+    ast::ExpressionRef inline_call(const Function& function, const std::vector<ast::ExpressionRef>& arguments) {
+        if(depth_ >= options_.inline_depth or arguments.size() != function.argument_names.size()) {
+            return nullptr;
+        }
+        std::set<std::string> parameters;
+        for(auto& name : function.argument_names) {
+            if(name.name.size() != 1) {
+                return nullptr;
+            }
+            parameters.insert(name.name[0]);
+        }
+        size_t nodes = 0;
+        if(!is_pure(function.body, &parameters, nodes) or nodes > options_.inline_limit) {
+            return nullptr;
+        }
+        std::map<std::string, ast::ExpressionRef> substitutions;
+        for(size_t i = 0; i < arguments.size(); ++i) {
+            auto& name = function.argument_names[i].name[0];
+            size_t argument_nodes = 0;
+            if(!is_trivial(arguments[i]) and (count_uses(function.body, name) > 1 or !is_pure(arguments[i], nullptr, argument_nodes))) {
+                return nullptr;
+            }
+            substitutions[name] = arguments[i];
+        }
+        ++depth_;
+        auto result = run(substitute(function.body, substitutions));
+        --depth_;
+        return result;
+    }
+public:
+    Optimizer(Runtime& runtime, const Options& options, const std::vector<std::string>& locals) : runtime_(runtime), options_(options), locals_(locals.begin(), locals.end()), depth_(0) {}
+
+    ast::ExpressionRef run(const ast::ExpressionRef& expression) {
+        auto tuple = boost::get<ast::Tuple>(&expression->variant);
+        if(tuple == nullptr or tuple->elements.size() == 0) {
+            return expression;
+        }
+        ast::Tuple::Elements elements;
+        elements.reserve(tuple->elements.size());
+        bool changed = false;
+        for(auto& element : tuple->elements) {
+            elements.push_back(run(element));
+            changed = changed or elements.back() != element;
+        }
+        auto current = changed ? make_expression(ast::Tuple(elements)) : expression;
+
+        auto callable = resolve(elements[0]);
+        if(callable.get() == nullptr) {
+            return current;
+        }
+        if(auto builtin = boost::get<Builtin>(&callable->variant)) {
+            if(builtin->pure and std::all_of(++elements.begin(), elements.end(), is_constant)) {
+                std::vector<ValueRef> arguments;
+                for(auto it = ++elements.begin(); it != elements.end(); ++it) {
+                    arguments.push_back(runtime_.eval(*it));
+                }
+                // Calls that fail are left for evaluation to report.
+                try {
+                    auto value = builtin->implementation(runtime_, arguments);
+                    return boost::apply_visitor(to_expression_visitor(value, current), value->variant);
+                } catch(const std::exception&) {}
+            }
+        } else if(auto function = boost::get<Function>(&callable->variant)) {
+            auto inlined = inline_call(*function, std::vector<ast::ExpressionRef>(++elements.begin(), elements.end()));
+            if(inlined.get() != nullptr) {
+                return inlined;
+            }
+        }
+        return current;
+    }
+};
+
+ast::ExpressionRef rdvlisp::optimize::optimize(Runtime& runtime, const ast::ExpressionRef& expression, const std::vector<std::string>& locals, const Options& options) {
+    return Optimizer(runtime, options, locals).run(expression);
+}
+
+Function rdvlisp::optimize::optimize(Runtime& runtime, const Function& function, const Options& options) {
+    std::vector<std::string> locals;
+    for(auto& name : function.argument_names) {
+        locals.insert(locals.end(), name.name.begin(), name.name.end());
+    }
+    return Function{function.argument_names, Optimizer(runtime, options, locals).run(function.body)};
+}
@@ -0,0 +1,45 @@
+//
+//  optimize.h
+//  rdvlisp
+//
+//  Created by Ruben De Visscher on 18/10/26.
+//  Copyright (c) 2026 Ruben De Visscher. All rights reserved.
+//
+
+#ifndef __rdvlisp__optimize__
+#define __rdvlisp__optimize__
+
+#include <string>
+#include <vector>
+#include "ast.h"
+#include "eval.h"
+
+namespace rdvlisp {
+    namespace optimize {
+        class Options {
+        public:
+            // Functions whose body has at most this many nodes are inlined.
+            size_t inline_limit;
+            // Inlining stops at this depth of nested inlined calls.
+            size_t inline_depth;
+            Options() : inline_limit(16), inline_depth(8) {}
+        };
+
+        // Rewrites expression ahead of evaluation:
+        //  - calls of pure builtins on constant arguments are replaced by their
+        //    result, a literal for numbers and strings and an ast::Constant for
+        //    anything else, e.g. arrays;
+        //  - calls of functions with a small body that only calls pure builtins
+        //    are replaced by the body, with the arguments substituted.
+        // Names are resolved in the value namespace of runtime as it is now, the
+        // result is stale if they are rebound later. locals are the names bound
+        // around expression when it is evaluated, they are never resolved.
+        // Subexpressions that don't change are shared with expression.
+        ast::ExpressionRef optimize(runtime::Runtime& runtime, const ast::ExpressionRef& expression, const std::vector<std::string>& locals=std::vector<std::string>(), const Options& options=Options());
+
+        // function with its body optimized, its arguments being the locals.
+        runtime::Function optimize(runtime::Runtime& runtime, const runtime::Function& function, const Options& options=Options());
+    }
+}
+
+#endif /* defined(__rdvlisp__optimize__) */
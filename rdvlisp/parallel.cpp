@@ -0,0 +1,161 @@
+//
+//  parallel.cpp
+//  rdvlisp
+//
+//  Created by Ruben De Visscher on 18/10/26.
+//  Copyright (c) 2026 Ruben De Visscher. All rights reserved.
+//
+
+#include "parallel.h"
+#include <algorithm>
+#include <limits>
+
+using namespace rdvlisp::parallel;
+
+static const size_t no_queue = std::numeric_limits<size_t>::max();
+
+// The pool and queue index of the worker running on this thread, if any.
+static thread_local ThreadPool * current_pool = nullptr;
+static thread_local size_t current_index = no_queue;
+
+ThreadPool::ThreadPool(size_t concurrency) : stopping_(false), pending_(0), next_queue_(0) {
+    size_t workers = concurrency > 1 ? concurrency - 1 : 0;
+    for(size_t i = 0; i < workers; ++i) {
+        queues_.push_back(std::unique_ptr<Queue>(new Queue()));
+    }
+    for(size_t i = 0; i < workers; ++i) {
+        threads_.push_back(std::thread(&ThreadPool::worker_loop, this, i));
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_all();
+    for(auto& thread : threads_) {
+        thread.join();
+    }
+}
+
+void ThreadPool::push(size_t queue_index, Task task) {
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex_);
+        ++pending_;
+    }
+    {
+        std::lock_guard<std::mutex> lock(queues_[queue_index]->mutex);
+        queues_[queue_index]->tasks.push_back(std::move(task));
+    }
+    wake_.notify_one();
+}
+
+bool ThreadPool::pop(size_t queue_index, Task& task) {
+    auto& queue = *queues_[queue_index];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if(queue.tasks.empty()) {
+        return false;
+    }
+    task = std::move(queue.tasks.back());
+    queue.tasks.pop_back();
+    --pending_;
+    return true;
+}
+
+bool ThreadPool::steal(size_t thief_index, Task& task) {
+    size_t n = queues_.size();
+    size_t offset = thief_index == no_queue ? 0 : thief_index + 1;
+    for(size_t i = 0; i < n; ++i) {
+        auto& queue = *queues_[(offset + i) % n];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if(!queue.tasks.empty()) {
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+            --pending_;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ThreadPool::try_run_one(size_t queue_index) {
+    Task task;
+    if((queue_index != no_queue and pop(queue_index, task)) or steal(queue_index, task)) {
+        task();
+        return true;
+    }
+    return false;
+}
+
+void ThreadPool::worker_loop(size_t index) {
+    current_pool = this;
+    current_index = index;
+    while(true) {
+        if(try_run_one(index)) {
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(sleep_mutex_);
+        wake_.wait(lock, [this] { return stopping_ or pending_ > 0; });
+        if(stopping_ and pending_ == 0) {
+            return;
+        }
+    }
+}
+
+size_t ThreadPool::grain_for(size_t size, size_t minimum) {
+    // Only depends on size, so the chunk boundaries (and thereby the order in
+    // which reductions combine their partial results) are the same no matter
+    // how many threads the pool has.
+    return std::max(minimum, (size + 255) / 256);
+}
+
+void ThreadPool::parallel_for(size_t begin, size_t end, size_t grain, const RangeBody& body) {
+    if(begin >= end) {
+        return;
+    }
+    if(grain == 0) {
+        grain = 1;
+    }
+    size_t chunks = (end - begin + grain - 1) / grain;
+    if(threads_.empty() or chunks == 1) {
+        for(size_t chunk_begin = begin; chunk_begin < end; chunk_begin += grain) {
+            body(chunk_begin, std::min(end, chunk_begin + grain));
+        }
+        return;
+    }
+
+    std::atomic<size_t> remaining(chunks);
+    std::mutex error_mutex;
+    std::exception_ptr error;
+
+    size_t own_index = current_pool == this ? current_index : no_queue;
+    size_t first_queue = own_index == no_queue ? next_queue_++ : own_index;
+    size_t chunk = 0;
+    for(size_t chunk_begin = begin; chunk_begin < end; chunk_begin += grain, ++chunk) {
+        size_t chunk_end = std::min(end, chunk_begin + grain);
+        // Workers keep their chunks local and let the others steal; external
+        // threads deal them out round-robin.
+        size_t queue_index = own_index == no_queue ? (first_queue + chunk) % queues_.size() : own_index;
+        push(queue_index, [&body, &remaining, &error_mutex, &error, chunk_begin, chunk_end]() {
+            try {
+                body(chunk_begin, chunk_end);
+            } catch(...) {
+                std::lock_guard<std::mutex> lock(error_mutex);
+                if(!error) {
+                    error = std::current_exception();
+                }
+            }
+            --remaining;
+        });
+    }
+
+    while(remaining > 0) {
+        if(!try_run_one(own_index)) {
+            std::this_thread::yield();
+        }
+    }
+    if(error) {
+        std::rethrow_exception(error);
+    }
+}
@@ -0,0 +1,76 @@
+//
+//  parallel.h
+//  rdvlisp
+//
+//  Created by Ruben De Visscher on 18/10/26.
+//  Copyright (c) 2026 Ruben De Visscher. All rights reserved.
+//
+
+#ifndef __rdvlisp__parallel__
+#define __rdvlisp__parallel__
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace rdvlisp {
+    namespace parallel {
+        // A fixed set of worker threads, each owning a deque of tasks. Owners pop
+        // from the back of their own deque, idle workers steal from the front of
+        // the others. Threads waiting on a parallel_for help execute tasks instead
+        // of blocking, so nested parallel_for calls cannot deadlock the pool.
+        class ThreadPool {
+        public:
+            typedef std::function<void()> Task;
+            typedef std::function<void(size_t, size_t)> RangeBody;
+        private:
+            class Queue {
+            public:
+                std::mutex mutex;
+                std::deque<Task> tasks;
+            };
+            std::vector<std::unique_ptr<Queue>> queues_;
+            std::vector<std::thread> threads_;
+            std::atomic<bool> stopping_;
+            std::atomic<size_t> pending_;
+            std::mutex sleep_mutex_;
+            std::condition_variable wake_;
+            std::atomic<size_t> next_queue_;
+
+            void push(size_t queue_index, Task task);
+            bool pop(size_t queue_index, Task& task);
+            bool steal(size_t thief_index, Task& task);
+            bool try_run_one(size_t queue_index);
+            void worker_loop(size_t index);
+        public:
+            // concurrency counts the calling thread, so ThreadPool(1) never spawns
+            // a thread and runs every parallel_for inline.
+            ThreadPool(size_t concurrency=std::thread::hardware_concurrency());
+            ~ThreadPool();
+            ThreadPool(const ThreadPool&) = delete;
+            ThreadPool& operator=(const ThreadPool&) = delete;
+
+            size_t concurrency() const {
+                return threads_.size() + 1;
+            }
+
+            // Splits [begin, end[ into chunks of at most grain elements and runs
+            // body(chunk_begin, chunk_end) for each of them. Returns once every
+            // chunk has finished; the first exception thrown by a chunk is
+            // rethrown here.
+            void parallel_for(size_t begin, size_t end, size_t grain, const RangeBody& body);
+
+            // Chunk size for a range of size elements: at most 256 chunks, and no
+            // fewer than minimum elements per chunk.
+            static size_t grain_for(size_t size, size_t minimum=16);
+        };
+    }
+}
+
+#endif /* defined(__rdvlisp__parallel__) */
@@ -0,0 +1,501 @@
+//
+//  persistent.h
+//  rdvlisp
+//
+//  Created by Ruben De Visscher on 18/10/26.
+//  Copyright (c) 2026 Ruben De Visscher. All rights reserved.
+//
+
+#ifndef __rdvlisp__persistent__
+#define __rdvlisp__persistent__
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+#include "memory.h"
+
+namespace rdvlisp {
+    // Immutable containers whose updates copy only the path to what changed
+    // and share the rest with the original, O(log32 n) per update. Their
+    // transients make a batch of updates in place on the nodes they created
+    // themselves, and hand out an immutable container at the end. Nodes are
+    // accounted to memory::Subsystem::Values.
+    namespace persistent {
+        static const unsigned bits = 5;
+        static const size_t width = size_t(1) << bits;
+        static const size_t mask = width - 1;
+
+        // Nodes with owner 0 are shared, the others belong to the transient
+        // with that owner and only it may change them.
+        inline uint64_t make_owner() {
+            static std::atomic<uint64_t> next(1);
+            return next.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        inline size_t index(uint32_t bitmap, uint32_t bit) {
+            return __builtin_popcount(bitmap & (bit - 1));
+        }
+
+        // A vector as a trie of 32-way nodes, the last elements kept in a
+        // separate tail so that appending rarely touches the trie.
+        template <typename T>
+        class Vector {
+        public:
+            class Transient;
+        private:
+            class Node {
+            public:
+                std::vector<std::shared_ptr<Node>> children;
+                std::vector<T> values;
+                uint64_t owner;
+                Node(uint64_t owner) : owner(owner) {}
+            };
+            typedef std::shared_ptr<Node> NodeRef;
+
+            size_t size_;
+            // Depth of the trie times bits, 0 when root_ is a leaf.
+            unsigned shift_;
+            // The elements before tail_offset(), null if there are none.
+            NodeRef root_;
+            // The 1 to 32 elements from tail_offset() on, null when empty.
+            NodeRef tail_;
+
+            static NodeRef make_node(uint64_t owner) {
+                return memory::make_shared<memory::Subsystem::Values, Node>(owner);
+            }
+            static NodeRef editable(const NodeRef& node, uint64_t owner) {
+                if(owner != 0 and node->owner == owner) {
+                    return node;
+                }
+                auto copy = make_node(owner);
+                copy->children = node->children;
+                copy->values = node->values;
+                return copy;
+            }
+            size_t tail_offset() const {
+                return size_ < width ? 0 : ((size_ - 1) >> bits) << bits;
+            }
+            static NodeRef assign(const NodeRef& node, unsigned level, size_t index, const T& x, uint64_t owner) {
+                auto result = editable(node, owner);
+                if(level == 0) {
+                    result->values[index & mask] = x;
+                } else {
+                    auto& child = result->children[(index >> level) & mask];
+                    child = assign(child, level - bits, index, x, owner);
+                }
+                return result;
+            }
+            static NodeRef new_path(unsigned level, const NodeRef& leaf, uint64_t owner) {
+                if(level == 0) {
+                    return leaf;
+                }
+                auto node = make_node(owner);
+                node->children.push_back(new_path(level - bits, leaf, owner));
+                return node;
+            }
+            // Adds leaf, holding the elements from index on, to the trie.
+            static NodeRef push_leaf(const NodeRef& node, unsigned level, size_t index, const NodeRef& leaf, uint64_t owner) {
+                auto result = editable(node, owner);
+                size_t i = (index >> level) & mask;
+                if(level == bits) {
+                    result->children.push_back(leaf);
+                } else if(i < result->children.size()) {
+                    result->children[i] = push_leaf(result->children[i], level - bits, index, leaf, owner);
+                } else {
+                    result->children.push_back(new_path(level - bits, leaf, owner));
+                }
+                return result;
+            }
+            void assign(size_t index, const T& x, uint64_t owner) {
+                if(index >= tail_offset()) {
+                    tail_ = editable(tail_, owner);
+                    tail_->values[index & mask] = x;
+                } else {
+                    root_ = assign(root_, shift_, index, x, owner);
+                }
+            }
+            void push_back(const T& x, uint64_t owner) {
+                if(tail_.get() != nullptr and size_ - tail_offset() < width) {
+                    tail_ = editable(tail_, owner);
+                    tail_->values.push_back(x);
+                    ++size_;
+                    return;
+                }
+                if(tail_.get() != nullptr) {
+                    size_t offset = tail_offset();
+                    if(root_.get() == nullptr) {
+                        root_ = tail_;
+                        shift_ = 0;
+                    } else if(offset == size_t(1) << (shift_ + bits)) {
+                        auto node = make_node(owner);
+                        node->children.push_back(root_);
+                        node->children.push_back(new_path(shift_, tail_, owner));
+                        root_ = node;
+                        shift_ += bits;
+                    } else {
+                        root_ = push_leaf(root_, shift_, offset, tail_, owner);
+                    }
+                }
+                tail_ = make_node(owner);
+                tail_->values.reserve(owner != 0 ? width : 1);
+                tail_->values.push_back(x);
+                ++size_;
+            }
+            template <typename F>
+            static void for_each(const Node& node, unsigned level, F& f) {
+                if(level == 0) {
+                    for(auto& x : node.values) {
+                        f(x);
+                    }
+                } else {
+                    for(auto& child : node.children) {
+                        for_each(*child, level - bits, f);
+                    }
+                }
+            }
+        public:
+            Vector() : size_(0), shift_(0) {}
+
+            size_t size() const {
+                return size_;
+            }
+            bool empty() const {
+                return size_ == 0;
+            }
+            // index must be less than size().
+            const T& operator[](size_t index) const {
+                if(index >= tail_offset()) {
+                    return tail_->values[index & mask];
+                }
+                const Node * node = root_.get();
+                for(unsigned level = shift_; level > 0; level -= bits) {
+                    node = node->children[(index >> level) & mask].get();
+                }
+                return node->values[index & mask];
+            }
+
+            // This vector with the element at index, less than size(), set to x.
+            Vector set(size_t index, const T& x) const {
+                Vector result = *this;
+                result.assign(index, x, 0);
+                return result;
+            }
+            Vector push_back(const T& x) const {
+                Vector result = *this;
+                result.push_back(x, 0);
+                return result;
+            }
+
+            // Calls f(x) for each element, in order.
+            template <typename F>
+            void for_each(F f) const {
+                if(root_.get() != nullptr) {
+                    for_each(*root_, shift_, f);
+                }
+                if(tail_.get() != nullptr) {
+                    for_each(*tail_, 0, f);
+                }
+            }
+        };
+
+        template <typename T>
+        class Vector<T>::Transient {
+            Vector vector_;
+            uint64_t owner_;
+        public:
+            Transient(const Vector& vector=Vector()) : vector_(vector), owner_(make_owner()) {}
+            size_t size() const {
+                return vector_.size();
+            }
+            const T& operator[](size_t index) const {
+                return vector_[index];
+            }
+            void set(size_t index, const T& x) {
+                vector_.assign(index, x, owner_);
+            }
+            void push_back(const T& x) {
+                vector_.push_back(x, owner_);
+            }
+            // The vector as it is now. Later updates through the transient
+            // don't affect it.
+            Vector persistent() {
+                owner_ = make_owner();
+                return vector_;
+            }
+        };
+
+        // A hash array mapped trie. Each node has one slot per 5 bits of the
+        // hash at its level, holding either an entry or a child node; keys
+        // whose 64 bits of hash are all equal share a collision node.
+        template <typename K, typename V, typename Hash=std::hash<K>, typename Equal=std::equal_to<K>>
+        class Map {
+        public:
+            class Transient;
+        private:
+            class Entry {
+            public:
+                K key;
+                V value;
+                uint64_t hash;
+            };
+            class Node {
+            public:
+                // Slots holding an entry and slots holding a child, both 0 in
+                // a collision node.
+                uint32_t datamap;
+                uint32_t nodemap;
+                std::vector<Entry> entries;
+                std::vector<std::shared_ptr<Node>> children;
+                uint64_t owner;
+                Node(uint64_t owner) : datamap(0), nodemap(0), owner(owner) {}
+            };
+            typedef std::shared_ptr<Node> NodeRef;
+
+            size_t size_;
+            // null when empty.
+            NodeRef root_;
+
+            static NodeRef make_node(uint64_t owner) {
+                return memory::make_shared<memory::Subsystem::Values, Node>(owner);
+            }
+            static NodeRef editable(const NodeRef& node, uint64_t owner) {
+                if(owner != 0 and node->owner == owner) {
+                    return node;
+                }
+                auto copy = make_node(owner);
+                copy->datamap = node->datamap;
+                copy->nodemap = node->nodemap;
+                copy->entries = node->entries;
+                copy->children = node->children;
+                return copy;
+            }
+            static uint32_t slot(uint64_t hash, unsigned shift) {
+                return uint32_t(1) << ((hash >> shift) & mask);
+            }
+            static bool matches(const Entry& entry, uint64_t hash, const K& key) {
+                return entry.hash == hash and Equal()(entry.key, key);
+            }
+            static NodeRef merge(unsigned shift, const Entry& a, const Entry& b, uint64_t owner) {
+                auto node = make_node(owner);
+                if(shift >= 64) {
+                    node->entries = {a, b};
+                    return node;
+                }
+                uint32_t p = slot(a.hash, shift);
+                uint32_t q = slot(b.hash, shift);
+                if(p == q) {
+                    node->nodemap = p;
+                    node->children.push_back(merge(shift + bits, a, b, owner));
+                } else {
+                    node->datamap = p | q;
+                    node->entries = p < q ? std::vector<Entry>{a, b} : std::vector<Entry>{b, a};
+                }
+                return node;
+            }
+            static NodeRef insert(const NodeRef& node, unsigned shift, const Entry& entry, uint64_t owner, bool& added) {
+                if(shift >= 64) {
+                    for(size_t i = 0; i < node->entries.size(); ++i) {
+                        if(matches(node->entries[i], entry.hash, entry.key)) {
+                            auto result = editable(node, owner);
+                            result->entries[i].value = entry.value;
+                            return result;
+                        }
+                    }
+                    auto result = editable(node, owner);
+                    result->entries.push_back(entry);
+                    added = true;
+                    return result;
+                }
+                uint32_t bit = slot(entry.hash, shift);
+                if(node->datamap & bit) {
+                    size_t i = index(node->datamap, bit);
+                    if(matches(node->entries[i], entry.hash, entry.key)) {
+                        auto result = editable(node, owner);
+                        result->entries[i].value = entry.value;
+                        return result;
+                    }
+                    auto child = merge(shift + bits, node->entries[i], entry, owner);
+                    auto result = editable(node, owner);
+                    result->entries.erase(result->entries.begin() + i);
+                    result->datamap ^= bit;
+                    result->nodemap |= bit;
+                    result->children.insert(result->children.begin() + index(result->nodemap, bit), child);
+                    added = true;
+                    return result;
+                }
+                if(node->nodemap & bit) {
+                    size_t i = index(node->nodemap, bit);
+                    auto child = insert(node->children[i], shift + bits, entry, owner, added);
+                    if(child == node->children[i]) {
+                        return node;
+                    }
+                    auto result = editable(node, owner);
+                    result->children[i] = child;
+                    return result;
+                }
+                auto result = editable(node, owner);
+                result->entries.insert(result->entries.begin() + index(result->datamap, bit), entry);
+                result->datamap |= bit;
+                added = true;
+                return result;
+            }
+            // A child left with a single entry is replaced by that entry, so
+            // that a map has the same shape however it was built.
+            static NodeRef erase(const NodeRef& node, unsigned shift, uint64_t hash, const K& key, uint64_t owner, bool& removed) {
+                if(shift >= 64) {
+                    for(size_t i = 0; i < node->entries.size(); ++i) {
+                        if(matches(node->entries[i], hash, key)) {
+                            auto result = editable(node, owner);
+                            result->entries.erase(result->entries.begin() + i);
+                            removed = true;
+                            return result;
+                        }
+                    }
+                    return node;
+                }
+                uint32_t bit = slot(hash, shift);
+                if(node->datamap & bit) {
+                    size_t i = index(node->datamap, bit);
+                    if(!matches(node->entries[i], hash, key)) {
+                        return node;
+                    }
+                    auto result = editable(node, owner);
+                    result->entries.erase(result->entries.begin() + i);
+                    result->datamap ^= bit;
+                    removed = true;
+                    return result;
+                }
+                if(node->nodemap & bit) {
+                    size_t i = index(node->nodemap, bit);
+                    auto child = erase(node->children[i], shift + bits, hash, key, owner, removed);
+                    if(!removed) {
+                        return node;
+                    }
+                    auto result = editable(node, owner);
+                    if(child->children.empty() and child->entries.size() == 1) {
+                        result->children.erase(result->children.begin() + i);
+                        result->nodemap ^= bit;
+                        result->entries.insert(result->entries.begin() + index(result->datamap, bit), child->entries[0]);
+                        result->datamap |= bit;
+                    } else {
+                        result->children[i] = child;
+                    }
+                    return result;
+                }
+                return node;
+            }
+            void insert(const K& key, const V& value, uint64_t owner) {
+                bool added = false;
+                Entry entry{key, value, static_cast<uint64_t>(Hash()(key))};
+                if(root_.get() == nullptr) {
+                    root_ = make_node(owner);
+                }
+                root_ = insert(root_, 0, entry, owner, added);
+                size_ += added ? 1 : 0;
+            }
+            void erase(const K& key, uint64_t owner) {
+                bool removed = false;
+                if(root_.get() == nullptr) {
+                    return;
+                }
+                root_ = erase(root_, 0, static_cast<uint64_t>(Hash()(key)), key, owner, removed);
+                if(removed and --size_ == 0) {
+                    root_.reset();
+                }
+            }
+            template <typename F>
+            static void for_each(const Node& node, F& f) {
+                for(auto& entry : node.entries) {
+                    f(entry.key, entry.value);
+                }
+                for(auto& child : node.children) {
+                    for_each(*child, f);
+                }
+            }
+        public:
+            Map() : size_(0) {}
+
+            size_t size() const {
+                return size_;
+            }
+            bool empty() const {
+                return size_ == 0;
+            }
+            // The value of key, nullptr if it has none.
+            const V * find(const K& key) const {
+                if(root_.get() == nullptr) {
+                    return nullptr;
+                }
+                uint64_t hash = Hash()(key);
+                const Node * node = root_.get();
+                for(unsigned shift = 0; shift < 64; shift += bits) {
+                    uint32_t bit = slot(hash, shift);
+                    if(node->datamap & bit) {
+                        auto& entry = node->entries[index(node->datamap, bit)];
+                        return matches(entry, hash, key) ? &entry.value : nullptr;
+                    } else if(node->nodemap & bit) {
+                        node = node->children[index(node->nodemap, bit)].get();
+                    } else {
+                        return nullptr;
+                    }
+                }
+                for(auto& entry : node->entries) {
+                    if(matches(entry, hash, key)) {
+                        return &entry.value;
+                    }
+                }
+                return nullptr;
+            }
+
+            // This map with key bound to value, replacing its value if any.
+            Map insert(const K& key, const V& value) const {
+                Map result = *this;
+                result.insert(key, value, 0);
+                return result;
+            }
+            Map erase(const K& key) const {
+                Map result = *this;
+                result.erase(key, 0);
+                return result;
+            }
+
+            // Calls f(key, value) for each entry, in no particular order.
+            template <typename F>
+            void for_each(F f) const {
+                if(root_.get() != nullptr) {
+                    for_each(*root_, f);
+                }
+            }
+        };
+
+        template <typename K, typename V, typename Hash, typename Equal>
+        class Map<K, V, Hash, Equal>::Transient {
+            Map map_;
+            uint64_t owner_;
+        public:
+            Transient(const Map& map=Map()) : map_(map), owner_(make_owner()) {}
+            size_t size() const {
+                return map_.size();
+            }
+            const V * find(const K& key) const {
+                return map_.find(key);
+            }
+            void insert(const K& key, const V& value) {
+                map_.insert(key, value, owner_);
+            }
+            void erase(const K& key) {
+                map_.erase(key, owner_);
+            }
+            // The map as it is now. Later updates through the transient don't
+            // affect it.
+            Map persistent() {
+                owner_ = make_owner();
+                return map_;
+            }
+        };
+    }
+}
+
+#endif /* defined(__rdvlisp__persistent__) */
@@ -0,0 +1,334 @@
+//
+//  profile.cpp
+//  rdvlisp
+//
+//  Created by Ruben De Visscher on 18/10/26.
+//  Copyright (c) 2026 Ruben De Visscher. All rights reserved.
+//
+
+#include "profile.h"
+#include <algorithm>
+#include <cerrno>
+#include <iomanip>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <signal.h>
+#include <sys/time.h>
+
+using namespace rdvlisp::profile;
+using namespace rdvlisp;
+
+static std::atomic<uint64_t> next_profiler_id(1);
+static std::atomic<Profiler *> sampling_profiler(nullptr);
+
+// The state of the calling thread for the profiler with id current_owner,
+// and for every profiler it used, by id. Ids aren't reused, so the states of
+// profilers that are gone are never looked up again.
+static thread_local uint64_t current_owner = 0;
+static thread_local void * current_state = nullptr;
+
+static std::unordered_map<uint64_t, void *>& thread_states() {
+    static thread_local std::unordered_map<uint64_t, void *> states;
+    return states;
+}
+
+static uint64_t now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+Profiler::Profiler(Mode mode, AllocationCounter allocation_counter, std::chrono::microseconds interval, size_t sample_capacity) : mode_(mode), allocation_counter_(allocation_counter), id_(next_profiler_id++), sample_capacity_(sample_capacity), next_sample_(0), dropped_samples_(0), sampling_(false) {
+    if(mode_ != Mode::Sampling) {
+        return;
+    }
+    samples_.resize(sample_capacity_ * (max_sample_depth + 1));
+    Profiler * expected = nullptr;
+    if(!sampling_profiler.compare_exchange_strong(expected, this)) {
+        throw std::logic_error("another profiler is already sampling");
+    }
+    struct sigaction action;
+    action.sa_handler = on_signal;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+    sigaction(SIGPROF, &action, nullptr);
+    itimerval timer;
+    timer.it_interval.tv_sec = interval.count() / 1000000;
+    timer.it_interval.tv_usec = interval.count() % 1000000;
+    timer.it_value = timer.it_interval;
+    setitimer(ITIMER_PROF, &timer, nullptr);
+    sampling_ = true;
+}
+
+Profiler::~Profiler() {
+    stop();
+}
+
+void Profiler::stop() {
+    if(!sampling_) {
+        return;
+    }
+    itimerval timer = {};
+    setitimer(ITIMER_PROF, &timer, nullptr);
+    // A signal still in flight must not terminate the process.
+    signal(SIGPROF, SIG_IGN);
+    sampling_profiler = nullptr;
+    sampling_ = false;
+}
+
+void Profiler::on_signal(int) {
+    int saved_errno = errno;
+    if(Profiler * profiler = sampling_profiler.load(std::memory_order_relaxed)) {
+        profiler->record_sample();
+    }
+    errno = saved_errno;
+}
+
+// Runs in the signal handler, on the interrupted thread.
+void Profiler::record_sample() {
+    if(current_owner != id_) {
+        return;
+    }
+    auto& state = *static_cast<ThreadState *>(current_state);
+    size_t depth = state.sample_depth;
+    if(depth > max_sample_depth) {
+        depth = max_sample_depth;
+    }
+    if(depth == 0) {
+        return;
+    }
+    size_t index = next_sample_.fetch_add(1, std::memory_order_relaxed);
+    if(index >= sample_capacity_) {
+        dropped_samples_.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    uint32_t * record = &samples_[index * (max_sample_depth + 1)];
+    std::copy(state.sample_stack, state.sample_stack + depth, record + 1);
+    record[0] = static_cast<uint32_t>(depth);
+}
+
+size_t Profiler::samples() const {
+    return std::min<size_t>(next_sample_, sample_capacity_);
+}
+
+Profiler::ThreadState& Profiler::thread_state() {
+    if(current_owner != id_) {
+        auto& state = thread_states()[id_];
+        if(state == nullptr) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            threads_.emplace_back(new ThreadState());
+            state = threads_.back().get();
+        }
+        // Set in this order so that a signal in between sees no state rather
+        // than the wrong one.
+        current_owner = 0;
+        current_state = state;
+        current_owner = id_;
+    }
+    return *static_cast<ThreadState *>(current_state);
+}
+
+uint32_t Profiler::site(ThreadState& state, const void * key, const std::function<Site()>& make_site) {
+    auto it = state.sites.find(key);
+    if(it != state.sites.end()) {
+        return it->second;
+    }
+    uint32_t id;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto global = sites_.find(key);
+        if(global != sites_.end()) {
+            id = global->second;
+        } else {
+            id = static_cast<uint32_t>(site_info_.size());
+            site_info_.push_back(make_site());
+            sites_[key] = id;
+        }
+    }
+    state.sites[key] = id;
+    if(state.counters.size() <= id) {
+        state.counters.resize(id + 1);
+        state.active.resize(id + 1);
+    }
+    return id;
+}
+
+void Profiler::enter(ThreadState& state, uint32_t site) {
+    uint64_t allocations = allocation_counter_ != nullptr ? allocation_counter_() : 0;
+    state.frames.push_back(Frame{site, now(), 0, allocations, 0});
+    ++state.counters[site].calls;
+    ++state.active[site];
+}
+
+// Prints expression until more than limit characters are, without visiting
+// the rest of it, so that naming a span doesn't depend on its size.
+static void print_prefix(std::ostream& os, const ast::Expression& expression, size_t limit);
+
+static void print_prefix(std::ostream& os, const ast::Tuple& tuple, size_t limit) {
+    os << "(";
+    for(size_t i = 0; i < tuple.elements.size() and static_cast<size_t>(os.tellp()) <= limit; ++i) {
+        if(i > 0) {
+            os << " ";
+        }
+        print_prefix(os, *tuple.elements[i], limit);
+    }
+    os << ")";
+}
+
+static void print_prefix(std::ostream& os, const ast::Expression& expression, size_t limit) {
+    if(static_cast<size_t>(os.tellp()) > limit) {
+        return;
+    }
+    if(auto tuple = boost::get<ast::Tuple>(&expression.variant)) {
+        print_prefix(os, *tuple, limit);
+    } else if(auto constant = boost::get<ast::Constant>(&expression.variant)) {
+        print_prefix(os, *constant->original, limit);
+    } else if(auto string = boost::get<ast::String>(&expression.variant)) {
+        os << ast::String(string->contents.slice(0, std::min(string->contents.size(), limit)));
+    } else {
+        os << expression;
+    }
+}
+
+static std::string span_name(const ast::Tuple& tuple) {
+    std::ostringstream ss;
+    print_prefix(ss, tuple, 60);
+    std::string printed = ss.str();
+    return printed.size() > 60 ? printed.substr(0, 57) + "..." : printed;
+}
+
+bool Profiler::enter_span(const ast::Tuple& tuple) {
+    if(mode_ != Mode::Counters) {
+        return false;
+    }
+    auto& state = thread_state();
+    // Called with mutex_ held. Naming is left to the report, it costs more
+    // than evaluating most tuples.
+    auto make_site = [this, &tuple] {
+        auto it = span_names_.find(&tuple);
+        if(it != span_names_.end()) {
+            return Site{Entry::Kind::Span, it->second, nullptr};
+        }
+        return Site{Entry::Kind::Span, "", std::make_shared<const ast::Tuple>(tuple)};
+    };
+    enter(state, site(state, &tuple, make_site));
+    return true;
+}
+
+bool Profiler::enter_function(const void * key, const std::function<std::string()>& name) {
+    auto& state = thread_state();
+    uint32_t id = site(state, key, [&name] {
+        return Site{Entry::Kind::Function, name(), nullptr};
+    });
+    if(mode_ == Mode::Counters) {
+        enter(state, id);
+    } else {
+        size_t depth = state.sample_depth;
+        if(depth < max_sample_depth) {
+            state.sample_stack[depth] = id;
+        }
+        std::atomic_signal_fence(std::memory_order_release);
+        state.sample_depth = depth + 1;
+    }
+    return true;
+}
+
+void Profiler::exit() {
+    auto& state = thread_state();
+    if(mode_ == Mode::Sampling) {
+        state.sample_depth = state.sample_depth - 1;
+        return;
+    }
+    Frame frame = state.frames.back();
+    state.frames.pop_back();
+    uint64_t elapsed = now() - frame.start_time;
+    uint64_t allocations = (allocation_counter_ != nullptr ? allocation_counter_() : 0) - frame.start_allocations;
+    auto& counters = state.counters[frame.site];
+    counters.self_time += elapsed - frame.child_time;
+    counters.self_allocations += allocations - frame.child_allocations;
+    if(--state.active[frame.site] == 0) {
+        counters.total_time += elapsed;
+        counters.allocations += allocations;
+    }
+    if(!state.frames.empty()) {
+        state.frames.back().child_time += elapsed;
+        state.frames.back().child_allocations += allocations;
+    }
+}
+
+static void name_spans(std::unordered_map<const void *, std::string>& names, const std::string& name, const SourceMap& source_map, const ast::ExpressionRef& expression, const Span& span) {
+    auto tuple = boost::get<ast::Tuple>(&expression->variant);
+    if(tuple == nullptr) {
+        return;
+    }
+    std::stringstream ss;
+    ss << name << ":" << source_map.position(span.start);
+    names[tuple] = ss.str();
+    for(size_t i = 0; i < tuple->elements.size() and i < span.elements.size(); ++i) {
+        name_spans(names, name, source_map, tuple->elements[i], span.elements[i]);
+    }
+}
+
+void Profiler::add_source(const std::string& name, const std::string& source, const ast::ExpressionRef& form, const Span& span) {
+    SourceMap source_map(source);
+    std::lock_guard<std::mutex> lock(mutex_);
+    name_spans(span_names_, name, source_map, form, span);
+}
+
+std::vector<Entry> Profiler::entries() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<Entry> entries;
+    for(auto& site : site_info_) {
+        entries.push_back(Entry{site.kind, site.tuple.get() != nullptr ? span_name(*site.tuple) : site.name, Counters()});
+    }
+    for(auto& state : threads_) {
+        for(size_t i = 0; i < state->counters.size(); ++i) {
+            auto& from = state->counters[i];
+            auto& to = entries[i].counters;
+            to.calls += from.calls;
+            to.total_time += from.total_time;
+            to.self_time += from.self_time;
+            to.allocations += from.allocations;
+            to.self_allocations += from.self_allocations;
+        }
+    }
+    std::stable_sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) {
+        return a.counters.self_time > b.counters.self_time;
+    });
+    return entries;
+}
+
+void Profiler::write_report(std::ostream& os, size_t limit) const {
+    auto all = entries();
+    os << std::setw(10) << "calls" << std::setw(12) << "total ms" << std::setw(12) << "self ms" << std::setw(12) << "allocs" << std::setw(12) << "self allocs" << "  name" << std::endl;
+    for(size_t i = 0; i < all.size() and i < limit; ++i) {
+        auto& counters = all[i].counters;
+        os << std::setw(10) << counters.calls
+           << std::setw(12) << std::fixed << std::setprecision(3) << counters.total_time / 1e6
+           << std::setw(12) << counters.self_time / 1e6
+           << std::setw(12) << counters.allocations
+           << std::setw(12) << counters.self_allocations
+           << "  " << (all[i].kind == Entry::Kind::Function ? "" : "span ") << all[i].name << std::endl;
+    }
+}
+
+void Profiler::write_folded(std::ostream& os) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::map<std::string, uint64_t> stacks;
+    size_t n = samples();
+    for(size_t i = 0; i < n; ++i) {
+        const uint32_t * record = &samples_[i * (max_sample_depth + 1)];
+        std::string stack;
+        for(uint32_t j = 0; j < record[0]; ++j) {
+            if(j > 0) {
+                stack += ";";
+            }
+            stack += site_info_[record[j + 1]].name;
+        }
+        if(!stack.empty()) {
+            ++stacks[stack];
+        }
+    }
+    for(auto& entry : stacks) {
+        os << entry.first << " " << entry.second << "\n";
+    }
+}
@@ -0,0 +1,175 @@
+//
+//  profile.h
+//  rdvlisp
+//
+//  Created by Ruben De Visscher on 18/10/26.
+//  Copyright (c) 2026 Ruben De Visscher. All rights reserved.
+//
+
+#ifndef __rdvlisp__profile__
+#define __rdvlisp__profile__
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "ast.h"
+#include "reader.h"
+
+namespace rdvlisp {
+    namespace profile {
+        // Totals for one function or source span. Times are in nanoseconds,
+        // total ones include callees and self ones don't. Recursive calls are
+        // only counted once in the totals.
+        class Counters {
+        public:
+            uint64_t calls = 0;
+            uint64_t total_time = 0;
+            uint64_t self_time = 0;
+            uint64_t allocations = 0;
+            uint64_t self_allocations = 0;
+        };
+
+        class Entry {
+        public:
+            enum class Kind {
+                Function,
+                Span
+            };
+            Kind kind;
+            std::string name;
+            Counters counters;
+        };
+
+        // Instrumentation for Runtime::set_profiler. In Counters mode every call
+        // and every evaluated tuple updates the Counters of its callable or
+        // span. In Sampling mode the evaluator only keeps a stack of the
+        // callables it is in, which a SIGPROF timer copies at every interval;
+        // write_folded turns those samples into input for flamegraph.pl.
+        // Callables and spans are told apart by address, so results are only
+        // meaningful while the values and forms evaluated are alive.
+        class Profiler {
+        public:
+            enum class Mode {
+                Counters,
+                Sampling
+            };
+            // Returns the number of allocations made so far by the calling
+            // thread or the process.
+            typedef uint64_t (*AllocationCounter)();
+            static const size_t max_sample_depth = 32;
+        private:
+            class Site {
+            public:
+                Entry::Kind kind;
+                std::string name;
+                // A span without a name from add_source is named after the
+                // start of its printed form when reported. The copy keeps its
+                // elements alive till then.
+                std::shared_ptr<const ast::Tuple> tuple;
+            };
+            class Frame {
+            public:
+                uint32_t site;
+                uint64_t start_time;
+                uint64_t child_time;
+                uint64_t start_allocations;
+                uint64_t child_allocations;
+            };
+            class ThreadState {
+            public:
+                std::unordered_map<const void *, uint32_t> sites;
+                std::vector<Counters> counters;
+                std::vector<uint32_t> active;
+                std::vector<Frame> frames;
+                // Read by the signal handler of the same thread.
+                uint32_t sample_stack[max_sample_depth];
+                volatile size_t sample_depth = 0;
+            };
+
+            Mode mode_;
+            AllocationCounter allocation_counter_;
+            uint64_t id_;
+            mutable std::mutex mutex_;
+            std::unordered_map<const void *, uint32_t> sites_;
+            std::vector<Site> site_info_;
+            std::unordered_map<const void *, std::string> span_names_;
+            std::vector<std::unique_ptr<ThreadState>> threads_;
+            // Sampling mode: one record of max_sample_depth+1 entries per
+            // sample, its depth followed by the site ids from the root.
+            std::vector<uint32_t> samples_;
+            size_t sample_capacity_;
+            std::atomic<size_t> next_sample_;
+            std::atomic<uint64_t> dropped_samples_;
+            bool sampling_;
+
+            ThreadState& thread_state();
+            uint32_t site(ThreadState& state, const void * key, const std::function<Site()>& make_site);
+            void enter(ThreadState& state, uint32_t site);
+            void record_sample();
+            static void on_signal(int);
+        public:
+            // In Sampling mode the timer fires every interval of CPU time, and
+            // at most sample_capacity samples are kept. Only one profiler can
+            // be sampling at a time.
+            Profiler(Mode mode=Mode::Counters, AllocationCounter allocation_counter=nullptr, std::chrono::microseconds interval=std::chrono::microseconds(1000), size_t sample_capacity=1 << 15);
+            ~Profiler();
+            Profiler(const Profiler&) = delete;
+            Profiler& operator=(const Profiler&) = delete;
+
+            Mode mode() const {
+                return mode_;
+            }
+
+            // Names the tuples of form after where they were read from, as
+            // name:line:column, instead of after their printed form.
+            void add_source(const std::string& name, const std::string& source, const ast::ExpressionRef& form, const Span& span);
+
+            // Stops the sampling timer, further samples are discarded.
+            void stop();
+
+            // Counters summed over all threads, by self time, descending. Only
+            // consistent while no evaluation is running.
+            std::vector<Entry> entries() const;
+            void write_report(std::ostream& os, size_t limit=20) const;
+            // One line per distinct stack, "root;...;leaf count".
+            void write_folded(std::ostream& os) const;
+            size_t samples() const;
+            uint64_t dropped_samples() const {
+                return dropped_samples_;
+            }
+
+            // Used by the evaluator through Scope. Return false if nothing was
+            // entered, in which case exit must not be called.
+            bool enter_span(const ast::Tuple& tuple);
+            bool enter_function(const void * key, const std::function<std::string()>& name);
+            void exit();
+        };
+
+        // Enters a span or function for as long as it lives, if profiler isn't
+        // null. The name of a function is only computed the first time it is
+        // seen.
+        class Scope {
+            Profiler * profiler_;
+        public:
+            Scope(Profiler * profiler, const ast::Tuple& tuple) : profiler_(profiler != nullptr and profiler->enter_span(tuple) ? profiler : nullptr) {}
+            template <typename F>
+            Scope(Profiler * profiler, const void * key, F name) : profiler_(profiler != nullptr and profiler->enter_function(key, name) ? profiler : nullptr) {}
+            ~Scope() {
+                if(profiler_ != nullptr) {
+                    profiler_->exit();
+                }
+            }
+            Scope(const Scope&) = delete;
+            Scope& operator=(const Scope&) = delete;
+        };
+    }
+}
+
+#endif /* defined(__rdvlisp__profile__) */
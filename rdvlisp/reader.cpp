@@ -7,10 +7,15 @@
 //
 
 #include "reader.h"
+#include "numeric.h"
+#include "memory.h"
+#include <cmath>
 #include <regex>
 #include <map>
 #include <sstream>
 #include <iomanip>
+#include <limits>
+#include <type_traits>
 
 class Token {
 public:
@@ -20,11 +25,18 @@ public:
     
     size_t start;
     size_t end;
-    std::string value;
+    rdvlisp::memory::String<rdvlisp::memory::Subsystem::Reader> value;
     Token() : type(Type::error) {}
-    Token(Type type, const std::string& value, size_t start, size_t end) : type(type), value(value), start(start), end(end) {}
+    Token(Type type, const decltype(value)& value, size_t start, size_t end) : type(type), value(value), start(start), end(end) {}
+    std::string str() const {
+        return std::string(value.data(), value.size());
+    }
 };
 
+static decltype(Token::value) text(const std::string& s, size_t start, size_t end) {
+    return decltype(Token::value)(s.data() + start, end - start);
+}
+
 static std::map<Token::Type, std::string> token_type_to_string({
     {Token::Type::tuple_start, "tuple_start"},
     {Token::Type::tuple_end, "tuple_end"},
@@ -63,18 +75,24 @@ size_t consume_optionally_signed_decimal_integer(const std::string& s, size_t st
     }
 }
 
+Token get_token_radix_integer(const std::string& s, size_t start, size_t prefix_start) {
+    bool is_hexadecimal = s[prefix_start+1] == 'x';
+    auto current = prefix_start+2;
+    while(current < s.size() and (is_hexadecimal ? isxdigit(s[current]) : (s[current] == '0' or s[current] == '1'))) { ++current; }
+    if(current == prefix_start+2) {
+        return Token(Token::Type::error, is_hexadecimal ? "could not parse hexadecimal digits" : "could not parse binary digits", start, current);
+    }
+    return Token(Token::Type::integer, text(s, start, current), start, current);
+}
+
 Token get_token_numeric(const std::string& s, size_t start) {
     auto current = start;
     
-    if(s.size()-current >= 2) {
-        if(s[current] == '0') {
-            if(s[current+1] == 'x') {
-                return Token(Token::Type::error, "hexadecimal integers are not yet implemented", start, current+2);
-            } else if(s[current+1] == 'b') {
-                return Token(Token::Type::error, "binary integers are not yet implemented", start, current+2);
-            }
-        }
+    if(current < s.size() and (s[current] == '+' or s[current] == '-')) { ++current; }
+    if(s.size()-current > 2 and s[current] == '0' and (s[current+1] == 'x' or s[current+1] == 'b')) {
+        return get_token_radix_integer(s, start, current);
     }
+    current = start;
     
     current = consume_optionally_signed_decimal_integer(s, current);
     if(current == start) {
@@ -101,12 +119,12 @@ Token get_token_numeric(const std::string& s, size_t start) {
                 is_float = true;
             }
             if(is_float) {
-                return Token(Token::Type::floating_point, s.substr(start, current-start), start, current);
+                return Token(Token::Type::floating_point, text(s, start, current), start, current);
             } else {
-                return Token(Token::Type::integer, s.substr(start, current-start), start, current);
+                return Token(Token::Type::integer, text(s, start, current), start, current);
             }
         } else {
-            return Token(Token::Type::integer, s.substr(start, current-start), start, current);
+            return Token(Token::Type::integer, text(s, start, current), start, current);
         }
     }
 }
@@ -141,7 +159,7 @@ Token get_token_string(const std::string& s, size_t start) {
         }
         if(current < s.size() and s[current] == '"') {
             ++current;
-            return Token(Token::Type::string, s.substr(start, current-start), start, current);
+            return Token(Token::Type::string, text(s, start, current), start, current);
         } else {
             return Token(Token::Type::error, "unexpected end of file while scanning for end of string", start, current);
         }
@@ -156,8 +174,17 @@ Token get_token_identifier(const std::string& s, size_t start) {
     auto current = start;
     if(current < s.size() and (isalpha(s[current]) or identifier_punctuation_chars.find(s[current]) != std::string::npos)) {
         ++current;
-        while(current < s.size() and (isalnum(s[current]) or identifier_punctuation_chars.find(s[current]) != std::string::npos)) { ++current; }
-        return Token(Token::Type::identifier, s.substr(start, current-start), start, current);
+        while(current < s.size()) {
+            if(isalnum(s[current]) or identifier_punctuation_chars.find(s[current]) != std::string::npos) {
+                ++current;
+            } else if(s[current] == '.' and current+1 < s.size() and (isalpha(s[current+1]) or identifier_punctuation_chars.find(s[current+1]) != std::string::npos)) {
+                // a.b.c names c in namespace b in namespace a
+                ++current;
+            } else {
+                break;
+            }
+        }
+        return Token(Token::Type::identifier, text(s, start, current), start, current);
     } else {
         return Token(Token::Type::error, "could not parse identifier", start, current+1);
     }
@@ -170,7 +197,7 @@ Token get_token(const std::string& s, size_t start) {
     }
     
     if(current > start) {
-        return Token(Token::Type::whitespace, s.substr(start, current-start), start, current);
+        return Token(Token::Type::whitespace, text(s, start, current), start, current);
     }
     
     if(current >= s.size()) {
@@ -216,19 +243,19 @@ Token get_token(const std::string& s, size_t start) {
         case ':':
             token = get_token_identifier(s, current+1);
             if(token.type != Token::Type::error) {
-                return Token(Token::Type::keyword, s.substr(current, token.end-current), current, token.end);
+                return Token(Token::Type::keyword, text(s, current, token.end), current, token.end);
             } else {
                 return Token(Token::Type::error, "could not parse keyword", current, current+1);
             }
         default:
-            if(isdigit(s[current]) or isxdigit(s[current])) {
+            if(isdigit(s[current])) {
                 return get_token_numeric(s, current);
             } else if(isalpha(s[current]) or identifier_punctuation_chars.find(s[current]) != std::string::npos) {
                 return get_token_identifier(s, current);
             } else {
                 std::stringstream ss;
                 ss << "unexpected character '" << s[current] << "'";
-                return Token(Token::Type::error, ss.str(), current, current+1);
+                return Token(Token::Type::error, ss.str().c_str(), current, current+1);
             }
     }
 }
@@ -262,6 +289,10 @@ std::ostream& rdvlisp::ast::operator<<(std::ostream& os, Tuple tuple) {
     return os << ")";
 }
 
+std::ostream& rdvlisp::ast::operator<<(std::ostream& os, Constant constant) {
+    return os << *constant.original;
+}
+
 std::ostream& rdvlisp::ast::operator<<(std::ostream& os, Identifier identifier) {
     if(identifier.name.size() > 0) {
         os << identifier.name[0];
@@ -276,46 +307,104 @@ std::ostream& rdvlisp::ast::operator<<(std::ostream& os, Keyword keyword) {
     return os << ":" << keyword.name.substr(1, keyword.name.size()-1);
 }
 
+class integer_print_visitor : public boost::static_visitor<std::ostream&> {
+    std::ostream& os;
+public:
+    integer_print_visitor(std::ostream& os) : os(os) {}
+    template <typename T>
+    std::ostream& operator()(T t) const {
+        // Widen first so that 8 bit values don't print as characters.
+        return os << (std::is_signed<T>::value ? std::to_string(static_cast<int64_t>(t)) : std::to_string(static_cast<uint64_t>(t)));
+    }
+};
+
+class floating_point_print_visitor : public boost::static_visitor<std::ostream&> {
+    std::ostream& os;
+public:
+    floating_point_print_visitor(std::ostream& os) : os(os) {}
+    template <typename T>
+    std::ostream& operator()(T t) const {
+        // There are no literals for these, but expressions evaluating to them.
+        if(std::isnan(t)) {
+            return os << "(/ 0.0 0.0)";
+        } else if(std::isinf(t)) {
+            return os << (t > 0 ? "(/ 1.0 0.0)" : "(/ -1.0 0.0)");
+        }
+        // The shortest representation that reads back as the same value, and
+        // still as a floating point literal.
+        std::stringstream ss;
+        for(int precision = 1; precision <= std::numeric_limits<T>::max_digits10; ++precision) {
+            ss.str("");
+            ss << std::setprecision(precision) << t;
+            if(static_cast<T>(std::strtod(ss.str().c_str(), nullptr)) == t) {
+                break;
+            }
+        }
+        auto result = ss.str();
+        if(result.find_first_of(".e") == std::string::npos) {
+            result += ".0";
+        }
+        return os << result;
+    }
+};
+
 std::ostream& rdvlisp::ast::operator<<(std::ostream& os, FloatingPoint floating_point) {
-    return os << floating_point.value;
+    return boost::apply_visitor(floating_point_print_visitor(os), floating_point.value);
 }
 
 std::ostream& rdvlisp::ast::operator<<(std::ostream& os, Integer integer) {
-    return os << integer.value;
+    return boost::apply_visitor(integer_print_visitor(os), integer.value);
+}
+
+void print_escaped(std::ostream& os, char c) {
+    switch(c) {
+        case '\n':
+            os << "\\n";
+            break;
+        case '\t':
+            os << "\\t";
+            break;
+        case '\r':
+            os << "\\r";
+            break;
+        case '\v':
+            os << "\\v";
+            break;
+        case '\b':
+            os << "\\b";
+            break;
+        case '\a':
+            os << "\\a";
+            break;
+        case '\f':
+            os << "\\f";
+            break;
+        case '"':
+            os << "\\\"";
+            break;
+        case '\\':
+            os << "\\\\";
+            break;
+        default:
+            os << c;
+    }
 }
 
 std::ostream& rdvlisp::ast::operator<<(std::ostream& os, String string) {
     os << "\"";
-    for(char c : string.contents) {
-        switch(c) {
-            case '\n':
-                os << "\\n";
-                break;
-            case '\t':
-                os << "\\t";
-                break;
-            case '\r':
-                os << "\\r";
-                break;
-            case '\v':
-                os << "\\v";
-                break;
-            case '\b':
-                os << "\\b";
-                break;
-            case '\a':
-                os << "\\a";
-                break;
-            default:
-                os << c;
+    string.contents.for_each_piece([&os](const char * data, size_t size) {
+        for(const char * it = data; it != data + size; ++it) {
+            print_escaped(os, *it);
         }
-    }
+    });
     return os << "\"";
 }
 
-Result<Tuple> read_tuple(const std::string& s, size_t start) {
+Result<ExpressionRef> read_expression(const std::string& s, size_t start, Span * span, const SourceRef * buffer);
+
+Result<Tuple> read_tuple(const std::string& s, size_t start, Span * span, const SourceRef * buffer) {
     auto current = start;
-    std::vector<ExpressionRef> elements;
+    Tuple::Elements elements;
     Token token = get_token(s, start);
     if(token.type != Token::Type::tuple_start) {
         return Result<Tuple>("tuple not started with '('", start, token.end);
@@ -326,7 +415,7 @@ Result<Tuple> read_tuple(const std::string& s, size_t start) {
     while(true) {
         token = get_token(s, current);
         if(token.type == Token::Type::error) {
-            return Result<Tuple>(token.value, start, token.end);
+            return Result<Tuple>(token.str(), start, token.end);
         }
         if(token.type == Token::Type::whitespace) {
             sepby_whitespace = true;
@@ -334,14 +423,20 @@ Result<Tuple> read_tuple(const std::string& s, size_t start) {
             continue;
         }
         if(token.type == Token::Type::tuple_end) {
-            return Result<Tuple>(Tuple(elements), start, token.end);
+            return Result<Tuple>(Tuple(std::move(elements)), start, token.end);
         }
         if(!is_first and !sepby_whitespace) {
             return Result<Tuple>("tuple elements must be separated by whitespace", start, token.end);
         }
-        auto r = read(s, current);
+        Span element_span;
+        auto r = read_expression(s, current, span != nullptr ? &element_span : nullptr, buffer);
         if(r.good()) {
             elements.push_back(r.get());
+            if(span != nullptr) {
+                element_span.start = r.start;
+                element_span.end = r.end;
+                span->elements.push_back(std::move(element_span));
+            }
             current = r.end;
         } else {
             return Result<Tuple>(r.error(), start, r.end);
@@ -351,16 +446,102 @@ Result<Tuple> read_tuple(const std::string& s, size_t start) {
     }
 }
 
+// The contents of the string literal s[begin, end[ with its escape sequences
+// replaced. The lexer has already rejected unsupported escapes. Without any,
+// it is a slice of buffer, s itself, if given.
+Rope unescape(const std::string& s, size_t begin, size_t end, const SourceRef * buffer) {
+    auto first_escape = s.find('\\', begin);
+    if(first_escape == std::string::npos or first_escape >= end) {
+        if(buffer != nullptr) {
+            return Rope(*buffer, begin, end - begin);
+        }
+        return Rope(s.data() + begin, end - begin);
+    }
+    std::string contents(s, begin, first_escape - begin);
+    contents.reserve(end - begin);
+    for(size_t i = first_escape; i < end; ++i) {
+        if(s[i] == '\\') {
+            ++i;
+            switch(s[i]) {
+                case 'n':
+                    contents.push_back('\n');
+                    break;
+                case 't':
+                    contents.push_back('\t');
+                    break;
+                case 'r':
+                    contents.push_back('\r');
+                    break;
+                case 'f':
+                    contents.push_back('\f');
+                    break;
+                case 'v':
+                    contents.push_back('\v');
+                    break;
+                case 'b':
+                    contents.push_back('\b');
+                    break;
+                case 'a':
+                    contents.push_back('\a');
+                    break;
+                default:
+                    contents.push_back(s[i]);
+            }
+        } else {
+            contents.push_back(s[i]);
+        }
+    }
+    return Rope(std::move(contents));
+}
+
+static std::vector<std::string> split_identifier(const std::string& s) {
+    std::vector<std::string> components;
+    size_t start = 0;
+    for(size_t dot = s.find('.'); dot != std::string::npos; dot = s.find('.', start)) {
+        components.push_back(s.substr(start, dot - start));
+        start = dot + 1;
+    }
+    components.push_back(s.substr(start));
+    return components;
+}
+
 template <typename T>
 Result<ExpressionRef> make_result(const Result<T>& r) {
     if(r.good()) {
-        return Result<ExpressionRef>(std::make_shared<Expression>(r.get()), r.start, r.end);
+        return Result<ExpressionRef>(memory::make_shared<memory::Subsystem::Ast, Expression>(r.get()), r.start, r.end);
     } else {
         return Result<ExpressionRef>(r.error(), r.start, r.end);
     }
 }
 
+static Result<ExpressionRef> read_spanned(const std::string& s, size_t start, Span& span, const SourceRef * buffer) {
+    span = Span();
+    auto r = read_expression(s, start, &span, buffer);
+    span.start = r.start;
+    span.end = r.end;
+    return r;
+}
+
 Result<ExpressionRef> rdvlisp::read(const std::string& s, size_t start) {
+    return read_expression(s, start, nullptr, nullptr);
+}
+
+Result<ExpressionRef> rdvlisp::read(const std::string& s, size_t start, Span& span) {
+    return read_spanned(s, start, span, nullptr);
+}
+
+Result<ExpressionRef> rdvlisp::read(const SourceRef& source, size_t start) {
+    return read_expression(*source, start, nullptr, &source);
+}
+
+Result<ExpressionRef> rdvlisp::read(const SourceRef& source, size_t start, Span& span) {
+    return read_spanned(*source, start, span, &source);
+}
+
+// Reads the expression at or after start. If span is given, the spans of the
+// elements of tuples are added to it, recursively. String literals slice
+// buffer if given.
+Result<ExpressionRef> read_expression(const std::string& s, size_t start, Span * span, const SourceRef * buffer) {
     size_t current = start;
     
     Token token;
@@ -371,55 +552,55 @@ Result<ExpressionRef> rdvlisp::read(const std::string& s, size_t start) {
             current = token.end;
             continue;
         }
-        std::stringstream ss;
-        size_t i;
         switch(token.type) {
             case Token::Type::tuple_start:
-                return make_result(read_tuple(s, current));
+                return make_result(read_tuple(s, current, span, buffer));
                 break;
             case Token::Type::string:
-                ss.str("");
-                ss.clear();
-                i = 1;
-                while(i < token.value.size()-1) {
-                    if(token.value[i] == '\\') {
-                        ++i;
-                        if(token.value[i] == 'n') {
-                            ss << '\n';
-                        } else if(token.value[i] == 't') {
-                            ss << '\t';
-                        } else if(token.value[i] == 'r') {
-                            ss << '\r';
-                        } else if(token.value[i] == 'f') {
-                            ss << '\f';
-                        } else if(token.value[i] == 'v') {
-                            ss << '\v';
-                        } else if(token.value[i] == 'b') {
-                            ss << '\b';
-                        } else if(token.value[i] == 'a') {
-                            ss << '\a';
-                        } else if(token.value[i] == '"' or token.value[i] == '\\') {
-                            ss << token.value[i];
-                        }
-                    } else {
-                        ss << token.value[i];
-                    }
-                    ++i;
-                }
-                return make_result(Result<String>(String(ss.str()), start, token.end));
+                return make_result(Result<String>(String(unescape(s, token.start+1, token.end-1, buffer)), start, token.end));
                 break;
             case Token::Type::identifier:
-                return make_result(Result<Identifier>(Identifier(token.value), start, token.end));
+                return make_result(Result<Identifier>(Identifier(split_identifier(token.str())), start, token.end));
                 break;
-            case Token::Type::integer:
-                return make_result(Result<Integer>(Integer(token.value), start, token.end));
+            case Token::Type::integer: {
+                decltype(Integer::value) value;
+                if(!numeric::parse_integer(s.data()+token.start, s.data()+token.end, value)) {
+                    return Result<ExpressionRef>("integer literal does not fit in 64 bits", start, token.end);
+                }
+                return make_result(Result<Integer>(Integer(value), start, token.end));
                 break;
-            case Token::Type::floating_point:
-                return make_result(Result<FloatingPoint>(FloatingPoint(token.value), start, token.end));
+            }
+            case Token::Type::floating_point: {
+                decltype(FloatingPoint::value) value;
+                if(!numeric::parse_floating_point(s.data()+token.start, s.data()+token.end, value)) {
+                    return Result<ExpressionRef>("floating point literal out of range", start, token.end);
+                }
+                return make_result(Result<FloatingPoint>(FloatingPoint(value), start, token.end));
                 break;
+            }
             case Token::Type::keyword:
-                return make_result(Result<Keyword>(Keyword(token.value), start, token.end));
+                return make_result(Result<Keyword>(Keyword(token.str()), start, token.end));
                 break;
+            case Token::Type::quote:
+            case Token::Type::unquote: {
+                // 'x reads as (quasiquote x) and ,x as (unquote x)
+                Span element_span;
+                auto r = read_expression(s, token.end, span != nullptr ? &element_span : nullptr, buffer);
+                if(r.fail()) {
+                    return Result<ExpressionRef>(r.error(), start, r.end);
+                }
+                auto head = memory::make_shared<memory::Subsystem::Ast, Expression>(Identifier(token.type == Token::Type::quote ? "quasiquote" : "unquote"));
+                if(span != nullptr) {
+                    Span head_span;
+                    head_span.start = token.start;
+                    head_span.end = token.end;
+                    element_span.start = r.start;
+                    element_span.end = r.end;
+                    span->elements.push_back(head_span);
+                    span->elements.push_back(std::move(element_span));
+                }
+                return make_result(Result<Tuple>(Tuple(Tuple::Elements{head, r.get()}), start, r.end));
+            }
             default:
                 return Result<ExpressionRef>("unexpected token of type " + token_type_to_string[token.type] + " encountered", start, token.end);
         }
@@ -10,9 +10,11 @@
 #define __rdvlisp__reader__
 
 #include <iostream>
+#include <memory>
 #include <vector>
 #include "types.h"
 #include "ast.h"
+#include "source_map.h"
 
 namespace rdvlisp {
     class ReadError : public std::runtime_error {
@@ -27,9 +29,18 @@ namespace rdvlisp {
             ss << "[" << ": " << what;
             return ss.str();
         }
+        template <typename T>
+        static std::string stringify(const T& what, size_t start, size_t end, const SourceMap& source_map) {
+            std::stringstream ss;
+            ss << "at " << source_map.position(start) << ", " << stringify(what, start, end).substr(3);
+            return ss.str();
+        }
     public:
         template <typename T>
         ReadError(const T& what, size_t start, size_t end) : std::runtime_error(stringify(what, start, end)) {}
+        // Also reports the line and column of start.
+        template <typename T>
+        ReadError(const T& what, size_t start, size_t end, const SourceMap& source_map) : std::runtime_error(stringify(what, start, end, source_map)) {}
     };
     
     template <typename T, typename E=std::string>
@@ -70,7 +81,27 @@ namespace rdvlisp {
         Result(E e, size_t start, size_t end) : variant(e), start(start), end(end) {}
     };
     
+    // Where an expression was read from: [start, end[ in the source, and the
+    // spans of its elements if it is a tuple.
+    class Span {
+    public:
+        size_t start, end;
+        std::vector<Span> elements;
+        Span() : start(0), end(0) {}
+    };
+    
     Result<ast::ExpressionRef> read(const std::string& source, size_t start=0);
+    Result<ast::ExpressionRef> read(const std::string& source, size_t start, Span& span);
+
+    typedef std::shared_ptr<const std::string> SourceRef;
+    // source as a buffer accounted to memory::Subsystem::Reader.
+    inline SourceRef make_source(std::string source) {
+        return memory::make_shared_string<memory::Subsystem::Reader>(std::move(source));
+    }
+    // Long string literals without escapes are slices of source instead of
+    // copies, and keep all of it alive.
+    Result<ast::ExpressionRef> read(const SourceRef& source, size_t start=0);
+    Result<ast::ExpressionRef> read(const SourceRef& source, size_t start, Span& span);
 }
 
 #endif /* defined(__rdvlisp__reader__) */
@@ -0,0 +1,281 @@
+//
+//  rope.cpp
+//  rdvlisp
+//
+//  Created by Ruben De Visscher on 18/10/26.
+//  Copyright (c) 2026 Ruben De Visscher. All rights reserved.
+//
+
+#include "rope.h"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+using namespace rdvlisp;
+
+Rope Rope::make_inline(const char * data, size_t size) {
+    Inline x;
+    if(size > 0) {
+        std::memcpy(x.data, data, size);
+    }
+    x.size = static_cast<uint8_t>(size);
+    return Rope(x);
+}
+
+Rope::Rope(const char * data, size_t size) {
+    if(size <= inline_capacity) {
+        *this = make_inline(data, size);
+    } else {
+        variant_ = Slice{std::make_shared<const std::string>(data, size), 0, size};
+    }
+}
+
+Rope::Rope(const char * s) : Rope(s, std::strlen(s)) {}
+
+Rope::Rope(const std::string& s) : Rope(s.data(), s.size()) {}
+
+Rope::Rope(std::string&& s) {
+    if(s.size() <= inline_capacity) {
+        *this = make_inline(s.data(), s.size());
+    } else {
+        size_t size = s.size();
+        variant_ = Slice{std::make_shared<const std::string>(std::move(s)), 0, size};
+    }
+}
+
+Rope::Rope(const std::shared_ptr<const std::string>& buffer, size_t offset, size_t length) {
+    if(offset > buffer->size() or length > buffer->size() - offset) {
+        throw std::out_of_range("rope range outside of buffer");
+    }
+    if(length <= inline_capacity) {
+        *this = make_inline(buffer->data() + offset, length);
+    } else {
+        variant_ = Slice{buffer, offset, length};
+    }
+}
+
+size_t Rope::size() const {
+    if(auto x = boost::get<Inline>(&variant_)) {
+        return x->size;
+    } else if(auto x = boost::get<Slice>(&variant_)) {
+        return x->length;
+    } else {
+        return boost::get<Concat>(variant_).node->length;
+    }
+}
+
+size_t Rope::depth() const {
+    if(auto x = boost::get<Concat>(&variant_)) {
+        return x->node->depth;
+    } else {
+        return 0;
+    }
+}
+
+char Rope::operator[](size_t index) const {
+    const Rope * current = this;
+    while(auto x = boost::get<Concat>(&current->variant_)) {
+        auto& node = *x->node;
+        if(index < node.left.size()) {
+            current = &node.left;
+        } else {
+            index -= node.left.size();
+            current = &node.right;
+        }
+    }
+    if(index >= current->size()) {
+        throw std::out_of_range("rope index out of range");
+    }
+    if(auto x = boost::get<Inline>(&current->variant_)) {
+        return x->data[index];
+    } else {
+        auto& slice = boost::get<Slice>(current->variant_);
+        return (*slice.buffer)[slice.offset + index];
+    }
+}
+
+Rope Rope::slice(size_t begin, size_t end) const {
+    if(begin > end or end > size()) {
+        throw std::out_of_range("rope slice out of range");
+    }
+    if(begin == 0 and end == size()) {
+        return *this;
+    }
+    if(auto x = boost::get<Inline>(&variant_)) {
+        return make_inline(x->data + begin, end - begin);
+    } else if(auto x = boost::get<Slice>(&variant_)) {
+        return Rope(x->buffer, x->offset + begin, end - begin);
+    } else {
+        auto& node = *boost::get<Concat>(variant_).node;
+        size_t left_size = node.left.size();
+        if(end <= left_size) {
+            return node.left.slice(begin, end);
+        } else if(begin >= left_size) {
+            return node.right.slice(begin - left_size, end - left_size);
+        } else {
+            return node.left.slice(begin, left_size) + node.right.slice(0, end - left_size);
+        }
+    }
+}
+
+Rope Rope::make_node(const Rope& left, const Rope& right) {
+    return Rope(Concat{std::make_shared<const Node>(left, right)});
+}
+
+// A node of left and right, whose depths differ by at most two, with one or
+// two rotations if they differ by two.
+Rope Rope::rotate(const Rope& left, const Rope& right) {
+    if(left.depth() > right.depth() + 1) {
+        auto& node = *boost::get<Concat>(left.variant_).node;
+        if(node.left.depth() >= node.right.depth()) {
+            return make_node(node.left, make_node(node.right, right));
+        }
+        auto& inner = *boost::get<Concat>(node.right.variant_).node;
+        return make_node(make_node(node.left, inner.left), make_node(inner.right, right));
+    } else if(right.depth() > left.depth() + 1) {
+        auto& node = *boost::get<Concat>(right.variant_).node;
+        if(node.right.depth() >= node.left.depth()) {
+            return make_node(make_node(left, node.left), node.right);
+        }
+        auto& inner = *boost::get<Concat>(node.left.variant_).node;
+        return make_node(make_node(left, inner.left), make_node(inner.right, node.right));
+    }
+    return make_node(left, right);
+}
+
+// Concatenates balanced trees, descending the deeper one to where the other
+// fits, so only the depth difference many nodes are made.
+Rope Rope::join(const Rope& left, const Rope& right) {
+    if(left.depth() > right.depth() + 1) {
+        auto& node = *boost::get<Concat>(left.variant_).node;
+        return rotate(node.left, join(node.right, right));
+    } else if(right.depth() > left.depth() + 1) {
+        auto& node = *boost::get<Concat>(right.variant_).node;
+        return rotate(join(left, node.left), node.right);
+    }
+    return make_node(left, right);
+}
+
+Rope Rope::operator+(const Rope& other) const {
+    if(other.empty()) {
+        return *this;
+    } else if(empty()) {
+        return other;
+    }
+    size_t total = size() + other.size();
+    if(total <= inline_capacity) {
+        Inline x;
+        size_t offset = 0;
+        auto copy = [&x, &offset](const char * data, size_t size) {
+            std::memcpy(x.data + offset, data, size);
+            offset += size;
+        };
+        for_each_piece(copy);
+        other.for_each_piece(copy);
+        x.size = static_cast<uint8_t>(total);
+        return Rope(x);
+    }
+    // Adjacent ranges of the same buffer, e.g. two slices of one string
+    // being joined back together, stay a single slice.
+    auto a = boost::get<Slice>(&variant_);
+    auto b = boost::get<Slice>(&other.variant_);
+    if(a != nullptr and b != nullptr and a->buffer == b->buffer and a->offset + a->length == b->offset) {
+        return Rope(Slice{a->buffer, a->offset, total});
+    }
+    // Appending a short piece to a tree that ends in a short leaf merges them,
+    // so building a string in small increments doesn't create a leaf for each.
+    if(auto x = boost::get<Concat>(&variant_)) {
+        auto& node = *x->node;
+        if(boost::get<Inline>(&node.right.variant_) != nullptr and node.right.size() + other.size() <= inline_capacity) {
+            return node.left + (node.right + other);
+        }
+    }
+    return join(*this, other);
+}
+
+void Rope::append_to(std::string& out) const {
+    out.reserve(out.size() + size());
+    for_each_piece([&out](const char * data, size_t size) {
+        out.append(data, size);
+    });
+}
+
+std::string Rope::str() const {
+    if(auto x = boost::get<Slice>(&variant_)) {
+        if(x->offset == 0 and x->length == x->buffer->size()) {
+            return *x->buffer;
+        }
+    }
+    std::string result;
+    append_to(result);
+    return result;
+}
+
+// The pieces of a rope from left to right, walking the tree with a stack.
+class Rope::Cursor {
+    std::vector<const Rope *> stack_;
+public:
+    const char * data;
+    size_t size;
+    Cursor(const Rope& rope) : data(nullptr), size(0) {
+        stack_.push_back(&rope);
+        next();
+    }
+    // Moves to the next non-empty piece, leaves size 0 at the end.
+    void next() {
+        size = 0;
+        while(size == 0 and !stack_.empty()) {
+            const Rope * rope = stack_.back();
+            stack_.pop_back();
+            if(auto x = boost::get<Inline>(&rope->variant_)) {
+                data = x->data;
+                size = x->size;
+            } else if(auto x = boost::get<Slice>(&rope->variant_)) {
+                data = x->buffer->data() + x->offset;
+                size = x->length;
+            } else {
+                auto& node = *boost::get<Concat>(rope->variant_).node;
+                stack_.push_back(&node.right);
+                stack_.push_back(&node.left);
+            }
+        }
+    }
+    void skip(size_t n) {
+        data += n;
+        size -= n;
+        if(size == 0) {
+            next();
+        }
+    }
+};
+
+bool Rope::operator==(const Rope& other) const {
+    if(size() != other.size()) {
+        return false;
+    }
+    if(variant_.which() == other.variant_.which()) {
+        if(auto x = boost::get<Concat>(&variant_)) {
+            if(x->node == boost::get<Concat>(other.variant_).node) {
+                return true;
+            }
+        }
+    }
+    Cursor a(*this);
+    Cursor b(other);
+    while(a.size > 0) {
+        size_t n = std::min(a.size, b.size);
+        if(std::memcmp(a.data, b.data, n) != 0) {
+            return false;
+        }
+        a.skip(n);
+        b.skip(n);
+    }
+    return true;
+}
+
+std::ostream& rdvlisp::operator<<(std::ostream& os, const Rope& rope) {
+    rope.for_each_piece([&os](const char * data, size_t size) {
+        os.write(data, size);
+    });
+    return os;
+}
@@ -0,0 +1,112 @@
+//
+//  rope.h
+//  rdvlisp
+//
+//  Created by Ruben De Visscher on 18/10/26.
+//  Copyright (c) 2026 Ruben De Visscher. All rights reserved.
+//
+
+#ifndef __rdvlisp__rope__
+#define __rdvlisp__rope__
+
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include <boost/variant.hpp>
+
+namespace rdvlisp {
+    // An immutable string. Short strings are stored inline, longer ones as a
+    // range of a shared buffer so slicing never copies, and concatenation
+    // builds a tree of pieces instead of copying both sides. The depths of
+    // the two sides of a tree differ by at most one, like in an AVL tree, so
+    // appending is O(log n) however the rope was built.
+    class Rope {
+    public:
+        static const size_t inline_capacity = 31;
+    private:
+        class Inline {
+        public:
+            char data[inline_capacity];
+            uint8_t size;
+        };
+        class Slice {
+        public:
+            std::shared_ptr<const std::string> buffer;
+            size_t offset;
+            size_t length;
+        };
+        class Node;
+        class Concat {
+        public:
+            std::shared_ptr<const Node> node;
+        };
+        boost::variant<Inline, Slice, Concat> variant_;
+        class Cursor;
+
+        Rope(const Inline& x) : variant_(x) {}
+        Rope(const Slice& x) : variant_(x) {}
+        Rope(const Concat& x) : variant_(x) {}
+        static Rope make_inline(const char * data, size_t size);
+        static Rope make_node(const Rope& left, const Rope& right);
+        static Rope rotate(const Rope& left, const Rope& right);
+        static Rope join(const Rope& left, const Rope& right);
+    public:
+        Rope() : Rope(nullptr, 0) {}
+        Rope(const char * data, size_t size);
+        Rope(const char * s);
+        Rope(const std::string& s);
+        Rope(std::string&& s);
+        // The range [offset, offset+length[ of buffer, without copying.
+        Rope(const std::shared_ptr<const std::string>& buffer, size_t offset, size_t length);
+
+        size_t size() const;
+        bool empty() const {
+            return size() == 0;
+        }
+        size_t depth() const;
+        char operator[](size_t index) const;
+
+        // The characters [begin, end[, sharing storage with this rope.
+        Rope slice(size_t begin, size_t end) const;
+        Rope operator+(const Rope& other) const;
+
+        std::string str() const;
+        void append_to(std::string& out) const;
+        // Calls f(data, size) for each contiguous piece, in order.
+        template <typename F>
+        void for_each_piece(F f) const;
+
+        bool operator==(const Rope& other) const;
+        bool operator!=(const Rope& other) const {
+            return !(*this == other);
+        }
+    };
+
+    class Rope::Node {
+    public:
+        Rope left;
+        Rope right;
+        size_t length;
+        size_t depth;
+        Node(const Rope& left, const Rope& right) : left(left), right(right), length(left.size() + right.size()), depth(1 + std::max(left.depth(), right.depth())) {}
+    };
+
+    template <typename F>
+    void Rope::for_each_piece(F f) const {
+        if(auto x = boost::get<Inline>(&variant_)) {
+            f(x->data, static_cast<size_t>(x->size));
+        } else if(auto x = boost::get<Slice>(&variant_)) {
+            f(x->buffer->data() + x->offset, x->length);
+        } else {
+            auto& node = *boost::get<Concat>(variant_).node;
+            node.left.for_each_piece(f);
+            node.right.for_each_piece(f);
+        }
+    }
+
+    std::ostream& operator<<(std::ostream& os, const Rope& rope);
+}
+
+#endif /* defined(__rdvlisp__rope__) */
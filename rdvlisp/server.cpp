@@ -0,0 +1,517 @@
+//
+//  server.cpp
+//  rdvlisp
+//
+//  Created by Ruben De Visscher on 18/10/26.
+//  Copyright (c) 2026 Ruben De Visscher. All rights reserved.
+//
+
+#include "server.h"
+#include "macros.h"
+#include "reader.h"
+#include <cctype>
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace rdvlisp::server;
+using namespace rdvlisp::runtime;
+using namespace rdvlisp;
+
+#ifdef MSG_NOSIGNAL
+static const int send_flags = MSG_NOSIGNAL;
+#else
+static const int send_flags = 0;
+#endif
+
+static std::string system_error(const std::string& what) {
+    return what + ": " + std::strerror(errno);
+}
+
+static void set_flags(int fd) {
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+#ifdef SO_NOSIGPIPE
+    int on = 1;
+    setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+}
+
+static sockaddr_un socket_address(const std::string& path) {
+    sockaddr_un address;
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if(path.size() >= sizeof(address.sun_path)) {
+        throw ServerError("socket path too long: " + path);
+    }
+    std::memcpy(address.sun_path, path.data(), path.size());
+    return address;
+}
+
+static void put_length(std::string& out, uint32_t length) {
+    for(int shift = 24; shift >= 0; shift -= 8) {
+        out += static_cast<char>((length >> shift) & 0xff);
+    }
+}
+
+static uint32_t get_length(const char * data) {
+    uint32_t length = 0;
+    for(int i = 0; i < 4; ++i) {
+        length = (length << 8) | static_cast<uint8_t>(data[i]);
+    }
+    return length;
+}
+
+static std::string response_frame(Response response, const std::string& text) {
+    std::string frame;
+    frame.reserve(5 + text.size());
+    put_length(frame, static_cast<uint32_t>(text.size() + 1));
+    frame += static_cast<char>(response);
+    frame += text;
+    return frame;
+}
+
+Server::Server(Runtime& runtime, const Options& options) : runtime_(runtime), options_(options), listen_fd_(-1), stopping_(false), connection_count_(0), batch_count_(0), form_count_(0), error_count_(0) {
+    auto address = socket_address(options.socket_path);
+    if(pipe(wake_fds_) != 0) {
+        throw ServerError(system_error("pipe"));
+    }
+    set_flags(wake_fds_[0]);
+    set_flags(wake_fds_[1]);
+    listen_fd_ = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(listen_fd_ < 0) {
+        close(wake_fds_[0]);
+        close(wake_fds_[1]);
+        throw ServerError(system_error("socket"));
+    }
+    set_flags(listen_fd_);
+    bool bound = bind(listen_fd_, reinterpret_cast<sockaddr *>(&address), sizeof(address)) == 0;
+    if(!bound and errno == EADDRINUSE) {
+        // Left behind by a server that is gone if nothing accepts on it.
+        int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+        bool live = probe >= 0 and connect(probe, reinterpret_cast<sockaddr *>(&address), sizeof(address)) == 0;
+        if(probe >= 0) {
+            close(probe);
+        }
+        if(!live) {
+            unlink(options.socket_path.c_str());
+            bound = bind(listen_fd_, reinterpret_cast<sockaddr *>(&address), sizeof(address)) == 0;
+        }
+    }
+    if(!bound or listen(listen_fd_, SOMAXCONN) != 0) {
+        std::string message = system_error("cannot listen on " + options.socket_path);
+        close(listen_fd_);
+        close(wake_fds_[0]);
+        close(wake_fds_[1]);
+        throw ServerError(message);
+    }
+}
+
+Server::~Server() {
+    for(auto& connection : connections_) {
+        close(connection->fd);
+    }
+    close(listen_fd_);
+    unlink(options_.socket_path.c_str());
+    close(wake_fds_[0]);
+    close(wake_fds_[1]);
+}
+
+void Server::stop() {
+    stopping_.store(true);
+    wake();
+}
+
+void Server::wake() {
+    char c = 0;
+    // A full pipe already wakes the loop.
+    ssize_t written = write(wake_fds_[1], &c, 1);
+    (void)written;
+}
+
+Server::Statistics Server::statistics() const {
+    Statistics statistics;
+    statistics.connections = connection_count_.load();
+    statistics.batches = batch_count_.load();
+    statistics.forms = form_count_.load();
+    statistics.errors = error_count_.load();
+    return statistics;
+}
+
+void Server::post(std::function<void()> task) {
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex_);
+        queue_.push_back(std::move(task));
+    }
+    queue_ready_.notify_one();
+}
+
+void Server::work() {
+    while(true) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(queue_mutex_);
+            queue_ready_.wait(lock, [this] {
+                return stopping_.load() or !queue_.empty();
+            });
+            if(stopping_.load()) {
+                return;
+            }
+            task = std::move(queue_.front());
+            queue_.pop_front();
+        }
+        task();
+    }
+}
+
+void Server::run() {
+    Runtime::Concurrent concurrent(runtime_);
+    // Stops and joins the workers however the loop ends, before the runtime
+    // leaves concurrent mode; a joinable thread left behind would terminate.
+    class Workers {
+        Server& server_;
+    public:
+        Workers(Server& server) : server_(server) {}
+        ~Workers() {
+            {
+                // Under the mutex, so that a worker can't miss the
+                // notification between checking stopping_ and waiting.
+                std::lock_guard<std::mutex> lock(server_.queue_mutex_);
+                server_.stopping_.store(true);
+            }
+            server_.queue_ready_.notify_all();
+            for(auto& worker : server_.workers_) {
+                worker.join();
+            }
+            server_.workers_.clear();
+            server_.queue_.clear();
+        }
+    } joined(*this);
+    size_t workers = options_.workers == 0 ? std::max<size_t>(std::thread::hardware_concurrency(), 1) : options_.workers;
+    for(size_t i = 0; i < workers; ++i) {
+        workers_.push_back(std::thread(&Server::work, this));
+    }
+    std::vector<pollfd> descriptors;
+    while(!stopping_.load()) {
+        descriptors.clear();
+        descriptors.push_back(pollfd{wake_fds_[0], POLLIN, 0});
+        descriptors.push_back(pollfd{listen_fd_, POLLIN, 0});
+        for(auto& connection : connections_) {
+            std::lock_guard<std::mutex> lock(connection->mutex);
+            short events = connection->input_closed or saturated(*connection) ? 0 : POLLIN;
+            if(!connection->output.empty()) {
+                events |= POLLOUT;
+            }
+            descriptors.push_back(pollfd{connection->fd, events, 0});
+        }
+        if(poll(descriptors.data(), descriptors.size(), -1) < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+            throw ServerError(system_error("poll"));
+        }
+        if(descriptors[0].revents != 0) {
+            char buffer[256];
+            while(::read(wake_fds_[0], buffer, sizeof(buffer)) > 0) {}
+        }
+        // Connections are only added after the loop below, so that they
+        // line up with descriptors.
+        std::vector<ConnectionRef> open;
+        for(size_t i = 0; i < connections_.size(); ++i) {
+            auto& connection = connections_[i];
+            short revents = descriptors[i + 2].revents;
+            bool alive = true;
+            if(connection->input_closed and (revents & (POLLHUP | POLLERR))) {
+                // Gone entirely, not just done sending.
+                alive = false;
+            } else if(revents & (POLLIN | POLLHUP | POLLERR)) {
+                alive = receive(connection);
+            }
+            // Results may have become ready while polling, so always try,
+            // and batches held back may be posted now.
+            alive = alive and transmit(*connection) and dispatch(connection);
+            if(alive and connection->input_closed) {
+                std::lock_guard<std::mutex> lock(connection->mutex);
+                alive = !connection->batches.empty() or !connection->output.empty();
+            }
+            if(alive) {
+                open.push_back(connection);
+            } else {
+                close(connection->fd);
+            }
+        }
+        connections_.swap(open);
+        if(descriptors[1].revents != 0) {
+            accept_connections();
+        }
+    }
+}
+
+void Server::accept_connections() {
+    while(true) {
+        int fd = accept(listen_fd_, nullptr, nullptr);
+        if(fd < 0) {
+            if(errno == EINTR or errno == ECONNABORTED) {
+                continue;
+            }
+            return;
+        }
+        set_flags(fd);
+        connections_.push_back(std::make_shared<Connection>(fd));
+        connection_count_.fetch_add(1);
+    }
+}
+
+// Under connection.mutex.
+bool Server::saturated(const Connection& connection) const {
+    return connection.batches.size() >= options_.max_pending or connection.output.size() >= options_.max_output;
+}
+
+// Reads what is available, up to a batch beyond the complete ones, and posts
+// those. Returns false if the connection must be closed.
+bool Server::receive(const ConnectionRef& connection) {
+    char buffer[65536];
+    while(connection->input.size() < options_.max_batch + 4) {
+        ssize_t n = ::read(connection->fd, buffer, sizeof(buffer));
+        if(n > 0) {
+            connection->input.append(buffer, n);
+        } else if(n == 0) {
+            connection->input_closed = true;
+            break;
+        } else if(errno == EINTR) {
+            continue;
+        } else if(errno == EAGAIN or errno == EWOULDBLOCK) {
+            break;
+        } else {
+            return false;
+        }
+    }
+    return dispatch(connection);
+}
+
+// Posts the complete batches in the input of connection until it is
+// saturated. Returns false if the connection must be closed.
+bool Server::dispatch(const ConnectionRef& connection) {
+    auto& input = connection->input;
+    size_t position = 0;
+    while(input.size() - position >= 4) {
+        uint32_t length = get_length(input.data() + position);
+        if(length > options_.max_batch) {
+            return false;
+        }
+        if(input.size() - position - 4 < length) {
+            break;
+        }
+        auto batch = std::make_shared<Batch>();
+        {
+            std::lock_guard<std::mutex> lock(connection->mutex);
+            if(saturated(*connection)) {
+                break;
+            }
+            connection->batches.push_back(batch);
+        }
+        auto source = make_source(std::string(input, position + 4, length));
+        position += 4 + length;
+        batch_count_.fetch_add(1);
+        post([this, connection, batch, source] {
+            read_batch(connection, batch, source);
+        });
+    }
+    input.erase(0, position);
+    return true;
+}
+
+// Sends what it can of the output without blocking. Returns false if the
+// connection must be closed.
+bool Server::transmit(Connection& connection) {
+    std::lock_guard<std::mutex> lock(connection.mutex);
+    size_t position = 0;
+    while(position < connection.output.size()) {
+        ssize_t n = send(connection.fd, connection.output.data() + position, connection.output.size() - position, send_flags);
+        if(n >= 0) {
+            position += n;
+        } else if(errno == EINTR) {
+            continue;
+        } else if(errno == EAGAIN or errno == EWOULDBLOCK) {
+            break;
+        } else {
+            return false;
+        }
+    }
+    connection.output.erase(0, position);
+    return true;
+}
+
+// Reads and expands the forms of a batch and posts their evaluation. Forms
+// before a read or expansion error are still evaluated, the error is the last
+// result.
+void Server::read_batch(const ConnectionRef& connection, const BatchRef& batch, const SourceRef& buffer) {
+    auto& source = *buffer;
+    std::vector<ast::ExpressionRef> forms;
+    std::string error;
+    macros::Expander expander(&expansions_);
+    size_t current = 0;
+    while(true) {
+        while(current < source.size() and std::isspace(static_cast<unsigned char>(source[current]))) {
+            ++current;
+        }
+        if(current >= source.size()) {
+            break;
+        }
+        auto r = read(buffer, current);
+        if(r.fail()) {
+            error = ReadError(r.error(), r.start, r.end, SourceMap(source)).what();
+            break;
+        }
+        current = r.end;
+        try {
+            if(macros::Expander::is_definition(r.get())) {
+                expander.define(r.get());
+            } else {
+                std::lock_guard<std::mutex> lock(expansions_mutex_);
+                forms.push_back(expander.expand(r.get()));
+            }
+        } catch(const macros::ExpansionError& e) {
+            std::ostringstream ss;
+            ss << SourceMap(source).position(r.start) << ": " << e.what();
+            error = ss.str();
+            break;
+        }
+    }
+    size_t count = forms.size() + (error.empty() ? 0 : 1);
+    {
+        std::lock_guard<std::mutex> lock(connection->mutex);
+        batch->results.resize(count);
+        batch->ready.resize(count, false);
+        batch->read = true;
+    }
+    form_count_.fetch_add(forms.size());
+    for(size_t i = 0; i < forms.size(); ++i) {
+        auto form = forms[i];
+        post([this, connection, batch, i, form] {
+            eval_form(connection, batch, i, form);
+        });
+    }
+    if(!error.empty()) {
+        error_count_.fetch_add(1);
+    }
+    // Also sends an empty batch.
+    complete(*connection, *batch, forms.size(), error.empty() ? "" : response_frame(Response::Error, error));
+}
+
+void Server::eval_form(const ConnectionRef& connection, const BatchRef& batch, size_t index, const ast::ExpressionRef& form) {
+    std::string frame;
+    try {
+        std::ostringstream ss;
+        ss << *runtime_.eval(form);
+        frame = response_frame(Response::Value, ss.str());
+    } catch(const std::exception& e) {
+        error_count_.fetch_add(1);
+        frame = response_frame(Response::Error, e.what());
+    }
+    complete(*connection, *batch, index, std::move(frame));
+}
+
+// Stores the result of form index of batch, index one past the last form
+// only checks whether batch is done. Moves the results that are next in line
+// to the output of connection.
+void Server::complete(Connection& connection, Batch& batch, size_t index, std::string frame) {
+    bool sent = false;
+    {
+        std::lock_guard<std::mutex> lock(connection.mutex);
+        if(index < batch.results.size()) {
+            batch.results[index] = std::move(frame);
+            batch.ready[index] = true;
+        }
+        while(!connection.batches.empty() and connection.batches.front()->read) {
+            auto& front = *connection.batches.front();
+            while(front.sent < front.results.size() and front.ready[front.sent]) {
+                connection.output += front.results[front.sent];
+                std::string().swap(front.results[front.sent]);
+                ++front.sent;
+                sent = true;
+            }
+            if(front.sent < front.results.size()) {
+                break;
+            }
+            connection.output += response_frame(Response::End, "");
+            connection.batches.pop_front();
+            sent = true;
+        }
+    }
+    if(sent) {
+        wake();
+    }
+}
+
+Client::Client(const std::string& socket_path) : fd_(socket(AF_UNIX, SOCK_STREAM, 0)) {
+    if(fd_ < 0) {
+        throw ServerError(system_error("socket"));
+    }
+    auto address = socket_address(socket_path);
+    if(connect(fd_, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0) {
+        std::string message = system_error("cannot connect to " + socket_path);
+        close(fd_);
+        throw ServerError(message);
+    }
+#ifdef SO_NOSIGPIPE
+    int on = 1;
+    setsockopt(fd_, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+}
+
+Client::~Client() {
+    close(fd_);
+}
+
+void Client::send(const std::string& source) {
+    std::string frame;
+    frame.reserve(4 + source.size());
+    put_length(frame, static_cast<uint32_t>(source.size()));
+    frame += source;
+    size_t position = 0;
+    while(position < frame.size()) {
+        ssize_t n = ::send(fd_, frame.data() + position, frame.size() - position, send_flags);
+        if(n < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+            throw ServerError(system_error("send"));
+        }
+        position += n;
+    }
+}
+
+std::vector<Client::Result> Client::receive() {
+    std::vector<Result> results;
+    size_t position = 0;
+    while(true) {
+        while(input_.size() - position >= 4 and input_.size() - position - 4 >= get_length(input_.data() + position)) {
+            uint32_t length = get_length(input_.data() + position);
+            if(length == 0) {
+                throw ServerError("malformed response");
+            }
+            auto response = static_cast<Response>(input_[position + 4]);
+            std::string text = input_.substr(position + 5, length - 1);
+            position += 4 + length;
+            if(response == Response::End) {
+                input_.erase(0, position);
+                return results;
+            }
+            results.push_back(Result{response == Response::Error, text});
+        }
+        char buffer[65536];
+        ssize_t n = ::read(fd_, buffer, sizeof(buffer));
+        if(n < 0 and errno == EINTR) {
+            continue;
+        } else if(n <= 0) {
+            throw ServerError(n == 0 ? "connection closed by server" : system_error("read"));
+        }
+        input_.append(buffer, n);
+    }
+}
@@ -0,0 +1,184 @@
+//
+//  server.h
+//  rdvlisp
+//
+//  Created by Ruben De Visscher on 18/10/26.
+//  Copyright (c) 2026 Ruben De Visscher. All rights reserved.
+//
+
+#ifndef __rdvlisp__server__
+#define __rdvlisp__server__
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include "eval.h"
+#include "macros.h"
+#include "reader.h"
+
+namespace rdvlisp {
+    namespace server {
+        class ServerError : public std::runtime_error {
+        public:
+            ServerError(const std::string& what) : std::runtime_error(what) {}
+        };
+
+        // Frames are a 32 bit big-endian length followed by that many bytes.
+        // A client sends batches, each a frame with the source of any number
+        // of forms. The server answers every batch, in the order they were
+        // sent, with a frame per form other than macro definitions, a
+        // Response byte followed by the printed value or the error, and an
+        // End frame after the last one.
+        enum class Response : uint8_t {
+            Value = 'v',
+            Error = 'e',
+            End = '.'
+        };
+
+        // Serves batches on a Unix domain socket from one warm runtime. Each
+        // batch is read and its forms evaluated as separate tasks on a pool of
+        // workers, so batches from one or many connections are read while
+        // earlier ones are evaluated, and the forms of a batch run in
+        // parallel. Results are sent in order as soon as those before them
+        // are.
+        //
+        // Forms are evaluated concurrently in the runtime, like the bodies of
+        // pmap, under a Runtime::Concurrent, so the modules they use must be
+        // loaded before run.
+        //
+        // Macro calls are expanded as in a module: (macro ...) forms define
+        // macros for the rest of their batch only, since the batches of a
+        // connection are read concurrently too. Expansions are cached across
+        // batches and connections.
+        class Server {
+        public:
+            class Options {
+            public:
+                std::string socket_path;
+                // 0 means one per hardware thread.
+                size_t workers = 0;
+                // A connection sending a longer batch is closed.
+                size_t max_batch = size_t(1) << 24;
+                // A connection isn't read from while it has this many batches
+                // not entirely sent, or this many bytes of frames its client
+                // hasn't received yet.
+                size_t max_pending = 64;
+                size_t max_output = size_t(1) << 20;
+            };
+            class Statistics {
+            public:
+                uint64_t connections = 0;
+                uint64_t batches = 0;
+                uint64_t forms = 0;
+                uint64_t errors = 0;
+            };
+        private:
+            class Batch {
+            public:
+                bool read = false;
+                // The response frame of each form, once evaluated.
+                std::vector<std::string> results;
+                std::vector<bool> ready;
+                size_t sent = 0;
+            };
+            typedef std::shared_ptr<Batch> BatchRef;
+            class Connection {
+            public:
+                int fd;
+                // Only used by the thread calling run.
+                std::string input;
+                bool input_closed = false;
+                // Batches not entirely sent yet, in order, and the frames to
+                // send, under mutex.
+                std::mutex mutex;
+                std::deque<BatchRef> batches;
+                std::string output;
+                Connection(int fd) : fd(fd) {}
+            };
+            typedef std::shared_ptr<Connection> ConnectionRef;
+
+            runtime::Runtime& runtime_;
+            Options options_;
+            int listen_fd_;
+            int wake_fds_[2];
+            std::atomic<bool> stopping_;
+            std::vector<ConnectionRef> connections_;
+
+            std::vector<std::thread> workers_;
+            std::mutex queue_mutex_;
+            std::condition_variable queue_ready_;
+            std::deque<std::function<void()>> queue_;
+
+            std::mutex expansions_mutex_;
+            macros::Cache expansions_;
+
+            std::atomic<uint64_t> connection_count_;
+            std::atomic<uint64_t> batch_count_;
+            std::atomic<uint64_t> form_count_;
+            std::atomic<uint64_t> error_count_;
+
+            void post(std::function<void()> task);
+            void work();
+            void wake();
+            void accept_connections();
+            bool saturated(const Connection& connection) const;
+            bool receive(const ConnectionRef& connection);
+            bool dispatch(const ConnectionRef& connection);
+            bool transmit(Connection& connection);
+            void read_batch(const ConnectionRef& connection, const BatchRef& batch, const SourceRef& source);
+            void eval_form(const ConnectionRef& connection, const BatchRef& batch, size_t index, const ast::ExpressionRef& form);
+            void complete(Connection& connection, Batch& batch, size_t index, std::string frame);
+        public:
+            // Listens on options.socket_path, replacing a socket there nothing
+            // listens on anymore.
+            Server(runtime::Runtime& runtime, const Options& options);
+            ~Server();
+            Server(const Server&) = delete;
+            Server& operator=(const Server&) = delete;
+
+            // Serves until stop is called. Throws ServerError if polling
+            // fails; the workers have been joined either way.
+            void run();
+            // May be called from any thread, and from a signal handler.
+            void stop();
+            Statistics statistics() const;
+        };
+
+        // A blocking connection to a Server.
+        class Client {
+        public:
+            class Result {
+            public:
+                bool error;
+                std::string text;
+            };
+        private:
+            int fd_;
+            std::string input_;
+        public:
+            Client(const std::string& socket_path);
+            ~Client();
+            Client(const Client&) = delete;
+            Client& operator=(const Client&) = delete;
+
+            // Batches can be sent ahead of receiving the results of earlier
+            // ones, receive returns those of the oldest batch not received.
+            void send(const std::string& source);
+            std::vector<Result> receive();
+            std::vector<Result> evaluate(const std::string& source) {
+                send(source);
+                return receive();
+            }
+        };
+    }
+}
+
+#endif /* defined(__rdvlisp__server__) */
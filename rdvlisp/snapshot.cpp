@@ -0,0 +1,762 @@
+//
+//  snapshot.cpp
+//  rdvlisp
+//
+//  Created by Ruben De Visscher on 18/10/26.
+//  Copyright (c) 2026 Ruben De Visscher. All rights reserved.
+//
+
+#include "snapshot.h"
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <type_traits>
+#include <unordered_map>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace rdvlisp::snapshot;
+using namespace rdvlisp::runtime;
+using namespace rdvlisp;
+
+// Layout, in native byte order:
+//   magic, version, byte_order
+//   u64 size, string table
+//   u64 count, records: u8 kind, u8 tag, payload
+//   u32 count, ids of the value namespaces, root first
+//   u32 count, ids of the type namespaces, root first
+// Record tags are the index of the alternative in the variant of Type,
+// ast::Expression or Value, the version must change with those variants.
+static const char magic[8] = {'R', 'D', 'V', 'S', 'N', 'A', 'P', '\0'};
+static const uint32_t version = 2;
+static const uint32_t byte_order = 0x01020304;
+
+enum class Kind : uint8_t {
+    Type,
+    Expression,
+    Value,
+    Namespace
+};
+
+class raw_integer_visitor : public boost::static_visitor<uint64_t> {
+public:
+    template <typename T>
+    uint64_t operator()(T t) const {
+        typedef typename std::conditional<std::is_signed<T>::value, int64_t, uint64_t>::type Wide;
+        return static_cast<uint64_t>(static_cast<Wide>(t));
+    }
+};
+
+typedef decltype(ast::Integer::value) IntegerVariant;
+typedef decltype(ast::FloatingPoint::value) FloatingPointVariant;
+
+class SnapshotWriter {
+    std::string strings_;
+    std::unordered_map<std::string, uint64_t> string_offsets_;
+    std::string records_;
+    std::unordered_map<const void *, uint32_t> ids_;
+    uint32_t count_;
+
+    template <typename T>
+    void put(T x) {
+        records_.append(reinterpret_cast<const char *>(&x), sizeof(x));
+    }
+    void put_string(const std::string& s) {
+        auto it = string_offsets_.find(s);
+        if(it == string_offsets_.end()) {
+            it = string_offsets_.insert(std::make_pair(s, strings_.size())).first;
+            strings_ += s;
+        }
+        put<uint64_t>(it->second);
+        put<uint64_t>(s.size());
+    }
+    void put_identifier(const ast::Identifier& identifier) {
+        put<uint32_t>(identifier.name.size());
+        for(auto& component : identifier.name) {
+            put_string(component);
+        }
+    }
+    void put_integer(const IntegerVariant& value) {
+        put<uint8_t>(value.which());
+        put<uint64_t>(boost::apply_visitor(raw_integer_visitor(), value));
+    }
+    void put_floating_point(const FloatingPointVariant& value) {
+        put<uint8_t>(value.which());
+        if(auto x = boost::get<float>(&value)) {
+            put<float>(*x);
+        } else {
+            put<double>(boost::get<double>(value));
+        }
+    }
+    bool seen(const void * object, uint32_t& id) {
+        auto it = ids_.find(object);
+        if(it == ids_.end()) {
+            return false;
+        }
+        id = it->second;
+        return true;
+    }
+    // Starts the record of object, once the records it refers to are written.
+    uint32_t begin(const void * object, Kind kind, int tag) {
+        put<uint8_t>(static_cast<uint8_t>(kind));
+        put<uint8_t>(static_cast<uint8_t>(tag));
+        ids_[object] = count_;
+        return count_++;
+    }
+public:
+    SnapshotWriter() : count_(0) {}
+
+    uint32_t type(const types::TypeRef& type) {
+        uint32_t id;
+        if(seen(type.get(), id)) {
+            return id;
+        }
+        auto& variant = type->variant;
+        if(auto array = boost::get<types::Array>(&variant)) {
+            uint32_t inner = this->type(array->inner_type);
+            id = begin(type.get(), Kind::Type, variant.which());
+            put<uint32_t>(inner);
+            put<uint8_t>(array->length ? 1 : 0);
+            put<uint64_t>(array->length ? *array->length : 0);
+        } else if(auto function = boost::get<types::Function>(&variant)) {
+            uint32_t return_type = this->type(function->return_type);
+            std::vector<uint32_t> argument_types;
+            for(auto& argument_type : function->argument_types) {
+                argument_types.push_back(this->type(argument_type));
+            }
+            id = begin(type.get(), Kind::Type, variant.which());
+            put<uint32_t>(return_type);
+            put<uint32_t>(argument_types.size());
+            for(auto argument_type : argument_types) {
+                put<uint32_t>(argument_type);
+            }
+            put<uint8_t>(function->is_vararg ? 1 : 0);
+        } else {
+            id = begin(type.get(), Kind::Type, variant.which());
+            if(auto integer = boost::get<types::Integer>(&variant)) {
+                put<uint64_t>(integer->bits);
+                put<uint8_t>(integer->is_signed ? 1 : 0);
+            } else if(auto floating_point = boost::get<types::FloatingPoint>(&variant)) {
+                put<uint64_t>(floating_point->bits);
+            } else if(auto type_variable = boost::get<types::TypeVariable>(&variant)) {
+                put_string(type_variable->name);
+            }
+        }
+        return id;
+    }
+
+    uint32_t expression(const ast::ExpressionRef& expression) {
+        uint32_t id;
+        if(seen(expression.get(), id)) {
+            return id;
+        }
+        auto& variant = expression->variant;
+        if(auto tuple = boost::get<ast::Tuple>(&variant)) {
+            std::vector<uint32_t> elements;
+            for(auto& element : tuple->elements) {
+                elements.push_back(this->expression(element));
+            }
+            id = begin(expression.get(), Kind::Expression, variant.which());
+            put<uint32_t>(elements.size());
+            for(auto element : elements) {
+                put<uint32_t>(element);
+            }
+        } else if(auto constant = boost::get<ast::Constant>(&variant)) {
+            uint32_t constant_value = value(constant->value);
+            uint32_t original = this->expression(constant->original);
+            id = begin(expression.get(), Kind::Expression, variant.which());
+            put<uint32_t>(constant_value);
+            put<uint32_t>(original);
+        } else {
+            id = begin(expression.get(), Kind::Expression, variant.which());
+            if(auto identifier = boost::get<ast::Identifier>(&variant)) {
+                put_identifier(*identifier);
+            } else if(auto integer = boost::get<ast::Integer>(&variant)) {
+                put_integer(integer->value);
+            } else if(auto floating_point = boost::get<ast::FloatingPoint>(&variant)) {
+                put_floating_point(floating_point->value);
+            } else if(auto string = boost::get<ast::String>(&variant)) {
+                put_string(string->contents.str());
+            } else {
+                put_string(boost::get<ast::Keyword>(variant).name);
+            }
+        }
+        return id;
+    }
+
+    uint32_t value(const ValueRef& value) {
+        uint32_t id;
+        if(seen(value.get(), id)) {
+            return id;
+        }
+        auto& variant = value->variant;
+        if(auto array = boost::get<Array>(&variant)) {
+            uint32_t type = this->type(array->type);
+            std::vector<uint32_t> elements;
+            for(auto& element : array->elements) {
+                elements.push_back(this->value(element));
+            }
+            id = begin(value.get(), Kind::Value, variant.which());
+            put<uint32_t>(type);
+            put<uint32_t>(elements.size());
+            for(auto element : elements) {
+                put<uint32_t>(element);
+            }
+        } else if(auto space = boost::get<Namespace>(&variant)) {
+            std::vector<uint32_t> bindings;
+            for(auto& binding : space->bindings()) {
+                bindings.push_back(this->value(binding.second));
+            }
+            id = begin(value.get(), Kind::Value, variant.which());
+            put_bindings(*space, bindings);
+        } else if(auto vector = boost::get<Vector>(&variant)) {
+            std::vector<uint32_t> elements;
+            vector->elements.for_each([this, &elements](const ValueRef& element) {
+                elements.push_back(this->value(element));
+            });
+            id = begin(value.get(), Kind::Value, variant.which());
+            put<uint32_t>(elements.size());
+            for(auto element : elements) {
+                put<uint32_t>(element);
+            }
+        } else if(auto map = boost::get<Map>(&variant)) {
+            std::vector<uint32_t> entries;
+            map->entries.for_each([this, &entries](const ValueRef& key, const ValueRef& value) {
+                entries.push_back(this->value(key));
+                entries.push_back(this->value(value));
+            });
+            id = begin(value.get(), Kind::Value, variant.which());
+            put<uint32_t>(entries.size() / 2);
+            for(auto entry : entries) {
+                put<uint32_t>(entry);
+            }
+        } else if(auto function = boost::get<Function>(&variant)) {
+            uint32_t body = expression(function->body);
+            id = begin(value.get(), Kind::Value, variant.which());
+            put<uint32_t>(function->argument_names.size());
+            for(auto& argument_name : function->argument_names) {
+                put_identifier(argument_name);
+            }
+            put<uint32_t>(body);
+        } else {
+            id = begin(value.get(), Kind::Value, variant.which());
+            if(auto string = boost::get<String>(&variant)) {
+                put_string(string->contents.str());
+            } else if(auto integer = boost::get<Integer>(&variant)) {
+                put_integer(integer->value);
+            } else if(auto floating_point = boost::get<FloatingPoint>(&variant)) {
+                put_floating_point(floating_point->value);
+            } else if(auto builtin = boost::get<Builtin>(&variant)) {
+                put_string(builtin->name);
+            } else {
+                put_string(boost::get<AsyncBuiltin>(variant).name);
+            }
+        }
+        return id;
+    }
+
+    void put_bindings(const Namespace& space, const std::vector<uint32_t>& values) {
+        put_string(space.name());
+        put<uint32_t>(values.size());
+        size_t i = 0;
+        for(auto& binding : space.bindings()) {
+            put_string(binding.first);
+            put<uint32_t>(values[i++]);
+        }
+    }
+
+    uint32_t space(const Namespace& space) {
+        uint32_t id;
+        if(seen(&space, id)) {
+            return id;
+        }
+        std::vector<uint32_t> bindings;
+        for(auto& binding : space.bindings()) {
+            bindings.push_back(value(binding.second));
+        }
+        id = begin(&space, Kind::Namespace, 0);
+        put_bindings(space, bindings);
+        return id;
+    }
+
+    std::string finish(const std::vector<uint32_t>& value_namespaces, const std::vector<uint32_t>& type_namespaces) {
+        std::string out(magic, sizeof(magic));
+        auto append = [&out](const void * data, size_t size) {
+            out.append(static_cast<const char *>(data), size);
+        };
+        append(&version, sizeof(version));
+        append(&byte_order, sizeof(byte_order));
+        uint64_t strings_size = strings_.size();
+        append(&strings_size, sizeof(strings_size));
+        out += strings_;
+        uint64_t count = count_;
+        append(&count, sizeof(count));
+        out += records_;
+        for(auto namespaces : {&value_namespaces, &type_namespaces}) {
+            uint32_t n = static_cast<uint32_t>(namespaces->size());
+            append(&n, sizeof(n));
+            append(namespaces->data(), n * sizeof(uint32_t));
+        }
+        return out;
+    }
+};
+
+std::string rdvlisp::snapshot::save(Runtime& runtime) {
+    SnapshotWriter writer;
+    std::vector<uint32_t> value_namespaces, type_namespaces;
+    for(auto& space : runtime.value_namespace.namespaces()) {
+        value_namespaces.push_back(writer.space(*space));
+    }
+    for(auto& space : runtime.type_namespace.namespaces()) {
+        type_namespaces.push_back(writer.space(*space));
+    }
+    return writer.finish(value_namespaces, type_namespaces);
+}
+
+std::string rdvlisp::snapshot::save(const Namespace& space) {
+    SnapshotWriter writer;
+    return writer.finish({writer.space(space)}, {});
+}
+
+void rdvlisp::snapshot::save(Runtime& runtime, const std::string& path) {
+    std::string image = save(runtime);
+    // Written next to path first, so that a process loading path never sees
+    // half of a snapshot.
+    std::string temporary = path + ".tmp";
+    {
+        std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+        out.write(image.data(), image.size());
+        if(!out) {
+            throw SnapshotError(temporary + ": could not write snapshot");
+        }
+    }
+    if(std::rename(temporary.c_str(), path.c_str()) != 0) {
+        throw SnapshotError(path + ": " + std::strerror(errno));
+    }
+}
+
+class make_integer_visitor : public boost::static_visitor<Integer> {
+public:
+    template <typename T>
+    Integer operator()(T t) const {
+        return Integer(t);
+    }
+};
+
+class SnapshotReader {
+    class Object {
+    public:
+        types::TypeRef type;
+        ast::ExpressionRef expression;
+        ValueRef value;
+        std::shared_ptr<Namespace> space;
+    };
+
+    const char * data_;
+    size_t size_;
+    size_t position_;
+    std::shared_ptr<const std::string> strings_;
+    std::vector<Object> objects_;
+    std::unordered_map<std::string, ValueRef> builtins_;
+
+    static void corrupt() {
+        throw SnapshotError("corrupt snapshot");
+    }
+    template <typename T>
+    T get() {
+        if(size_ - position_ < sizeof(T)) {
+            corrupt();
+        }
+        T x;
+        std::memcpy(&x, data_ + position_, sizeof(T));
+        position_ += sizeof(T);
+        return x;
+    }
+    // The number of items that follow, each at least a u32, checked before
+    // anything is sized by it.
+    uint32_t get_count() {
+        uint32_t n = get<uint32_t>();
+        if(n > (size_ - position_) / sizeof(uint32_t)) {
+            corrupt();
+        }
+        return n;
+    }
+    // Offset and length of a string in the string table.
+    std::pair<uint64_t, uint64_t> get_range() {
+        uint64_t offset = get<uint64_t>();
+        uint64_t length = get<uint64_t>();
+        if(offset > strings_->size() or length > strings_->size() - offset) {
+            corrupt();
+        }
+        return std::make_pair(offset, length);
+    }
+    std::string get_string() {
+        auto range = get_range();
+        return strings_->substr(range.first, range.second);
+    }
+    Rope get_rope() {
+        auto range = get_range();
+        return Rope(strings_, range.first, range.second);
+    }
+    ast::Identifier get_identifier() {
+        std::vector<std::string> name(get_count());
+        for(auto& component : name) {
+            component = get_string();
+        }
+        try {
+            return ast::Identifier(name);
+        } catch(const std::invalid_argument&) {
+            corrupt();
+            throw;
+        }
+    }
+    IntegerVariant get_integer() {
+        uint8_t which = get<uint8_t>();
+        uint64_t raw = get<uint64_t>();
+        switch(which) {
+            case 0:
+                return static_cast<int8_t>(raw);
+            case 1:
+                return static_cast<uint8_t>(raw);
+            case 2:
+                return static_cast<int16_t>(raw);
+            case 3:
+                return static_cast<uint16_t>(raw);
+            case 4:
+                return static_cast<int32_t>(raw);
+            case 5:
+                return static_cast<uint32_t>(raw);
+            case 6:
+                return static_cast<int64_t>(raw);
+            case 7:
+                return raw;
+            default:
+                corrupt();
+                return raw;
+        }
+    }
+    FloatingPointVariant get_floating_point() {
+        if(get<uint8_t>() == 0) {
+            return get<float>();
+        } else {
+            return get<double>();
+        }
+    }
+    Object& object(uint32_t id) {
+        if(id >= objects_.size()) {
+            corrupt();
+        }
+        return objects_[id];
+    }
+    const types::TypeRef& type(uint32_t id) {
+        auto& type = object(id).type;
+        if(type.get() == nullptr) {
+            corrupt();
+        }
+        return type;
+    }
+    const ast::ExpressionRef& expression(uint32_t id) {
+        auto& expression = object(id).expression;
+        if(expression.get() == nullptr) {
+            corrupt();
+        }
+        return expression;
+    }
+    const ValueRef& value(uint32_t id) {
+        auto& value = object(id).value;
+        if(value.get() == nullptr) {
+            corrupt();
+        }
+        return value;
+    }
+    const std::shared_ptr<Namespace>& space(uint32_t id) {
+        auto& space = object(id).space;
+        if(space.get() == nullptr) {
+            corrupt();
+        }
+        return space;
+    }
+    const ValueRef& builtin(const std::string& name) {
+        auto it = builtins_.find(name);
+        if(it == builtins_.end()) {
+            throw SnapshotError("snapshot refers to builtin " + name + ", which is not installed");
+        }
+        return it->second;
+    }
+    void collect_builtins(const Namespace& space) {
+        for(auto& binding : space.bindings()) {
+            auto& variant = binding.second->variant;
+            if(auto builtin = boost::get<Builtin>(&variant)) {
+                builtins_[builtin->name] = binding.second;
+            } else if(auto async_builtin = boost::get<AsyncBuiltin>(&variant)) {
+                builtins_[async_builtin->name] = binding.second;
+            } else if(auto nested = boost::get<Namespace>(&variant)) {
+                collect_builtins(*nested);
+            }
+        }
+    }
+    void get_bindings(Namespace& space) {
+        uint32_t n = get_count();
+        for(uint32_t i = 0; i < n; ++i) {
+            std::string name = get_string();
+            space.bind(name, value(get<uint32_t>()));
+        }
+    }
+
+    types::TypeRef read_type(uint8_t tag) {
+        switch(tag) {
+            case 0: {
+                uint64_t bits = get<uint64_t>();
+                bool is_signed = get<uint8_t>() != 0;
+                return types::intern(types::Integer(bits, is_signed));
+            }
+            case 1:
+                return types::intern(types::FloatingPoint(get<uint64_t>()));
+            case 2: {
+                auto& inner = type(get<uint32_t>());
+                bool has_length = get<uint8_t>() != 0;
+                uint64_t length = get<uint64_t>();
+                return has_length ? types::ref(types::Array(inner, length)) : types::ref(types::Array(inner));
+            }
+            case 3: {
+                auto return_type = type(get<uint32_t>());
+                std::vector<types::TypeRef> argument_types(get_count());
+                for(auto& argument_type : argument_types) {
+                    argument_type = type(get<uint32_t>());
+                }
+                bool is_vararg = get<uint8_t>() != 0;
+                return types::ref(types::Function(return_type, argument_types, is_vararg));
+            }
+            case 4:
+                return types::ref(types::TypeVariable(get_string()));
+            case 5:
+                return types::intern(types::Undetermined());
+            case 6:
+                return types::intern(types::String());
+            case 7:
+                return types::intern(types::Keyword());
+            default:
+                corrupt();
+                return nullptr;
+        }
+    }
+
+    ast::Expression read_expression(uint8_t tag) {
+        switch(tag) {
+            case 0:
+                return get_identifier();
+            case 1:
+                return ast::Integer(get_integer());
+            case 2:
+                return ast::FloatingPoint(get_floating_point());
+            case 3: {
+                ast::Tuple::Elements elements(get_count());
+                for(auto& element : elements) {
+                    element = expression(get<uint32_t>());
+                }
+                return ast::Tuple(std::move(elements));
+            }
+            case 4:
+                return ast::String(get_rope());
+            case 5:
+                return ast::Keyword(get_string());
+            case 6: {
+                auto& constant_value = value(get<uint32_t>());
+                return ast::Constant(constant_value, expression(get<uint32_t>()));
+            }
+            default:
+                corrupt();
+                return ast::Tuple(ast::Tuple::Elements());
+        }
+    }
+
+    ValueRef read_value(uint8_t tag) {
+        switch(tag) {
+            case 0:
+                return make_value(String(get_rope()));
+            case 1:
+                return make_value(boost::apply_visitor(make_integer_visitor(), get_integer()));
+            case 2: {
+                auto& array_type = type(get<uint32_t>());
+                std::vector<ValueRef> elements(get_count());
+                for(auto& element : elements) {
+                    element = value(get<uint32_t>());
+                }
+                Array array(elements, types::undetermined);
+                array.type = array_type;
+                return make_value(std::move(array));
+            }
+            case 3: {
+                Namespace space(get_string());
+                get_bindings(space);
+                return make_value(std::move(space));
+            }
+            case 4: {
+                auto floating_point = get_floating_point();
+                if(auto x = boost::get<float>(&floating_point)) {
+                    return make_value(FloatingPoint(*x));
+                }
+                return make_value(FloatingPoint(boost::get<double>(floating_point)));
+            }
+            case 5: {
+                std::vector<ast::Identifier> argument_names;
+                uint32_t n = get_count();
+                for(uint32_t i = 0; i < n; ++i) {
+                    argument_names.push_back(get_identifier());
+                }
+                return make_value(Function{argument_names, expression(get<uint32_t>())});
+            }
+            case 6:
+            case 7:
+                return builtin(get_string());
+            case 8: {
+                persistent::Vector<ValueRef>::Transient elements;
+                uint32_t n = get_count();
+                for(uint32_t i = 0; i < n; ++i) {
+                    elements.push_back(value(get<uint32_t>()));
+                }
+                return make_value(Vector{elements.persistent()});
+            }
+            case 9: {
+                decltype(Map::entries)::Transient entries;
+                uint32_t n = get_count();
+                for(uint32_t i = 0; i < n; ++i) {
+                    auto& key = value(get<uint32_t>());
+                    entries.insert(key, value(get<uint32_t>()));
+                }
+                return make_value(Map{entries.persistent()});
+            }
+            default:
+                corrupt();
+                return nullptr;
+        }
+    }
+    void read_object(Object& object, Kind kind, uint8_t tag) {
+        switch(kind) {
+            case Kind::Type:
+                object.type = read_type(tag);
+                break;
+            case Kind::Expression:
+                object.expression = memory::make_shared<memory::Subsystem::Ast, ast::Expression>(read_expression(tag));
+                break;
+            case Kind::Value:
+                object.value = read_value(tag);
+                break;
+            case Kind::Namespace:
+                object.space = memory::make_shared<memory::Subsystem::Values, Namespace>(get_string());
+                get_bindings(*object.space);
+                break;
+            default:
+                corrupt();
+        }
+    }
+public:
+    SnapshotReader(const Runtime& runtime, const char * data, size_t size) : data_(data), size_(size), position_(0) {
+        for(auto& space : runtime.value_namespace.namespaces()) {
+            collect_builtins(*space);
+        }
+    }
+
+    // The value and type namespaces of the snapshot, root first.
+    std::pair<std::vector<std::shared_ptr<Namespace>>, std::vector<std::shared_ptr<Namespace>>> decode() {
+        if(size_ < sizeof(magic) or std::memcmp(data_, magic, sizeof(magic)) != 0) {
+            throw SnapshotError("not a snapshot");
+        }
+        position_ = sizeof(magic);
+        if(get<uint32_t>() != version or get<uint32_t>() != byte_order) {
+            throw SnapshotError("snapshot was written by another version or on another architecture");
+        }
+        uint64_t strings_size = get<uint64_t>();
+        if(strings_size > size_ - position_) {
+            corrupt();
+        }
+        // The one copy of all strings, restored strings are slices of it.
+        strings_ = std::make_shared<const std::string>(data_ + position_, strings_size);
+        position_ += strings_size;
+
+        uint64_t count = get<uint64_t>();
+        if(count > size_ - position_) {
+            corrupt();
+        }
+        objects_.resize(count);
+        for(auto& object : objects_) {
+            auto kind = static_cast<Kind>(get<uint8_t>());
+            uint8_t tag = get<uint8_t>();
+            try {
+                read_object(object, kind, tag);
+            } catch(const std::logic_error&) {
+                // Types, identifiers and the like reject invalid fields.
+                corrupt();
+            }
+        }
+
+        std::pair<std::vector<std::shared_ptr<Namespace>>, std::vector<std::shared_ptr<Namespace>>> roots;
+        for(auto namespaces : {&roots.first, &roots.second}) {
+            uint32_t n = get_count();
+            for(uint32_t i = 0; i < n; ++i) {
+                namespaces->push_back(space(get<uint32_t>()));
+            }
+        }
+        if(position_ != size_) {
+            corrupt();
+        }
+        return roots;
+    }
+};
+
+void rdvlisp::snapshot::load(Runtime& runtime, const char * data, size_t size) {
+    auto roots = SnapshotReader(runtime, data, size).decode();
+    for(auto root : {std::make_pair(&runtime.value_namespace, &roots.first), std::make_pair(&runtime.type_namespace, &roots.second)}) {
+        for(size_t i = 0; i < root.second->size(); ++i) {
+            auto& restored = (*root.second)[i];
+            if(i > 0) {
+                root.first->import(restored);
+                continue;
+            }
+            for(auto& binding : restored->bindings()) {
+                root.first->bind(binding.first, binding.second);
+            }
+        }
+    }
+}
+
+std::shared_ptr<Namespace> rdvlisp::snapshot::load_namespace(Runtime& runtime, const char * data, size_t size) {
+    auto roots = SnapshotReader(runtime, data, size).decode();
+    if(roots.first.size() != 1 or roots.second.size() != 0) {
+        throw SnapshotError("not a snapshot of a namespace");
+    }
+    return roots.first[0];
+}
+
+void rdvlisp::snapshot::load(Runtime& runtime, const std::string& path) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if(fd < 0) {
+        throw SnapshotError(path + ": " + std::strerror(errno));
+    }
+    struct stat status;
+    if(fstat(fd, &status) != 0) {
+        int error = errno;
+        close(fd);
+        throw SnapshotError(path + ": " + std::strerror(error));
+    }
+    size_t size = static_cast<size_t>(status.st_size);
+    if(size == 0) {
+        close(fd);
+        throw SnapshotError(path + ": not a snapshot");
+    }
+    void * data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(data == MAP_FAILED) {
+        throw SnapshotError(path + ": " + std::strerror(errno));
+    }
+    try {
+        load(runtime, static_cast<const char *>(data), size);
+    } catch(...) {
+        munmap(data, size);
+        throw;
+    }
+    munmap(data, size);
+}
@@ -0,0 +1,48 @@
+//
+//  snapshot.h
+//  rdvlisp
+//
+//  Created by Ruben De Visscher on 18/10/26.
+//  Copyright (c) 2026 Ruben De Visscher. All rights reserved.
+//
+
+#ifndef __rdvlisp__snapshot__
+#define __rdvlisp__snapshot__
+
+#include <stdexcept>
+#include <string>
+#include "eval.h"
+
+namespace rdvlisp {
+    namespace snapshot {
+        class SnapshotError : public std::runtime_error {
+        public:
+            SnapshotError(const std::string& what) : std::runtime_error(what) {}
+        };
+
+        // A snapshot holds the value and type namespaces of a runtime and
+        // everything reachable from them: values, function bodies and types,
+        // shared objects being stored once. It contains no pointers, only
+        // indices of earlier objects and offsets into one string table, which
+        // restored strings share instead of being copied one by one.
+        // Builtins can't be serialized and are stored by name; the runtime a
+        // snapshot is loaded into must have them installed. Scalar types are
+        // interned again on load, so they compare equal to types::sint8 etc.
+        std::string save(runtime::Runtime& runtime);
+        void save(runtime::Runtime& runtime, const std::string& path);
+        // A snapshot of space alone, for load_namespace.
+        std::string save(const runtime::Namespace& space);
+
+        // Adds the bindings of a snapshot to runtime: those of its root
+        // namespaces are bound in the root namespaces of runtime, the other
+        // namespaces are imported. Throws SnapshotError if the data is not a
+        // snapshot of this version or refers to a builtin runtime lacks.
+        void load(runtime::Runtime& runtime, const char * data, size_t size);
+        // Maps the file at path and loads it.
+        void load(runtime::Runtime& runtime, const std::string& path);
+        // The namespace saved by save(space), resolving builtins in runtime.
+        std::shared_ptr<runtime::Namespace> load_namespace(runtime::Runtime& runtime, const char * data, size_t size);
+    }
+}
+
+#endif /* defined(__rdvlisp__snapshot__) */
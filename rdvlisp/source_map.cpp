@@ -0,0 +1,129 @@
+//
+//  source_map.cpp
+//  rdvlisp
+//
+//  Created by Ruben De Visscher on 18/10/26.
+//  Copyright (c) 2026 Ruben De Visscher. All rights reserved.
+//
+
+#include "source_map.h"
+#include <algorithm>
+#include <iterator>
+#include <stdexcept>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+using namespace rdvlisp;
+
+// Appends base + i + 1 to line_starts for every '\n' at data[i].
+static void scan_newlines(const char * data, size_t size, size_t base, std::vector<size_t>& line_starts) {
+    size_t i = 0;
+#ifdef __SSE2__
+    const __m128i newline = _mm_set1_epi8('\n');
+    for(; i + 16 <= size; i += 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+        unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, newline)));
+        while(mask != 0) {
+            line_starts.push_back(base + i + __builtin_ctz(mask) + 1);
+            mask &= mask - 1;
+        }
+    }
+#endif
+    for(; i < size; ++i) {
+        if(data[i] == '\n') {
+            line_starts.push_back(base + i + 1);
+        }
+    }
+}
+
+// Number of code points starting in data[0, size[, everything but UTF-8
+// continuation bytes.
+static size_t count_columns(const char * data, size_t size) {
+    size_t columns = 0;
+    for(size_t i = 0; i < size; ++i) {
+        if((static_cast<unsigned char>(data[i]) & 0xC0) != 0x80) {
+            ++columns;
+        }
+    }
+    return columns;
+}
+
+SourceMap::SourceMap(const std::string& source) : source_(&source) {
+    line_starts_.push_back(0);
+    scan_newlines(source.data(), source.size(), 0, line_starts_);
+    add_checkpoints(0, line_starts_.size(), checkpoints_);
+}
+
+// Offset just past the last character of line (0-based), its newline if any.
+size_t SourceMap::line_end(size_t line) const {
+    return line + 1 < line_starts_.size() ? line_starts_[line + 1] : source_->size();
+}
+
+// Appends the checkpoints of the lines [first, last[ (0-based).
+void SourceMap::add_checkpoints(size_t first, size_t last, std::vector<Checkpoint>& checkpoints) const {
+    for(size_t line = first; line < last; ++line) {
+        size_t column = 1;
+        for(size_t offset = line_starts_[line] + checkpoint_interval; offset < line_end(line); offset += checkpoint_interval) {
+            column += count_columns(source_->data() + offset - checkpoint_interval, checkpoint_interval);
+            checkpoints.push_back(Checkpoint{offset, column});
+        }
+    }
+}
+
+SourceMap::Position SourceMap::position(size_t offset) const {
+    if(offset > source_->size()) {
+        throw std::out_of_range("offset outside of source");
+    }
+    auto it = std::upper_bound(line_starts_.begin(), line_starts_.end(), offset) - 1;
+    size_t from = *it;
+    size_t column = 1;
+    auto checkpoint = std::upper_bound(checkpoints_.begin(), checkpoints_.end(), offset, [](size_t offset, const Checkpoint& checkpoint) {
+        return offset < checkpoint.offset;
+    });
+    if(checkpoint != checkpoints_.begin() and std::prev(checkpoint)->offset > from) {
+        from = std::prev(checkpoint)->offset;
+        column = std::prev(checkpoint)->column;
+    }
+    column += count_columns(source_->data() + from, offset - from);
+    return Position{static_cast<size_t>(it - line_starts_.begin()) + 1, column};
+}
+
+void SourceMap::edit(size_t start, size_t end, const std::string& replacement) {
+    // Line starts in ]start, end] came from newlines that were replaced.
+    auto first = std::upper_bound(line_starts_.begin(), line_starts_.end(), start);
+    auto last = std::upper_bound(first, line_starts_.end(), end);
+    std::vector<size_t> inserted;
+    scan_newlines(replacement.data(), replacement.size(), start, inserted);
+    size_t index = first - line_starts_.begin();
+    size_t shift_from = index + inserted.size();
+    first = line_starts_.erase(first, last);
+    line_starts_.insert(first, inserted.begin(), inserted.end());
+    for(size_t i = shift_from; i < line_starts_.size(); ++i) {
+        line_starts_[i] = line_starts_[i] - end + start + replacement.size();
+    }
+
+    // The checkpoints of the lines from the one start is on to the one the
+    // end of replacement is on are recomputed, the later ones shifted.
+    size_t first_line = std::upper_bound(line_starts_.begin(), line_starts_.end(), start) - line_starts_.begin() - 1;
+    size_t last_line = std::upper_bound(line_starts_.begin(), line_starts_.end(), start + replacement.size()) - line_starts_.begin();
+    size_t changed_start = line_starts_[first_line];
+    size_t changed_end = line_end(last_line - 1);
+    size_t old_changed_end = changed_end + end - start - replacement.size();
+    auto by_offset = [](const Checkpoint& checkpoint, size_t offset) {
+        return checkpoint.offset < offset;
+    };
+    auto first_checkpoint = std::lower_bound(checkpoints_.begin(), checkpoints_.end(), changed_start, by_offset);
+    auto last_checkpoint = std::lower_bound(first_checkpoint, checkpoints_.end(), old_changed_end, by_offset);
+    for(auto it = last_checkpoint; it != checkpoints_.end(); ++it) {
+        it->offset = it->offset - end + start + replacement.size();
+    }
+    std::vector<Checkpoint> added;
+    add_checkpoints(first_line, last_line, added);
+    first_checkpoint = checkpoints_.erase(first_checkpoint, last_checkpoint);
+    checkpoints_.insert(first_checkpoint, added.begin(), added.end());
+}
+
+std::ostream& rdvlisp::operator<<(std::ostream& os, SourceMap::Position position) {
+    return os << position.line << ":" << position.column;
+}
@@ -0,0 +1,62 @@
+//
+//  source_map.h
+//  rdvlisp
+//
+//  Created by Ruben De Visscher on 18/10/26.
+//  Copyright (c) 2026 Ruben De Visscher. All rights reserved.
+//
+
+#ifndef __rdvlisp__source_map__
+#define __rdvlisp__source_map__
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace rdvlisp {
+    // Index of the line starts of a source, built with one scan, so that byte
+    // offsets can be turned into lines and columns in O(log n). Long lines,
+    // minified sources say, also get the column of every checkpoint_interval
+    // bytes, so that a column is counted from at most that far back.
+    class SourceMap {
+    public:
+        static const size_t checkpoint_interval = 4096;
+        // 1-based; columns count UTF-8 code points, not bytes.
+        class Position {
+        public:
+            size_t line, column;
+        };
+    private:
+        class Checkpoint {
+        public:
+            size_t offset, column;
+        };
+        const std::string * source_;
+        std::vector<size_t> line_starts_;
+        // Offsets within lines at multiples of checkpoint_interval from
+        // their start, in order.
+        std::vector<Checkpoint> checkpoints_;
+
+        size_t line_end(size_t line) const;
+        void add_checkpoints(size_t first, size_t last, std::vector<Checkpoint>& checkpoints) const;
+    public:
+        // source must outlive the map.
+        SourceMap(const std::string& source);
+
+        Position position(size_t offset) const;
+        size_t lines() const {
+            return line_starts_.size();
+        }
+        // Offset of the first character of line (1-based).
+        size_t line_start(size_t line) const {
+            return line_starts_.at(line - 1);
+        }
+
+        // Updates the index after [start, end[ of the source was replaced by
+        // replacement, which the source must already reflect.
+        void edit(size_t start, size_t end, const std::string& replacement);
+    };
+    std::ostream& operator<<(std::ostream& os, SourceMap::Position position);
+}
+
+#endif /* defined(__rdvlisp__source_map__) */
@@ -7,3 +7,22 @@
 //
 
 #include "types.h"
+#include <mutex>
+#include <unordered_map>
+
+using namespace rdvlisp::types;
+using namespace rdvlisp;
+
+TypeRef rdvlisp::types::intern(const Type& type) {
+    // Function-local so that it is initialized before the first use, by the
+    // static constants of whichever translation unit comes first.
+    static std::mutex mutex;
+    static std::unordered_map<std::string, TypeRef> interned;
+    std::string key = boost::apply_visitor(print_visitor(), type.variant);
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = interned.find(key);
+    if(it == interned.end()) {
+        it = interned.insert(std::make_pair(key, ref(type))).first;
+    }
+    return it->second;
+}
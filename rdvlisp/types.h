@@ -10,10 +10,12 @@
 #define __rdvlisp__types__
 
 #include <iostream>
+#include <memory>
 #include <boost/optional.hpp>
 #include <boost/variant.hpp>
 #include <vector>
 #include <sstream>
+#include "memory.h"
 
 namespace rdvlisp {
     namespace types {
@@ -21,7 +23,7 @@ namespace rdvlisp {
         typedef std::shared_ptr<Type> TypeRef;
         template <typename T>
         TypeRef ref(T t) {
-            return std::make_shared<Type>(t);
+            return memory::make_shared<memory::Subsystem::Types, Type>(t);
         }
         
         class pod {
@@ -91,20 +93,26 @@ namespace rdvlisp {
             Type(T t) : variant(t) {}
         };
         
-        static const types::TypeRef sint8(new types::Type(Integer(8, true)));
-        static const types::TypeRef uint8(new types::Type(Integer(8, false)));
-        static const types::TypeRef sint16(new types::Type(Integer(16, true)));
-        static const types::TypeRef uint16(new types::Type(Integer(16, false)));
-        static const types::TypeRef sint32(new types::Type(Integer(32, true)));
-        static const types::TypeRef uint32(new types::Type(Integer(32, false)));
-        static const types::TypeRef sint64(new types::Type(Integer(64, true)));
-        static const types::TypeRef uint64(new types::Type(Integer(64, false)));
+        // The one instance of type shared by the whole program; types with the
+        // same printed form intern to the same pointer. Types are compared by
+        // pointer, so the constants below must be interned for every
+        // translation unit to see the same ones.
+        TypeRef intern(const Type& type);
         
-        static const types::TypeRef float32(new types::Type(FloatingPoint(32)));
-        static const types::TypeRef float64(new types::Type(FloatingPoint(64)));
+        static const types::TypeRef sint8 = intern(Integer(8, true));
+        static const types::TypeRef uint8 = intern(Integer(8, false));
+        static const types::TypeRef sint16 = intern(Integer(16, true));
+        static const types::TypeRef uint16 = intern(Integer(16, false));
+        static const types::TypeRef sint32 = intern(Integer(32, true));
+        static const types::TypeRef uint32 = intern(Integer(32, false));
+        static const types::TypeRef sint64 = intern(Integer(64, true));
+        static const types::TypeRef uint64 = intern(Integer(64, false));
         
-        static const types::TypeRef string(new types::Type(String()));
-        static const types::TypeRef undetermined(new types::Type(Undetermined()));
+        static const types::TypeRef float32 = intern(FloatingPoint(32));
+        static const types::TypeRef float64 = intern(FloatingPoint(64));
+        
+        static const types::TypeRef string = intern(String());
+        static const types::TypeRef undetermined = intern(Undetermined());
         
         class print_visitor : public boost::static_visitor<std::string> {
         public:
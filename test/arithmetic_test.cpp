@@ -0,0 +1,60 @@
+//
+//  arithmetic_test.cpp
+//  rdvlisp
+//
+//  Created by Ruben De Visscher on 18/10/26.
+//  Copyright (c) 2026 Ruben De Visscher. All rights reserved.
+//
+
+#include "optimize.h"
+#include "reader.h"
+#include "test.h"
+
+using namespace rdvlisp;
+
+// The printed value of source, and of the form the folder replaces it by.
+static std::pair<std::string, std::string> evaluate_and_fold(const std::string& source) {
+    runtime::Runtime runtime(1);
+    std::stringstream folded;
+    folded << *optimize::optimize(runtime, read(source).get());
+    return std::make_pair(test::evaluate(runtime, source), folded.str());
+}
+
+#define CHECK_ARITHMETIC(source, expected) \
+    { \
+        auto results = evaluate_and_fold(source); \
+        CHECK_EQUAL(results.first, std::string(expected)); \
+        CHECK_EQUAL(results.second, std::string(expected)); \
+    }
+
+// Operands are promoted to 64 bits, whatever the type of their literal.
+TEST(arithmetic, integer_promotion) {
+    CHECK_ARITHMETIC("(+ 100 100)", "200");
+    CHECK_ARITHMETIC("(* 1000 1000)", "1000000");
+    CHECK_ARITHMETIC("(+ 0xFF 1)", "256");
+    CHECK_ARITHMETIC("(- 0x80)", "-128");
+    CHECK_ARITHMETIC("(- 1 2)", "-1");
+    CHECK_ARITHMETIC("(/ -7 2)", "-3");
+}
+
+// Only 64 bits wrap around, and a uint64 operand makes the result unsigned.
+TEST(arithmetic, integer_overflow) {
+    CHECK_ARITHMETIC("(+ 9223372036854775807 1)", "-9223372036854775808");
+    CHECK_ARITHMETIC("(- 0 18446744073709551615)", "1");
+    CHECK_ARITHMETIC("(+ 18446744073709551615 1)", "0");
+    CHECK_ARITHMETIC("(/ -9223372036854775808 -1)", "-9223372036854775808");
+}
+
+// Literals that happen to be exact floats are still computed in double.
+TEST(arithmetic, floating_point) {
+    CHECK_ARITHMETIC("(/ 1.0 3.0)", "0.3333333333333333");
+    CHECK_ARITHMETIC("(+ 0.5 1)", "1.5");
+    CHECK_ARITHMETIC("(- 0.5)", "-0.5");
+    CHECK_ARITHMETIC("(* 16777217 1.0)", "16777217.0");
+}
+
+TEST(arithmetic, errors) {
+    runtime::Runtime runtime(1);
+    CHECK_EQUAL(test::evaluate(runtime, "(/ 1 0)"), std::string("error: /: division by zero"));
+    CHECK_EQUAL(test::evaluate(runtime, "(+ 1 \"a\")"), std::string("error: + expects numbers"));
+}
@@ -0,0 +1,114 @@
+//
+//  async_test.cpp
+//  rdvlisp
+//
+//  Created by Ruben De Visscher on 18/10/26.
+//  Copyright (c) 2026 Ruben De Visscher. All rights reserved.
+//
+
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <thread>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "async.h"
+#include "reader.h"
+#include "test.h"
+
+using namespace rdvlisp;
+
+// A FIFO in a fresh directory, removed with it.
+class Fifo {
+public:
+    std::string directory;
+    std::string path;
+    Fifo() {
+        char name[] = "/tmp/rdvlisp-test-XXXXXX";
+        if(mkdtemp(name) == nullptr) {
+            throw test::Failure("mkdtemp failed");
+        }
+        directory = name;
+        path = directory + "/fifo";
+        if(mkfifo(path.c_str(), 0600) != 0) {
+            throw test::Failure("mkfifo failed");
+        }
+    }
+    ~Fifo() {
+        unlink(path.c_str());
+        rmdir(directory.c_str());
+    }
+};
+
+static void wait_a_moment() {
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+}
+
+TEST(async, read_fifo_before_writer) {
+    Fifo fifo;
+    std::thread writer([&fifo] {
+        wait_a_moment();
+        std::ofstream(fifo.path) << "hello";
+    });
+    runtime::Runtime runtime;
+    auto result = test::evaluate(runtime, "(read-file \"" + fifo.path + "\")");
+    writer.join();
+    CHECK_EQUAL(result, "\"hello\"");
+}
+
+TEST(async, read_fifo_empty_writer) {
+    Fifo fifo;
+    std::thread writer([&fifo] {
+        wait_a_moment();
+        std::ofstream stream(fifo.path);
+    });
+    runtime::Runtime runtime;
+    auto result = test::evaluate(runtime, "(read-file \"" + fifo.path + "\")");
+    writer.join();
+    CHECK_EQUAL(result, "\"\"");
+}
+
+TEST(async, write_fifo_before_reader) {
+    Fifo fifo;
+    std::string received;
+    std::thread reader([&fifo, &received] {
+        wait_a_moment();
+        std::ifstream stream(fifo.path);
+        std::getline(stream, received);
+    });
+    runtime::Runtime runtime;
+    auto result = test::evaluate(runtime, "(write-file \"" + fifo.path + "\" \"hello\")");
+    reader.join();
+    CHECK_EQUAL(result, "\"" + fifo.path + "\"");
+    CHECK_EQUAL(received, "hello");
+}
+
+// Both ends in one event loop, each waiting for the other to open, and more
+// than fits in the pipe.
+TEST(async, fifo_event_loop) {
+    Fifo fifo;
+    std::string contents(1 << 20, 'x');
+    runtime::Runtime runtime;
+    runtime.value_namespace.bind("contents", runtime::make_value(runtime::String(contents)));
+    async::EventLoop loop;
+    std::string written, received;
+    loop.spawn(runtime, rdvlisp::read("(read-file \"" + fifo.path + "\")").get(), [&received](const async::Evaluation& evaluation) {
+        received = boost::get<runtime::String>(evaluation.result()->variant).contents.str();
+    });
+    loop.spawn(runtime, rdvlisp::read("(write-file \"" + fifo.path + "\" contents)").get(), [&written](const async::Evaluation& evaluation) {
+        written = boost::get<runtime::String>(evaluation.result()->variant).contents.str();
+    });
+    loop.run();
+    CHECK_EQUAL(written, fifo.path);
+    CHECK(received == contents);
+}
+
+TEST(async, regular_file) {
+    Fifo fifo;
+    std::string path = fifo.directory + "/file";
+    runtime::Runtime runtime;
+    CHECK_EQUAL(test::evaluate(runtime, "(write-file \"" + path + "\" \"hello\")"), "\"" + path + "\"");
+    CHECK_EQUAL(test::evaluate(runtime, "(read-file \"" + path + "\")"), "\"hello\"");
+    unlink(path.c_str());
+}
@@ -0,0 +1,107 @@
+//
+//  incremental_test.cpp
+//  rdvlisp
+//
+//  Created by Ruben De Visscher on 18/10/26.
+//  Copyright (c) 2026 Ruben De Visscher. All rights reserved.
+//
+
+#include <cctype>
+#include <random>
+#include "incremental.h"
+#include "test.h"
+
+using namespace rdvlisp;
+
+static std::string describe(const std::vector<IncrementalReader::Node>& nodes) {
+    std::stringstream ss;
+    for(auto& node : nodes) {
+        ss << node.offset << "+" << node.length << " " << *node.expression;
+        if(!node.elements.empty()) {
+            ss << " [" << describe(node.elements) << "]";
+        }
+        ss << "; ";
+    }
+    return ss.str();
+}
+
+static std::string describe(const IncrementalReader& reader) {
+    auto forms = reader.forms();
+    if(forms.fail()) {
+        std::stringstream ss;
+        ss << "error [" << forms.start << ", " << forms.end << "[: " << forms.error();
+        return ss.str();
+    }
+    return describe(reader.nodes());
+}
+
+// A random edit of source: mostly ones that keep it reading, inserting a
+// form, changing a character of a token or deleting a tuple, sometimes one
+// that likely breaks it.
+static void random_edit(std::mt19937& rng, const std::string& source, size_t& start, size_t& end, std::string& replacement) {
+    static const std::vector<std::string> forms = {
+        "x", "foo", "1", "-2.5", "(f a)", "(g (h 1) \"s\")", ":k", "0x1f", "\"a b\"", "'(q ,x)"
+    };
+    static const std::vector<std::string> breaking = {
+        "(", ")", "\"", "'", ",", "\\", "((", "))", "x(", ""
+    };
+    start = rng() % (source.size() + 1);
+    end = start;
+    replacement.clear();
+    size_t kind = rng() % 10;
+    if(kind < 4) {
+        replacement = " " + forms[rng() % forms.size()] + " ";
+    } else if(kind < 7 and start < source.size() and std::isalnum(static_cast<unsigned char>(source[start]))) {
+        end = start + 1;
+        replacement = std::string(1, 'a' + rng() % 26);
+    } else if(kind < 8) {
+        start = source.find('(', start);
+        if(start == std::string::npos) {
+            start = end = source.size();
+            return;
+        }
+        // Strings in the forms don't have parentheses.
+        size_t depth = 0;
+        for(end = start; end < source.size(); ++end) {
+            depth += source[end] == '(';
+            depth -= source[end] == ')';
+            if(depth == 0) {
+                ++end;
+                break;
+            }
+        }
+    } else {
+        replacement = breaking[rng() % breaking.size()];
+        end = std::min(source.size(), start + rng() % 4);
+    }
+}
+
+// After every edit of random sequences, the forms, their spans and the read
+// error if any are the same as those of reading the whole buffer.
+TEST(incremental, random_edits) {
+    std::mt19937 rng(42);
+    std::string initial;
+    for(size_t i = 0; i < 40; ++i) {
+        initial += "(define f" + std::to_string(i) + " (fn (x y) (+ x (* y " + std::to_string(i) + ") \"text\")))\n";
+    }
+    for(size_t sequence = 0; sequence < 20; ++sequence) {
+        IncrementalReader reader(initial);
+        for(size_t step = 0; step < 300; ++step) {
+            auto& source = reader.source();
+            size_t start, end;
+            std::string replacement;
+            random_edit(rng, source, start, end, replacement);
+            std::string removed = source.substr(start, end - start);
+            reader.edit(start, end, replacement);
+            IncrementalReader full(reader.source());
+            CHECK_EQUAL(describe(reader), describe(full));
+            // Edits that break the buffer are undone, so that the others are
+            // made to one that reads.
+            if(full.forms().fail()) {
+                reader.edit(start, start + replacement.size(), removed);
+                IncrementalReader undone(reader.source());
+                CHECK_EQUAL(describe(reader), describe(undone));
+            }
+        }
+    }
+}
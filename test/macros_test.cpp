@@ -0,0 +1,84 @@
+//
+//  macros_test.cpp
+//  rdvlisp
+//
+//  Created by Ruben De Visscher on 18/10/26.
+//  Copyright (c) 2026 Ruben De Visscher. All rights reserved.
+//
+
+#include "macros.h"
+#include "reader.h"
+#include "test.h"
+
+using namespace rdvlisp;
+
+static std::string expand(macros::Expander& expander, const std::string& source) {
+    std::stringstream ss;
+    ss << *expander.expand(read(source).get());
+    return ss.str();
+}
+
+static std::string expansion_error(macros::Expander& expander, const std::string& source) {
+    try {
+        expander.expand(read(source).get());
+    } catch(const macros::ExpansionError& e) {
+        return e.what();
+    }
+    return "";
+}
+
+// The parameter a template binds never captures an argument, whatever name
+// the argument has.
+TEST(macros, hygiene) {
+    macros::Expander expander;
+    expander.define(read("(macro defk (name e) '(function ,name (x) (+ x ,e)))").get());
+    // Also the names the n-th expansion would have renamed x to if fresh
+    // names were made of characters the reader accepts.
+    for(size_t n = 1; n <= 8; ++n) {
+        std::string argument = "x%" + std::to_string(n);
+        auto form = expander.expand(read("(defk g " + argument + ")").get());
+        auto& function = boost::get<ast::Tuple>(form->variant).elements;
+        auto& parameter = boost::get<ast::Identifier>(boost::get<ast::Tuple>(function[2]->variant).elements[0]->variant).name[0];
+        auto& body = boost::get<ast::Tuple>(function[3]->variant).elements;
+        CHECK(parameter != argument);
+        CHECK_EQUAL(boost::get<ast::Identifier>(body[1]->variant).name[0], parameter);
+        CHECK_EQUAL(boost::get<ast::Identifier>(body[2]->variant).name[0], argument);
+    }
+}
+
+// Cached expansions are only reused while the macros they called are the
+// same, and by every expander sharing the cache.
+TEST(macros, cache) {
+    macros::Cache cache;
+    macros::Expander first(&cache);
+    first.define(read("(macro twice (x) '(+ ,x ,x))").get());
+    CHECK_EQUAL(expand(first, "(f (twice 1))"), "(f (+ 1 1))");
+    CHECK_EQUAL(expand(first, "(f (twice 1))"), "(f (+ 1 1))");
+    CHECK_EQUAL(first.statistics().cached, 1u);
+
+    first.define(read("(macro twice (x) '(* 2 ,x))").get());
+    CHECK_EQUAL(expand(first, "(f (twice 1))"), "(f (* 2 1))");
+    CHECK_EQUAL(first.statistics().cached, 1u);
+
+    macros::Expander second(&cache);
+    second.define(read("(macro twice (x) '(* 2 ,x))").get());
+    CHECK_EQUAL(expand(second, "(f (twice 1))"), "(f (* 2 1))");
+    CHECK_EQUAL(second.statistics().cached, 1u);
+    // f becoming a macro invalidates expansions that called it as a function.
+    second.define(read("(macro f (x) '(g ,x))").get());
+    CHECK_EQUAL(expand(second, "(f (twice 1))"), "(g (* 2 1))");
+    CHECK_EQUAL(second.statistics().cached, 1u);
+}
+
+// A chain of as many macros as the limit expands, one more is rejected.
+TEST(macros, depth_limit) {
+    macros::Expander expander(nullptr, 3);
+    expander.define(read("(macro forever (x) '(forever ,x))").get());
+    expander.define(read("(macro c (x) '(+ ,x 1))").get());
+    expander.define(read("(macro b (x) '(c ,x))").get());
+    expander.define(read("(macro a (x) '(b ,x))").get());
+    expander.define(read("(macro d (x) '(a ,x))").get());
+    CHECK_EQUAL(expansion_error(expander, "(forever 1)"), "expansion of macro forever nested too deeply");
+    CHECK_EQUAL(expand(expander, "(a 0)"), "(+ 0 1)");
+    CHECK_EQUAL(expansion_error(expander, "(d 0)"), "expansion of macro c nested too deeply");
+}
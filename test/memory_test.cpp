@@ -0,0 +1,45 @@
+//
+//  memory_test.cpp
+//  rdvlisp
+//
+//  Created by Ruben De Visscher on 18/10/26.
+//  Copyright (c) 2026 Ruben De Visscher. All rights reserved.
+//
+
+#include "memory.h"
+#include "reader.h"
+#include "test.h"
+
+using namespace rdvlisp;
+
+// Source buffers count for the reader for as long as they are alive.
+TEST(memory, source_buffers) {
+    auto before = memory::usage(memory::Subsystem::Reader).live_bytes;
+    {
+        auto source = make_source(std::string(1 << 16, ' '));
+        CHECK(memory::usage(memory::Subsystem::Reader).live_bytes >= before + (1 << 16));
+    }
+    CHECK_EQUAL(memory::usage(memory::Subsystem::Reader).live_bytes, before);
+}
+
+// The element lists of tuples count for the AST, with their nodes.
+TEST(memory, tuple_elements) {
+    std::string source = "(";
+    for(size_t i = 0; i < 1000; ++i) {
+        source += " x";
+    }
+    source += ")";
+    auto before = memory::usage(memory::Subsystem::Ast).live_bytes;
+    {
+        auto form = read(source).get();
+        auto& tuple = boost::get<ast::Tuple>(form->variant);
+        CHECK(memory::usage(memory::Subsystem::Ast).live_bytes >= before + tuple.elements.size() * sizeof(ast::ExpressionRef));
+        auto with_form = memory::usage(memory::Subsystem::Ast).live_bytes;
+        {
+            ast::Tuple::Elements elements(tuple.elements.begin(), tuple.elements.begin() + 500);
+            CHECK_EQUAL(memory::usage(memory::Subsystem::Ast).live_bytes, with_form + 500 * sizeof(ast::ExpressionRef));
+        }
+        CHECK_EQUAL(memory::usage(memory::Subsystem::Ast).live_bytes, with_form);
+    }
+    CHECK_EQUAL(memory::usage(memory::Subsystem::Ast).live_bytes, before);
+}
@@ -0,0 +1,172 @@
+//
+//  modules_test.cpp
+//  rdvlisp
+//
+//  Created by Ruben De Visscher on 18/10/26.
+//  Copyright (c) 2026 Ruben De Visscher. All rights reserved.
+//
+
+#include <cstdlib>
+#include <fstream>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "modules.h"
+#include "test.h"
+
+using namespace rdvlisp;
+
+// A search path and a cache directory in a fresh directory, removed with
+// everything written to them.
+class ModuleTree {
+    std::vector<std::string> files_;
+    std::vector<std::string> directories_;
+    void make_directory(const std::string& path) {
+        if(mkdir(path.c_str(), 0700) == 0) {
+            directories_.push_back(path);
+        }
+    }
+public:
+    std::string root;
+    std::string source;
+    std::string cache;
+    ModuleTree() {
+        char name[] = "/tmp/rdvlisp-test-XXXXXX";
+        if(mkdtemp(name) == nullptr) {
+            throw test::Failure("mkdtemp failed");
+        }
+        root = name;
+        source = root + "/source";
+        cache = root + "/cache";
+        make_directory(source);
+        make_directory(cache);
+    }
+    ~ModuleTree() {
+        for(auto& file : files_) {
+            unlink(file.c_str());
+        }
+        if(DIR * entries = opendir(cache.c_str())) {
+            while(dirent * entry = readdir(entries)) {
+                unlink((cache + "/" + entry->d_name).c_str());
+            }
+            closedir(entries);
+        }
+        for(auto it = directories_.rbegin(); it != directories_.rend(); ++it) {
+            rmdir(it->c_str());
+        }
+        rmdir(root.c_str());
+    }
+    // Writes the source of module name, a.b being a/b.rdv.
+    void write(const std::string& name, const std::string& contents) {
+        std::string path = source;
+        size_t start = 0;
+        for(size_t dot = name.find('.'); dot != std::string::npos; dot = name.find('.', start)) {
+            path += "/" + name.substr(start, dot - start);
+            make_directory(path);
+            start = dot + 1;
+        }
+        path += "/" + name.substr(start) + ".rdv";
+        std::ofstream(path, std::ios::trunc) << contents;
+        files_.push_back(path);
+    }
+};
+
+// A runtime with a loader on tree, as a fresh process would have.
+class Session {
+public:
+    runtime::Runtime runtime;
+    modules::Loader loader;
+    Session(const ModuleTree& tree) : runtime(1), loader(runtime, {tree.source}, tree.cache) {}
+};
+
+TEST(modules, restore_from_cache) {
+    ModuleTree tree;
+    tree.write("a", "(function f (x) (b.g (b.g x)))");
+    tree.write("b", "(define one 1) (function g (x) (+ x one))");
+    {
+        Session session(tree);
+        session.loader.require("a");
+        CHECK_EQUAL(session.loader.statistics().compiled, 2u);
+        CHECK_EQUAL(session.loader.statistics().restored, 0u);
+        CHECK_EQUAL(test::evaluate(session.runtime, "(a.f 1)"), "3");
+    }
+    Session session(tree);
+    session.loader.require("a");
+    CHECK_EQUAL(session.loader.statistics().compiled, 0u);
+    CHECK_EQUAL(session.loader.statistics().restored, 2u);
+    CHECK_EQUAL(test::evaluate(session.runtime, "(a.f 1)"), "3");
+}
+
+// a depends on b, which depends on c; d depends on nothing. Editing b
+// recompiles b and a only.
+TEST(modules, edit_recompiles_dependents) {
+    ModuleTree tree;
+    tree.write("a", "(function f (x) (b.g x))");
+    tree.write("b", "(function g (x) (c.h x))");
+    tree.write("c", "(function h (x) (* x 2))");
+    tree.write("d", "(define k 7)");
+    {
+        Session session(tree);
+        session.loader.require("a");
+        session.loader.require("d");
+        CHECK_EQUAL(session.loader.statistics().compiled, 4u);
+    }
+    tree.write("b", "(function g (x) (+ (c.h x) 1))");
+    Session session(tree);
+    session.loader.require("a");
+    session.loader.require("d");
+    CHECK_EQUAL(session.loader.statistics().compiled, 2u);
+    CHECK_EQUAL(session.loader.statistics().restored, 2u);
+    CHECK_EQUAL(test::evaluate(session.runtime, "(a.f 5)"), "11");
+}
+
+TEST(modules, dependency_cycle) {
+    ModuleTree tree;
+    tree.write("p", "(function f (x) (q.g x))");
+    tree.write("q", "(function g (x) (p.f x))");
+    Session session(tree);
+    bool thrown = false;
+    try {
+        session.loader.require("p");
+    } catch(const modules::ModuleError& e) {
+        thrown = std::string(e.what()).find("depends on itself") != std::string::npos;
+    }
+    CHECK(thrown);
+    CHECK(!session.loader.is_loaded("p"));
+    CHECK(!session.loader.is_loaded("q"));
+}
+
+// Referring to a name loads the module it is in, and nothing else.
+TEST(modules, lazy_loading) {
+    ModuleTree tree;
+    tree.write("lib.b", "(function f (x) (+ x 1))");
+    tree.write("lib.c", "(function f (x) (+ x 2))");
+    Session session(tree);
+    CHECK(!session.loader.is_loaded("lib.b"));
+    CHECK_EQUAL(test::evaluate(session.runtime, "(lib.b.f 1)"), "2");
+    CHECK(session.loader.is_loaded("lib.b"));
+    CHECK(!session.loader.is_loaded("lib.c"));
+    CHECK(!session.loader.is_loaded("lib"));
+    CHECK_EQUAL(session.loader.statistics().compiled, 1u);
+}
+
+// The definitions compiled before the one that fails are unbound again.
+TEST(modules, failed_compile) {
+    ModuleTree tree;
+    tree.write("bad", "(define x 1) (function f (y) (+ x y)) (define z (undefined 1))");
+    Session session(tree);
+    bool thrown = false;
+    try {
+        session.loader.require("bad");
+    } catch(const modules::ModuleError&) {
+        thrown = true;
+    }
+    CHECK(thrown);
+    CHECK(!session.loader.is_loaded("bad"));
+    auto root = session.runtime.value_namespace.root();
+    if(root->contains("bad")) {
+        auto& space = boost::get<runtime::Namespace>(root->lookup("bad")->variant);
+        CHECK(space.bindings().empty());
+    }
+    CHECK_EQUAL(test::evaluate(session.runtime, "bad.x").compare(0, 7, "error: "), 0);
+}
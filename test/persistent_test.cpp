@@ -0,0 +1,296 @@
+//
+//  persistent_test.cpp
+//  rdvlisp
+//
+//  Created by Ruben De Visscher on 18/10/26.
+//  Copyright (c) 2026 Ruben De Visscher. All rights reserved.
+//
+
+#include <map>
+#include "eval.h"
+#include "persistent.h"
+#include "test.h"
+
+using namespace rdvlisp;
+
+static std::vector<size_t> elements(const persistent::Vector<size_t>& vector) {
+    std::vector<size_t> result;
+    vector.for_each([&result](size_t x) {
+        result.push_back(x);
+    });
+    return result;
+}
+
+// Every element, read by index and by for_each, is its own index.
+static void check_identity(const persistent::Vector<size_t>& vector, size_t size) {
+    CHECK_EQUAL(vector.size(), size);
+    auto all = elements(vector);
+    CHECK_EQUAL(all.size(), size);
+    for(size_t i = 0; i < size; ++i) {
+        CHECK_EQUAL(vector[i], i);
+        CHECK_EQUAL(all[i], i);
+    }
+}
+
+// Sizes around where the tail fills up and where the trie gets a new root:
+// a leaf root holds 32 elements, one level 1024, two levels 32768, each
+// with up to 32 more in the tail.
+static const std::vector<size_t> boundaries = {
+    0, 1, 31, 32, 33, 63, 64, 65, 66, 1023, 1024, 1025, 1056, 1057, 1058,
+    32767, 32768, 32769, 32800, 32801, 32802, 33900
+};
+
+// Earlier versions stay intact while later ones grow past each boundary.
+TEST(persistent, vector_push_back) {
+    std::vector<persistent::Vector<size_t>> versions;
+    persistent::Vector<size_t> vector;
+    for(size_t size : boundaries) {
+        while(vector.size() < size) {
+            vector = vector.push_back(vector.size());
+        }
+        versions.push_back(vector);
+    }
+    for(size_t i = 0; i < boundaries.size(); ++i) {
+        check_identity(versions[i], boundaries[i]);
+    }
+}
+
+// set at the first element, the last one in the trie and the first and last
+// in the tail, leaving the original unchanged.
+TEST(persistent, vector_set) {
+    for(size_t size : boundaries) {
+        persistent::Vector<size_t>::Transient transient;
+        for(size_t i = 0; i < size; ++i) {
+            transient.push_back(i);
+        }
+        auto vector = transient.persistent();
+        size_t tail = size == 0 ? 0 : (size - 1) / 32 * 32;
+        for(size_t index : {size_t(0), tail == 0 ? size_t(0) : tail - 1, tail, size - 1}) {
+            if(index >= size) {
+                continue;
+            }
+            auto updated = vector.set(index, 1000000);
+            check_identity(vector, size);
+            CHECK_EQUAL(updated.size(), size);
+            for(size_t i = 0; i < size; ++i) {
+                CHECK_EQUAL(updated[i], i == index ? 1000000 : i);
+            }
+            auto restored = updated.set(index, index);
+            check_identity(restored, size);
+        }
+    }
+}
+
+// Neither the vector a transient starts from nor the one it returned earlier
+// sees its later updates, in the trie or in the tail.
+TEST(persistent, vector_transient) {
+    persistent::Vector<size_t>::Transient transient;
+    for(size_t i = 0; i < 1100; ++i) {
+        transient.push_back(i);
+    }
+    auto first = transient.persistent();
+    transient.set(0, 7);
+    transient.set(1099, 7);
+    transient.push_back(1100);
+    auto second = transient.persistent();
+    transient.set(500, 7);
+    check_identity(first, 1100);
+    CHECK_EQUAL(second.size(), 1101);
+    CHECK_EQUAL(second[0], 7);
+    CHECK_EQUAL(second[500], 500);
+    CHECK_EQUAL(second[1099], 7);
+    CHECK_EQUAL(second[1100], 1100);
+    CHECK_EQUAL(transient[500], 7);
+
+    persistent::Vector<size_t>::Transient from(first);
+    from.set(3, 7);
+    from.push_back(1100);
+    check_identity(first, 1100);
+    CHECK_EQUAL(from[3], 7);
+    CHECK_EQUAL(from.size(), 1101);
+}
+
+// The hash is the key itself, so tests choose which slots keys share.
+class IdentityHash {
+public:
+    size_t operator()(uint64_t x) const {
+        return x;
+    }
+};
+
+class ConstantHash {
+public:
+    size_t operator()(uint64_t) const {
+        return 42;
+    }
+};
+
+template <typename Map>
+static std::vector<std::pair<uint64_t, int>> entries(const Map& map) {
+    std::vector<std::pair<uint64_t, int>> result;
+    map.for_each([&result](uint64_t key, int value) {
+        result.push_back(std::make_pair(key, value));
+    });
+    return result;
+}
+
+// Keys with the same hash all end up in one collision node below the last
+// level and can still be found, replaced and erased one by one.
+TEST(persistent, map_collisions) {
+    typedef persistent::Map<uint64_t, int, ConstantHash> Map;
+    Map map;
+    for(uint64_t key = 0; key < 100; ++key) {
+        map = map.insert(key, int(key));
+    }
+    auto replaced = map.insert(50, -1);
+    CHECK_EQUAL(replaced.size(), 100);
+    CHECK_EQUAL(*replaced.find(50), -1);
+    CHECK_EQUAL(*map.find(50), 50);
+    CHECK(map.find(100) == nullptr);
+    auto erased = map;
+    for(uint64_t key = 0; key < 100; key += 2) {
+        erased = erased.erase(key);
+    }
+    erased = erased.erase(100);
+    CHECK_EQUAL(erased.size(), 50);
+    CHECK_EQUAL(map.size(), 100);
+    for(uint64_t key = 0; key < 100; ++key) {
+        CHECK_EQUAL(*map.find(key), int(key));
+        CHECK(key % 2 == 0 ? erased.find(key) == nullptr : *erased.find(key) == int(key));
+    }
+    for(uint64_t key = 1; key < 100; key += 2) {
+        erased = erased.erase(key);
+    }
+    CHECK(erased.empty());
+    CHECK(erased.find(1) == nullptr);
+}
+
+// Erasing from a child, down to a collision node, until one entry is left
+// moves that entry back up: the map then iterates like one that never had
+// the erased keys.
+TEST(persistent, map_erase_collapses) {
+    typedef persistent::Map<uint64_t, int, IdentityHash> Map;
+    // 1 and 33 share slot 1 at the first level, 2 has a slot of its own.
+    auto shallow = Map().insert(1, 1).insert(33, 33).erase(33).insert(2, 2);
+    auto direct = Map().insert(1, 1).insert(2, 2);
+    CHECK(entries(shallow) == entries(direct));
+
+    typedef persistent::Map<uint64_t, int, ConstantHash> Colliding;
+    auto deep = Colliding().insert(1, 1).insert(2, 2).erase(2);
+    CHECK_EQUAL(deep.size(), 1);
+    CHECK_EQUAL(*deep.find(1), 1);
+    CHECK(deep.find(2) == nullptr);
+    auto chain = Map().insert(5, 5).insert(5 + (uint64_t(1) << 60), 0).erase(5 + (uint64_t(1) << 60)).insert(6, 6);
+    CHECK(entries(chain) == entries(Map().insert(5, 5).insert(6, 6)));
+}
+
+// Random inserts and erases against std::map, hashes restricted to a few
+// bits so that children and collision nodes are common.
+TEST(persistent, map_random) {
+    class FewBitsHash {
+    public:
+        size_t operator()(uint64_t x) const {
+            return (x % 7) | (x % 5) << 5 | uint64_t(x % 3) << 62;
+        }
+    };
+    typedef persistent::Map<uint64_t, int, FewBitsHash> Map;
+    uint64_t state = 1;
+    Map map;
+    std::map<uint64_t, int> expected;
+    std::vector<Map> versions;
+    std::vector<std::map<uint64_t, int>> expected_versions;
+    for(int i = 0; i < 5000; ++i) {
+        state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+        uint64_t key = (state >> 33) % 200;
+        if((state >> 20) % 3 == 0) {
+            map = map.erase(key);
+            expected.erase(key);
+        } else {
+            map = map.insert(key, i);
+            expected[key] = i;
+        }
+        if(i % 500 == 0) {
+            versions.push_back(map);
+            expected_versions.push_back(expected);
+        }
+    }
+    versions.push_back(map);
+    expected_versions.push_back(expected);
+    for(size_t v = 0; v < versions.size(); ++v) {
+        CHECK_EQUAL(versions[v].size(), expected_versions[v].size());
+        for(uint64_t key = 0; key < 200; ++key) {
+            auto found = versions[v].find(key);
+            auto it = expected_versions[v].find(key);
+            CHECK(it == expected_versions[v].end() ? found == nullptr : found != nullptr and *found == it->second);
+        }
+        auto all = entries(versions[v]);
+        std::map<uint64_t, int> all_entries(all.begin(), all.end());
+        CHECK(all_entries == expected_versions[v]);
+    }
+}
+
+TEST(persistent, map_transient) {
+    typedef persistent::Map<uint64_t, int, IdentityHash> Map;
+    Map::Transient transient;
+    for(uint64_t key = 0; key < 100; ++key) {
+        transient.insert(key * 32, int(key));
+    }
+    auto first = transient.persistent();
+    transient.insert(0, -1);
+    transient.insert(1000000, 1);
+    transient.erase(32);
+    CHECK_EQUAL(first.size(), 100);
+    CHECK_EQUAL(*first.find(0), 0);
+    CHECK_EQUAL(*first.find(32), 1);
+    CHECK(first.find(1000000) == nullptr);
+    CHECK_EQUAL(transient.size(), 100);
+    CHECK_EQUAL(*transient.find(0), -1);
+    CHECK(transient.find(32) == nullptr);
+
+    Map::Transient from(first);
+    from.erase(64);
+    CHECK_EQUAL(*first.find(64), 2);
+    CHECK(from.find(64) == nullptr);
+}
+
+// Integers of different types with the same value are the same key.
+TEST(persistent, value_keys) {
+    using runtime::Integer;
+    std::vector<runtime::ValueRef> minus_one = {
+        runtime::make_value(Integer(int8_t(-1))), runtime::make_value(Integer(int16_t(-1))),
+        runtime::make_value(Integer(int32_t(-1))), runtime::make_value(Integer(int64_t(-1)))
+    };
+    std::vector<runtime::ValueRef> two_hundred = {
+        runtime::make_value(Integer(uint8_t(200))), runtime::make_value(Integer(int16_t(200))),
+        runtime::make_value(Integer(uint16_t(200))), runtime::make_value(Integer(int32_t(200))),
+        runtime::make_value(Integer(uint32_t(200))), runtime::make_value(Integer(int64_t(200))),
+        runtime::make_value(Integer(uint64_t(200)))
+    };
+    runtime::ValueHash hash;
+    runtime::ValueEqual equal;
+    for(auto& group : {minus_one, two_hundred}) {
+        for(auto& a : group) {
+            for(auto& b : group) {
+                CHECK(equal(a, b));
+                CHECK_EQUAL(hash(a), hash(b));
+            }
+        }
+    }
+    // Same bits, different values.
+    CHECK(!equal(runtime::make_value(Integer(int8_t(-1))), runtime::make_value(Integer(uint8_t(255)))));
+    CHECK(!equal(runtime::make_value(Integer(int64_t(-1))), runtime::make_value(Integer(uint64_t(-1)))));
+    CHECK(!equal(runtime::make_value(Integer(int8_t(-56))), two_hundred[0]));
+
+    persistent::Map<runtime::ValueRef, runtime::ValueRef, runtime::ValueHash, runtime::ValueEqual> map;
+    map = map.insert(minus_one[0], two_hundred[0]);
+    map = map.insert(two_hundred[6], minus_one[3]);
+    for(auto& key : minus_one) {
+        CHECK(map.find(key) != nullptr and *map.find(key) == two_hundred[0]);
+    }
+    for(auto& key : two_hundred) {
+        CHECK(map.find(key) != nullptr and *map.find(key) == minus_one[3]);
+    }
+    map = map.insert(minus_one[2], minus_one[2]);
+    CHECK_EQUAL(map.size(), 2);
+    CHECK(*map.find(minus_one[1]) == minus_one[2]);
+}
@@ -0,0 +1,60 @@
+//
+//  print_test.cpp
+//  rdvlisp
+//
+//  Created by Ruben De Visscher on 18/10/26.
+//  Copyright (c) 2026 Ruben De Visscher. All rights reserved.
+//
+
+#include <cmath>
+#include "reader.h"
+#include "test.h"
+
+using namespace rdvlisp;
+
+// Evaluates source, then evaluates its printed value, which must give an
+// equal value that prints the same.
+static void check_round_trip(const std::string& source) {
+    runtime::Runtime runtime(1);
+    auto value = runtime.eval(read(source).get());
+    std::stringstream printed;
+    printed << *value;
+    auto r = read(printed.str());
+    if(r.fail() or r.end != printed.str().size()) {
+        throw test::Failure(source + " prints unreadably as " + printed.str());
+    }
+    auto again = runtime.eval(r.get());
+    std::stringstream reprinted;
+    reprinted << *again;
+    CHECK_EQUAL(reprinted.str(), printed.str());
+    auto floating_point = boost::get<runtime::FloatingPoint>(&value->variant);
+    if(floating_point == nullptr or !std::isnan(floating_point->bits == 32 ? boost::get<float>(floating_point->value) : boost::get<double>(floating_point->value))) {
+        CHECK(runtime::ValueEqual()(value, again));
+    }
+}
+
+TEST(print, strings) {
+    check_round_trip("(concat \"a\\\"b\")");
+    check_round_trip("(concat \"a\\\\b\" \"\\\\\")");
+    check_round_trip("(concat \"\\\\\\\"\")");
+    check_round_trip("(concat \"\\n\\t\\r\\f\\v\\b\\a\")");
+    check_round_trip("(concat \"\\\"\\\"\" \"(\")");
+    std::stringstream printed;
+    printed << ast::String("a\"b\\c");
+    CHECK_EQUAL(printed.str(), "\"a\\\"b\\\\c\"");
+}
+
+TEST(print, numbers) {
+    for(auto source : {"0.1", "1.5", "-0.0", "1e300", "(/ 1.0 3.0)", "(* 1e300 1e300)", "(- (* 1e300 1e300))", "(- (* 1e300 1e300) (* 1e300 1e300))", "-128", "18446744073709551615"}) {
+        check_round_trip(source);
+    }
+    std::stringstream printed;
+    printed << ast::FloatingPoint(std::numeric_limits<float>::infinity());
+    CHECK_EQUAL(printed.str(), "(/ 1.0 0.0)");
+}
+
+TEST(print, containers) {
+    check_round_trip("(array \"\\\"\" 1 2.5)");
+    check_round_trip("(vector \"x\\\\\" (array (* 1e300 1e300)))");
+    check_round_trip("(hash-map \"\\\"k\\\"\" (vector 1) 2 \"v\")");
+}
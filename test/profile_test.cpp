@@ -0,0 +1,67 @@
+//
+//  profile_test.cpp
+//  rdvlisp
+//
+//  Created by Ruben De Visscher on 18/10/26.
+//  Copyright (c) 2026 Ruben De Visscher. All rights reserved.
+//
+
+#include "profile.h"
+#include "reader.h"
+#include "test.h"
+
+using namespace rdvlisp;
+
+static const profile::Entry * find_entry(const std::vector<profile::Entry>& entries, const std::string& name) {
+    for(auto& entry : entries) {
+        if(entry.name == name) {
+            return &entry;
+        }
+    }
+    return nullptr;
+}
+
+// Spans are named after the start of their printed form once reported, even
+// if the form is gone by then.
+TEST(profile, span_names) {
+    runtime::Runtime runtime(1);
+    profile::Profiler profiler;
+    runtime.set_profiler(&profiler);
+    std::string sum = "(+ 1 2)";
+    for(size_t i = 0; i < 40; ++i) {
+        sum = "(+ " + sum + " 1)";
+    }
+    {
+        auto form = read(sum).get();
+        runtime.eval(form);
+        runtime.eval(form);
+    }
+    runtime.set_profiler(nullptr);
+    auto entries = profiler.entries();
+    auto outer = find_entry(entries, sum.substr(0, 57) + "...");
+    CHECK(outer != nullptr);
+    CHECK_EQUAL(outer->counters.calls, 2u);
+    auto inner = find_entry(entries, "(+ 1 2)");
+    CHECK(inner != nullptr);
+    CHECK_EQUAL(inner->counters.calls, 2u);
+}
+
+// A thread switching between profilers keeps counting into the same state of
+// each.
+TEST(profile, switching_profilers) {
+    runtime::Runtime runtime(1);
+    profile::Profiler first;
+    profile::Profiler second;
+    auto form = read("(+ 1 2)").get();
+    for(size_t i = 0; i < 1000; ++i) {
+        runtime.set_profiler(i % 2 == 0 ? &first : &second);
+        runtime.eval(form);
+    }
+    runtime.set_profiler(nullptr);
+    for(auto profiler : {&first, &second}) {
+        auto entries = profiler->entries();
+        auto entry = find_entry(entries, "(+ 1 2)");
+        CHECK(entry != nullptr);
+        CHECK_EQUAL(entry->counters.calls, 500u);
+    }
+}
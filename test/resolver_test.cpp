@@ -0,0 +1,65 @@
+//
+//  resolver_test.cpp
+//  rdvlisp
+//
+//  Created by Ruben De Visscher on 18/10/26.
+//  Copyright (c) 2026 Ruben De Visscher. All rights reserved.
+//
+
+#include <atomic>
+#include "reader.h"
+#include "test.h"
+
+using namespace rdvlisp;
+
+// Binds f and h to functions of one and two arguments calling g, which only
+// the resolver binds, and counts how often it is called.
+static void install(runtime::Runtime& runtime, std::atomic<size_t>& resolved) {
+    std::vector<ast::Identifier> arguments{ast::Identifier("x")};
+    runtime.value_namespace.bind("f", runtime::make_value(runtime::Function{arguments, read("(g x)").get()}));
+    arguments.push_back(ast::Identifier("y"));
+    runtime.value_namespace.bind("h", runtime::make_value(runtime::Function{arguments, read("(g x)").get()}));
+    runtime.value_namespace.set_resolver([&runtime, &resolved](const ast::Identifier& identifier) {
+        ++resolved;
+        if(identifier.name.size() != 1 or identifier.name[0] != "g") {
+            return false;
+        }
+        runtime.value_namespace.bind("g", runtime.value_namespace.lookup(ast::Identifier("-")));
+        return true;
+    });
+}
+
+static std::string array_source(size_t size) {
+    std::string source = "(array";
+    for(size_t i = 0; i < size; ++i) {
+        source += " " + std::to_string(i);
+    }
+    return source + ")";
+}
+
+TEST(resolver, sequential) {
+    runtime::Runtime runtime(1);
+    std::atomic<size_t> resolved(0);
+    install(runtime, resolved);
+    CHECK_EQUAL(test::evaluate(runtime, "(f 2)"), "-2");
+    CHECK_EQUAL(resolved.load(), 1u);
+    CHECK_EQUAL(test::evaluate(runtime, "(pmap f (array 1 2))"), "(array -1 -2)");
+    CHECK_EQUAL(resolved.load(), 1u);
+}
+
+// The parallel builtins never bind names while other threads may look them
+// up, whether they run inline or on the thread pool.
+TEST(resolver, parallel) {
+    for(size_t size : {2, 100000}) {
+        runtime::Runtime runtime(4);
+        std::atomic<size_t> resolved(0);
+        install(runtime, resolved);
+        for(auto builtin : {"pmap f", "pfor-each f", "preduce h 0"}) {
+            auto result = test::evaluate(runtime, std::string("(") + builtin + " " + array_source(size) + ")");
+            CHECK(result.find("error: ") == 0 and result.find("g") != std::string::npos);
+        }
+        CHECK_EQUAL(resolved.load(), 0u);
+        CHECK_EQUAL(test::evaluate(runtime, "(f 2)"), "-2");
+        CHECK_EQUAL(resolved.load(), 1u);
+    }
+}
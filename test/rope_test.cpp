@@ -0,0 +1,61 @@
+//
+//  rope_test.cpp
+//  rdvlisp
+//
+//  Created by Ruben De Visscher on 18/10/26.
+//  Copyright (c) 2026 Ruben De Visscher. All rights reserved.
+//
+
+#include <cmath>
+#include <random>
+#include "rope.h"
+#include "test.h"
+
+using namespace rdvlisp;
+
+// Appending pieces that can't be merged keeps the tree balanced.
+TEST(rope, append_depth) {
+    std::string chunk(40, 'y');
+    Rope rope;
+    std::string expected;
+    for(size_t i = 0; i < 100000; ++i) {
+        rope = rope + Rope(chunk + std::to_string(i));
+        expected += chunk + std::to_string(i);
+    }
+    CHECK(rope.depth() <= 1.45 * std::log2(100000.0));
+    CHECK(rope.str() == expected);
+}
+
+// Random concatenations and slices, compared with the same on strings,
+// pieces compared in both directions with differently shaped trees.
+TEST(rope, random) {
+    std::mt19937 rng(42);
+    std::vector<Rope> ropes;
+    std::vector<std::string> strings;
+    for(size_t i = 0; i < 2000; ++i) {
+        size_t operation = ropes.size() < 2 ? 0 : rng() % 3;
+        if(operation == 0) {
+            std::string s(rng() % 100, 'a' + rng() % 26);
+            ropes.push_back(Rope(s));
+            strings.push_back(s);
+        } else if(operation == 1) {
+            size_t a = rng() % ropes.size();
+            size_t b = rng() % ropes.size();
+            ropes.push_back(ropes[a] + ropes[b]);
+            strings.push_back(strings[a] + strings[b]);
+        } else {
+            size_t a = rng() % ropes.size();
+            size_t begin = rng() % (strings[a].size() + 1);
+            size_t end = begin + rng() % (strings[a].size() - begin + 1);
+            ropes.push_back(ropes[a].slice(begin, end));
+            strings.push_back(strings[a].substr(begin, end - begin));
+        }
+        auto& rope = ropes.back();
+        CHECK(rope.str() == strings.back());
+        CHECK(rope.depth() <= 2 * std::log2(rope.size() + 2) + 2);
+        size_t other = rng() % ropes.size();
+        CHECK_EQUAL(rope == ropes[other], strings.back() == strings[other]);
+        CHECK_EQUAL(ropes[other] == rope, strings.back() == strings[other]);
+        CHECK(rope == Rope(strings.back()));
+    }
+}
@@ -0,0 +1,98 @@
+//
+//  server_test.cpp
+//  rdvlisp
+//
+//  Created by Ruben De Visscher on 18/10/26.
+//  Copyright (c) 2026 Ruben De Visscher. All rights reserved.
+//
+
+#include <chrono>
+#include <thread>
+#include <unistd.h>
+#include "server.h"
+#include "test.h"
+
+using namespace rdvlisp;
+
+// A server on a fresh socket, running on its own thread.
+class RunningServer {
+public:
+    runtime::Runtime runtime;
+    std::string socket_path;
+    std::unique_ptr<server::Server> server;
+    std::thread serving;
+    RunningServer(server::Server::Options options=server::Server::Options()) : runtime(1) {
+        socket_path = "/tmp/rdvlisp-test-" + std::to_string(getpid()) + ".sock";
+        options.socket_path = socket_path;
+        options.workers = 2;
+        server.reset(new server::Server(runtime, options));
+        serving = std::thread([this] {
+            server->run();
+        });
+    }
+    ~RunningServer() {
+        server->stop();
+        serving.join();
+    }
+};
+
+// The printed results of a batch, errors prefixed like test::evaluate does.
+static std::vector<std::string> evaluate(server::Client& client, const std::string& source) {
+    std::vector<std::string> texts;
+    for(auto& result : client.evaluate(source)) {
+        texts.push_back(result.error ? "error: " + result.text : result.text);
+    }
+    return texts;
+}
+
+TEST(server, macros) {
+    RunningServer running;
+    server::Client client(running.socket_path);
+    auto results = evaluate(client, "(macro twice (x) '(+ ,x ,x)) (twice 3) (twice (twice 1))");
+    CHECK_EQUAL(results.size(), 2u);
+    CHECK_EQUAL(results[0], "6");
+    CHECK_EQUAL(results[1], "4");
+    // Macros are local to their batch.
+    results = evaluate(client, "(+ 1 2) (twice 3)");
+    CHECK_EQUAL(results.size(), 2u);
+    CHECK_EQUAL(results[0], "3");
+    CHECK(results[1].find("error: ") == 0);
+}
+
+// An expansion error ends the batch like a read error, with its position.
+TEST(server, expansion_errors) {
+    RunningServer running;
+    server::Client client(running.socket_path);
+    auto results = evaluate(client, "(+ 1 2)\n'x (+ 3 4)");
+    CHECK_EQUAL(results.size(), 2u);
+    CHECK_EQUAL(results[0], "3");
+    CHECK(results[1].find("error: 2:1: quasiquote outside of a macro definition") == 0);
+}
+
+// A client sending batches without receiving their results only gets that
+// many read, then all of them answered once it receives.
+TEST(server, backpressure) {
+    server::Server::Options options;
+    options.max_pending = 4;
+    options.max_output = 1 << 16;
+    RunningServer running(options);
+    std::string source = "\"" + std::string(1 << 14, 'x') + "\"";
+    size_t count = 256;
+    server::Client client(running.socket_path);
+    std::thread sender([&client, &source, count] {
+        for(size_t i = 0; i < count; ++i) {
+            client.send(source);
+        }
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    auto read_ahead = running.server->statistics().batches;
+    size_t answered = 0;
+    for(size_t i = 0; i < count; ++i) {
+        auto results = client.receive();
+        answered += results.size() == 1 and results[0].text == source ? 1 : 0;
+    }
+    sender.join();
+    CHECK(read_ahead < count / 2);
+    CHECK_EQUAL(answered, count);
+    CHECK_EQUAL(running.server->statistics().batches, count);
+}
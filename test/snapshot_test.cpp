@@ -0,0 +1,97 @@
+//
+//  snapshot_test.cpp
+//  rdvlisp
+//
+//  Created by Ruben De Visscher on 18/10/26.
+//  Copyright (c) 2026 Ruben De Visscher. All rights reserved.
+//
+
+#include "reader.h"
+#include "snapshot.h"
+#include "test.h"
+
+using namespace rdvlisp;
+
+static runtime::Function make_function(const std::vector<std::string>& arguments, const std::string& body) {
+    std::vector<ast::Identifier> names;
+    for(auto& argument : arguments) {
+        names.push_back(ast::Identifier(argument));
+    }
+    return runtime::Function{names, read(body).get()};
+}
+
+// A namespace lib with a function, a builtin under another name, an array and
+// a nested namespace inner with a function calling lib.twice.
+static runtime::Namespace make_library(runtime::Runtime& runtime) {
+    runtime::Namespace inner("inner");
+    inner.bind("xs", runtime.eval(read("(array 1 2 3)").get()));
+    inner.bind("quadruple", runtime::make_value(make_function({"x"}, "(lib.twice (lib.twice x))")));
+    runtime::Namespace lib("lib");
+    lib.bind("twice", runtime::make_value(make_function({"x"}, "(lib.plus x x)")));
+    lib.bind("plus", runtime.value_namespace.lookup(ast::Identifier("+")));
+    lib.bind("greeting", runtime.eval(read("(concat \"hello, \" \"world\")").get()));
+    lib.bind("inner", runtime::make_value(std::move(inner)));
+    return lib;
+}
+
+TEST(snapshot, runtime_round_trip) {
+    std::string image;
+    {
+        runtime::Runtime runtime(1);
+        runtime.value_namespace.bind("lib", runtime::make_value(make_library(runtime)));
+        image = snapshot::save(runtime);
+    }
+    runtime::Runtime runtime(1);
+    snapshot::load(runtime, image.data(), image.size());
+    CHECK_EQUAL(test::evaluate(runtime, "(lib.twice 21)"), "42");
+    CHECK_EQUAL(test::evaluate(runtime, "(lib.inner.quadruple 5)"), "20");
+    CHECK_EQUAL(test::evaluate(runtime, "lib.inner.xs"), "(array 1 2 3)");
+    CHECK_EQUAL(test::evaluate(runtime, "lib.greeting"), "\"hello, world\"");
+    // Builtins are those of the runtime loaded into.
+    CHECK(runtime.value_namespace.lookup(ast::Identifier(std::vector<std::string>{"lib", "plus"})) == runtime.value_namespace.lookup(ast::Identifier("+")));
+    // Scalar types are interned again.
+    auto xs = runtime.value_namespace.lookup(ast::Identifier(std::vector<std::string>{"lib", "inner", "xs"}));
+    auto& array = boost::get<runtime::Array>(xs->variant);
+    CHECK(boost::get<types::Array>(array.type->variant).inner_type == types::sint8);
+    CHECK(boost::get<runtime::Integer>(array.elements[0]->variant).type == types::sint8);
+}
+
+TEST(snapshot, namespace_round_trip) {
+    runtime::Runtime runtime(1);
+    auto library = make_library(runtime);
+    auto image = snapshot::save(library);
+    auto restored = snapshot::load_namespace(runtime, image.data(), image.size());
+    CHECK_EQUAL(restored->name(), "lib");
+    CHECK_EQUAL(restored->bindings().size(), library.bindings().size());
+    runtime.value_namespace.bind("lib", runtime::make_value(*restored));
+    CHECK_EQUAL(test::evaluate(runtime, "(lib.inner.quadruple 3)"), "12");
+}
+
+// Every prefix of an image, and the image with any byte changed, either loads
+// or is rejected with a SnapshotError, never with another exception.
+TEST(snapshot, damaged_images) {
+    runtime::Runtime runtime(1);
+    auto image = snapshot::save(make_library(runtime));
+    for(size_t size = 0; size < image.size(); ++size) {
+        bool rejected = false;
+        try {
+            snapshot::load_namespace(runtime, image.data(), size);
+        } catch(const snapshot::SnapshotError&) {
+            rejected = true;
+        }
+        CHECK(rejected);
+    }
+    size_t rejected = 0;
+    for(size_t i = 0; i < image.size(); ++i) {
+        for(char c : {'\xff', '\x80', '\x00'}) {
+            auto damaged = image;
+            damaged[i] = c;
+            try {
+                snapshot::load_namespace(runtime, damaged.data(), damaged.size());
+            } catch(const snapshot::SnapshotError&) {
+                ++rejected;
+            }
+        }
+    }
+    CHECK(rejected > image.size());
+}
@@ -0,0 +1,69 @@
+//
+//  source_map_test.cpp
+//  rdvlisp
+//
+//  Created by Ruben De Visscher on 18/10/26.
+//  Copyright (c) 2026 Ruben De Visscher. All rights reserved.
+//
+
+#include <random>
+#include "source_map.h"
+#include "test.h"
+
+using namespace rdvlisp;
+
+static SourceMap::Position scan(const std::string& source, size_t offset) {
+    SourceMap::Position position{1, 1};
+    for(size_t i = 0; i < offset; ++i) {
+        if(source[i] == '\n') {
+            ++position.line;
+            position.column = 1;
+        } else if((static_cast<unsigned char>(source[i]) & 0xC0) != 0x80) {
+            ++position.column;
+        }
+    }
+    return position;
+}
+
+static std::string random_text(std::mt19937& rng, size_t size) {
+    std::string text;
+    while(text.size() < size) {
+        size_t kind = rng() % 1000;
+        if(kind == 0) {
+            text += '\n';
+        } else if(kind < 50) {
+            text += "\xc3\xa9";
+        } else if(kind < 60) {
+            text += "\xe2\x82\xac";
+        } else {
+            text += static_cast<char>('a' + rng() % 26);
+        }
+    }
+    return text;
+}
+
+static void check_positions(std::mt19937& rng, const SourceMap& source_map, const std::string& source) {
+    for(size_t i = 0; i < 20; ++i) {
+        size_t offset = rng() % (source.size() + 1);
+        auto expected = scan(source, offset);
+        auto position = source_map.position(offset);
+        CHECK_EQUAL(position.line, expected.line);
+        CHECK_EQUAL(position.column, expected.column);
+    }
+}
+
+// Lines much longer than the checkpoint interval, edited at random.
+TEST(source_map, long_lines) {
+    std::mt19937 rng(42);
+    std::string source = random_text(rng, 100000);
+    SourceMap source_map(source);
+    check_positions(rng, source_map, source);
+    for(size_t step = 0; step < 200; ++step) {
+        size_t start = rng() % (source.size() + 1);
+        size_t end = std::min(source.size(), start + rng() % 10000);
+        auto replacement = random_text(rng, rng() % 10000);
+        source.replace(start, end - start, replacement);
+        source_map.edit(start, end, replacement);
+        check_positions(rng, source_map, source);
+    }
+}
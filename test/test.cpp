@@ -0,0 +1,61 @@
+//
+//  test.cpp
+//  rdvlisp
+//
+//  Created by Ruben De Visscher on 18/10/26.
+//  Copyright (c) 2026 Ruben De Visscher. All rights reserved.
+//
+
+#include <cstring>
+#include <iostream>
+#include <map>
+#include "reader.h"
+#include "test.h"
+
+using namespace rdvlisp;
+
+static std::map<std::string, void (*)()>& tests() {
+    static std::map<std::string, void (*)()> tests;
+    return tests;
+}
+
+test::Registration::Registration(const char * name, void (*test)()) {
+    tests()[name] = test;
+}
+
+std::string test::evaluate(runtime::Runtime& runtime, const std::string& source) {
+    std::stringstream ss;
+    try {
+        ss << *runtime.eval(read(source).get());
+    } catch(const std::exception& e) {
+        return std::string("error: ") + e.what();
+    }
+    return ss.str();
+}
+
+// Runs the tests whose names start with one of the arguments, all of them
+// without arguments.
+int main(int argc, const char * argv[]) {
+    size_t run = 0;
+    size_t failed = 0;
+    for(auto& entry : tests()) {
+        bool selected = argc == 1;
+        for(int i = 1; i < argc; ++i) {
+            selected = selected or entry.first.compare(0, std::strlen(argv[i]), argv[i]) == 0;
+        }
+        if(!selected) {
+            continue;
+        }
+        ++run;
+        try {
+            entry.second();
+        } catch(const std::exception& e) {
+            ++failed;
+            std::cerr << "FAIL " << entry.first << ": " << e.what() << std::endl;
+            continue;
+        }
+        std::cout << "ok   " << entry.first << std::endl;
+    }
+    std::cout << run - failed << " of " << run << " tests passed" << std::endl;
+    return failed == 0 and run > 0 ? 0 : 1;
+}
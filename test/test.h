@@ -0,0 +1,60 @@
+//
+//  test.h
+//  rdvlisp
+//
+//  Created by Ruben De Visscher on 18/10/26.
+//  Copyright (c) 2026 Ruben De Visscher. All rights reserved.
+//
+
+#ifndef __rdvlisp__test__test__
+#define __rdvlisp__test__test__
+
+#include <functional>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include "eval.h"
+
+namespace rdvlisp {
+    namespace test {
+        class Failure : public std::runtime_error {
+        public:
+            Failure(const std::string& what) : std::runtime_error(what) {}
+        };
+
+        // Adds a test to those rdvlisp_test runs, named suite/case.
+        class Registration {
+        public:
+            Registration(const char * name, void (*test)());
+        };
+
+        template <typename A, typename B>
+        void check_equal(const A& a, const B& b, const char * expression, const char * file, int line) {
+            if(!(a == b)) {
+                std::stringstream ss;
+                ss << file << ":" << line << ": " << expression << ": " << a << " != " << b;
+                throw Failure(ss.str());
+            }
+        }
+
+        // Reads source, a single form, and evaluates it in runtime. Returns
+        // the printed value, or "error: " followed by what went wrong.
+        std::string evaluate(runtime::Runtime& runtime, const std::string& source);
+    }
+}
+
+#define TEST(suite, name) \
+    static void test_##suite##_##name(); \
+    static rdvlisp::test::Registration registration_##suite##_##name(#suite "/" #name, test_##suite##_##name); \
+    static void test_##suite##_##name()
+
+#define CHECK(condition) \
+    if(!(condition)) { \
+        std::stringstream check_ss; \
+        check_ss << __FILE__ << ":" << __LINE__ << ": " << #condition; \
+        throw rdvlisp::test::Failure(check_ss.str()); \
+    }
+
+#define CHECK_EQUAL(a, b) rdvlisp::test::check_equal((a), (b), #a " == " #b, __FILE__, __LINE__)
+
+#endif /* defined(__rdvlisp__test__test__) */